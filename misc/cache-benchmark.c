@@ -0,0 +1,144 @@
+/* Replay an interactive pan/zoom trace interleaved with a level 0 sweep
+   against each cache eviction policy, and report how long the viewer's
+   reads took and how often they hit the cache.  With several slides,
+   the viewer moves between them and the sweep covers the first; mixing
+   formats with different decode costs exercises cost-aware eviction. */
+/* gcc -O2 -g -std=gnu99 -o cache-benchmark cache-benchmark.c \
+   $(pkg-config --cflags --libs openslide) */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <assert.h>
+#include <openslide.h>
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+#define SWEEP_WIDTH 1000
+#define SWEEP_HEIGHT 1000
+#define VIEW_WIDTH 1024
+#define VIEW_HEIGHT 768
+#define VIEWS_PER_SWEEP_STEP 4
+#define HOT_SPOTS 4
+
+struct policy {
+  const char *name;
+  enum openslide_cache_policy policy;
+};
+
+static const struct policy policies[] = {
+  {"LRU", OPENSLIDE_CACHE_POLICY_LRU},
+  {"S3-FIFO", OPENSLIDE_CACHE_POLICY_S3FIFO},
+  {"GDS", OPENSLIDE_CACHE_POLICY_GREEDY_DUAL_SIZE},
+};
+
+// the trace must be identical for each policy
+static uint32_t rand_next(uint32_t *state) {
+  *state = *state * 1103515245 + 12345;
+  return *state >> 8;
+}
+
+static double elapsed(const struct timespec *start,
+                      const struct timespec *end) {
+  return (end->tv_sec - start->tv_sec) +
+         (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// a viewer wandering around a few areas of interest, zooming in and out
+static void view(openslide_t *osr, uint32_t *buf, uint32_t *rand) {
+  int64_t w, h;
+  openslide_get_level0_dimensions(osr, &w, &h);
+  int32_t levels = openslide_get_level_count(osr);
+  uint32_t spot = rand_next(rand) % HOT_SPOTS;
+  int32_t level = rand_next(rand) % MIN(levels, 3);
+  double downsample = openslide_get_level_downsample(osr, level);
+
+  // spots are spread along the diagonal; pan within a few views of each
+  int64_t cx = w * (2 * spot + 1) / (2 * HOT_SPOTS);
+  int64_t cy = h * (2 * spot + 1) / (2 * HOT_SPOTS);
+  int64_t x = cx + ((int64_t) (rand_next(rand) % 5) - 2) *
+              VIEW_WIDTH / 2 * downsample;
+  int64_t y = cy + ((int64_t) (rand_next(rand) % 5) - 2) *
+              VIEW_HEIGHT / 2 * downsample;
+  x = MAX(0, MIN(x, w - 1));
+  y = MAX(0, MIN(y, h - 1));
+
+  openslide_read_region(osr, buf, x, y, level, VIEW_WIDTH, VIEW_HEIGHT);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    printf("Arguments: cache-MiB slide [slide...]\n");
+    return 1;
+  }
+  size_t cache_size = (size_t) atoi(argv[1]) * 1024 * 1024;
+  int slide_count = argc - 2;
+  openslide_t **osrs = malloc(slide_count * sizeof(*osrs));
+
+  uint32_t *buf = malloc(MAX(SWEEP_WIDTH * SWEEP_HEIGHT,
+                             VIEW_WIDTH * VIEW_HEIGHT) * 4);
+
+  for (unsigned i = 0; i < sizeof(policies) / sizeof(*policies); i++) {
+    openslide_cache_t *cache =
+      openslide_cache_create_with_policy(cache_size, policies[i].policy);
+    assert(cache != NULL);
+    for (int j = 0; j < slide_count; j++) {
+      osrs[j] = openslide_open(argv[j + 2]);
+      assert(osrs[j] != NULL && openslide_get_error(osrs[j]) == NULL);
+      openslide_set_cache(osrs[j], cache);
+    }
+    openslide_cache_release(cache);
+
+    openslide_t *osr = osrs[0];
+    int64_t w, h;
+    openslide_get_level0_dimensions(osr, &w, &h);
+    uint32_t rand = 1;
+    double sweep_time = 0;
+    double view_time = 0;
+    int64_t views = 0;
+    uint64_t view_hits = 0;
+    uint64_t view_lookups = 0;
+    openslide_cache_stats_t before, after;
+    struct timespec start, end;
+
+    for (int64_t y = 0; y < h; y += SWEEP_HEIGHT) {
+      for (int64_t x = 0; x < w; x += SWEEP_WIDTH) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        openslide_read_region(osr, buf, x, y, 0,
+                              MIN(w - x, SWEEP_WIDTH),
+                              MIN(h - y, SWEEP_HEIGHT));
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        sweep_time += elapsed(&start, &end);
+
+        for (int j = 0; j < VIEWS_PER_SWEEP_STEP; j++) {
+          openslide_get_cache_stats(osr, &before);
+          clock_gettime(CLOCK_MONOTONIC, &start);
+          view(osrs[rand_next(&rand) % slide_count], buf, &rand);
+          clock_gettime(CLOCK_MONOTONIC, &end);
+          openslide_get_cache_stats(osr, &after);
+          view_time += elapsed(&start, &end);
+          view_hits += after.hits - before.hits;
+          view_lookups += (after.hits + after.misses) -
+                          (before.hits + before.misses);
+          views++;
+        }
+      }
+    }
+    for (int j = 0; j < slide_count; j++) {
+      assert(openslide_get_error(osrs[j]) == NULL);
+      openslide_close(osrs[j]);
+    }
+
+    printf("%-8s sweep %8.2f s    viewer %8.2f s  (%.2f ms/view, "
+           "%.1f%% hits)\n",
+           policies[i].name, sweep_time, view_time,
+           1000 * view_time / views,
+           view_lookups ? 100.0 * view_hits / view_lookups : 0);
+  }
+
+  free(osrs);
+  free(buf);
+  return 0;
+}
@@ -2,7 +2,7 @@
 """
 from __future__ import division
 from __future__ import print_function
-from ctypes import (c_int32, c_uint32, c_char_p, c_int64, c_void_p, POINTER, byref, c_double, cdll)
+from ctypes import (c_int, c_int32, c_uint32, c_char_p, c_int64, c_void_p, POINTER, byref, c_double, cdll)
 import ctypes.util
 from itertools import count
 import sys
@@ -220,9 +220,12 @@ get_level_downsample = _func('osz_get_level_downsample', c_double, [_OpenSlide,
 
 get_best_level_for_downsample = _func('osz_get_best_level_for_downsample', c_int32, [_OpenSlide, c_int32, c_double])
 
-_read_region = _func('osz_read_region', None, [_OpenSlide, POINTER(c_uint32), c_int32, c_int64, c_int64, c_int32, c_int64, c_int64])
+# enum openslide_pixel_format
+_PIXEL_FORMAT_RGBA = 1
+
+_read_region_format = _func('osz_read_region_format', None, [_OpenSlide, c_void_p, c_int, c_int64, c_int32, c_int64, c_int64, c_int32, c_int64, c_int64])
 def read_region(slide, zlevel, x, y, level, w, h):
-    """ Wrapper around osz_read_region
+    """ Wrapper around osz_read_region_format
     """
     if w < 0 or h < 0:
         # OpenSlide would catch this, but not before we tried to allocate
@@ -231,9 +234,10 @@ def read_region(slide, zlevel, x, y, level, w, h):
     if w == 0 or h == 0:
         # PIL.Image.frombuffer() would raise an exception
         return PIL.Image.new('RGBA', (w, h))
+    # OpenSlide converts to straight RGBA as it reads
     buf = (w * h * c_uint32)()
-    _read_region(slide, buf, zlevel, x, y, level, w, h)
-    return _load_image(buf, (w, h))
+    _read_region_format(slide, buf, _PIXEL_FORMAT_RGBA, 0, zlevel, x, y, level, w, h)
+    return PIL.Image.frombuffer('RGBA', (w, h), buf, 'raw', 'RGBA', 0, 1)
 
 get_error = _func('openslide_get_error', c_char_p, [_OpenSlide], _check_string)
 
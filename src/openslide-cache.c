@@ -23,7 +23,13 @@
 
 #include "openslide-private.h"
 
+#include <string.h>
 #include <glib.h>
+#include <cairo.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #if defined(HAVE_UINTPTR_T) || defined(uintptr_t)
 #define ptr_int uintptr_t
@@ -33,20 +39,53 @@
 #define ptr_int uint64_t
 #endif
 
+// Each cache is split into independently locked shards, selected by key
+// hash, so that readers of different tiles don't contend on one mutex.
+// Shards are kept large enough to hold several big tiles.
+#define CACHE_MAX_SHARDS 64
+#define CACHE_MIN_SHARD_CAPACITY (8 * 1024 * 1024)
+
+// likewise for the lock protecting a binding's cache pointer
+#define BINDING_LOCK_COUNT 16
+
+// with OPENSLIDE_DEBUG=cache, log statistics every this many lookups
+#define CACHE_DEBUG_INTERVAL 4096
+
+// Decoded tiles of a single color share one buffer per color and size.
+// In each store, the first cached entry sharing a buffer is charged for
+// all of it, and the others only for their bookkeeping, at roughly this
+// many bytes.  When the charged entry leaves the store, the charge moves
+// to the next one.
+#define SOLID_ENTRY_CHARGE 128
+
+// A buffer held only by callers and batches isn't charged to any store,
+// so there are at most this many; further solid tiles are cached like any
+// other.
+#define SOLID_MAX_TILES 16
+
 // hash table key
 struct _openslide_cache_key {
-  void *plane;  // cookie for coordinate plane (level, grid, etc.)
+  const char *slide_id;  // interned or owned by the binding; compared by address
+  int32_t plane;  // index of the coordinate plane; see binding_get_plane_index()
   int64_t x;
   int64_t y;
 };
 
 // hash table value
 struct _openslide_cache_value {
-  GList *link;            // direct pointer to the node in the list
+  GList *link;            // direct pointer to the node in the policy's list
   struct _openslide_cache_key *key; // for removing keys when aged out
-  struct _openslide_cache *cache; // sadly, for total_bytes and the list
+  struct cache_store *store; // sadly, for total_bytes and the policy
 
   struct _openslide_cache_entry *entry;  // may outlive the value
+  int charge;  // bytes counted against the store
+  GList *solid_link;  // node in the store's list for entry->solid, if set
+
+  // eviction policy state
+  uint8_t queue;
+  uint8_t freq;
+  GSequenceIter *iter;
+  double priority;
 };
 
 // datum
@@ -54,41 +93,165 @@ struct _openslide_cache_entry {
   gint refcount;  // atomic ops only
   void *data;
   int size;
+  int charge;  // bytes counted against capacity, unless a store shares data
+  bool slab;  // data is from _openslide_slab_alloc(), else g_malloc()
+  struct solid_tile *solid;  // owns data instead, if set
+  int64_t cost;  // microseconds taken to produce the data, if known
 };
 
-struct _openslide_cache {
-  GMutex *mutex;
-  GQueue *list;
+// buffer shared by the cached tiles of one color and size
+struct solid_tile {
+  uint32_t color;  // with size, the hash table key
+  int size;
+  uint32_t *data;
+  int refcount;  // protected by solid_lock
+};
+
+// eviction policy.  all callbacks are called with the shard mutex held.
+struct cache_policy {
+  void *(*create)(void);
+  void (*destroy)(void *data);
+
+  // a value has been added to the store
+  void (*insert)(struct cache_store *store,
+                 struct _openslide_cache_value *value);
+  // a value has been found by lookup
+  void (*touch)(struct cache_store *store,
+                struct _openslide_cache_value *value);
+  // a value is being removed from the store
+  void (*remove)(struct cache_store *store,
+                 struct _openslide_cache_value *value);
+  // a value's charge has changed from old_charge.  optional.
+  void (*recharge)(struct cache_store *store,
+                   struct _openslide_cache_value *value,
+                   int old_charge);
+  // choose the next value to evict, or NULL if the store is empty.
+  // the caller removes it.
+  struct _openslide_cache_value *(*victim)(struct cache_store *store);
+  // every value of a slide has been removed, and its id is about to be
+  // freed; forget anything else kept about its keys.  optional.
+  void (*forget_slide)(struct cache_store *store, const char *slide_id);
+};
+
+// tiers, each with its own capacity
+enum cache_tier {
+  CACHE_TIER_DECODED,     // ARGB tile buffers
+  CACHE_TIER_COMPRESSED,  // raw tile bytes as stored in the slide
+  CACHE_TIER_COUNT,
+};
+
+// one tier of one shard
+struct cache_store {
   GHashTable *hashtable;
 
-  int capacity;
-  int total_size;
+  const struct cache_policy *policy;
+  void *policy_data;
+
+  int64_t capacity;
+  int64_t total_size;
+
+  // struct solid_tile -> GQueue of the values sharing its buffer; the
+  // head is charged for the buffer
+  GHashTable *solid_values;
+
+  // statistics
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t insertions;
+  uint64_t evictions;
+  uint64_t rejected;
+  uint64_t deduplicated;
+  uint64_t shared_hits;  // decoded tier only
+};
+
+struct cache_shard {
+  GMutex *mutex;
+  struct cache_store tiers[CACHE_TIER_COUNT];
+
+  GHashTable *pending;  // key -> struct cache_claim; decoded tier only
+};
+
+// a decoded tile missing from the cache, which one thread has undertaken
+// to produce.  other threads wanting the tile wait for it instead of
+// decoding it again.  protected by the shard mutex.
+struct cache_claim {
+  struct _openslide_cache_key key;
+  struct _openslide_cache *cache;  // owner's reference
+  GThread *owner;
+  GTimeVal start;  // for measuring the cost of producing the tile
+
+  GCond *cond;  // signaled when done
+  bool done;
+  struct _openslide_cache_entry *entry;  // result, or NULL if abandoned
+  int refcount;  // owner and waiters
+};
+
+struct _openslide_cache {
+  struct cache_shard *shards;
+  int shard_count;  // power of 2
+
+  gint refcount;  // atomic ops only; one per binding plus the creator's
 
   gint warned_overlarge_entry;
+
+  struct _openslide_diskcache *disk;  // atomic ops only; set at most once
+  struct _openslide_shmcache *shm;  // atomic ops only; set at most once
+};
+
+// caches with a persistent tier, so that reads in processes without one
+// don't pay for looking
+static volatile gint disk_cache_count;
+
+// decoded tier activity of one binding on one plane
+struct plane_stats {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t insertions;
+  uint64_t rejected;
+  uint64_t deduplicated;
+};
+
+// connection between an openslide_t and the cache it is currently using
+struct _openslide_cache_binding {
+  // protect cache pointer.  readers hold the lock selected by key hash
+  // while using the cache; writers take all of them.
+  GMutex *mutexes[BINDING_LOCK_COUNT];
+  struct _openslide_cache *cache;
+
+  openslide_t *osr;  // for mapping planes to level indexes
+  const char *slide_id;  // interned if persistent, else owned
+  bool persistent;  // slide_id is stable across processes
+
+  // per-plane statistics, split like the locks that protect them
+  struct plane_stats *plane_stats[BINDING_LOCK_COUNT];
+  int32_t plane_count;
+
+  gint debug_lookups;  // atomic ops only
 };
 
 // eviction
-// mutex must be held
-static void possibly_evict(struct _openslide_cache *cache, int incoming_size) {
+// store mutex must be held
+static void possibly_evict(struct cache_store *store, int incoming_size) {
   g_assert(incoming_size >= 0);
 
-  int size = cache->total_size + incoming_size;
-  int target = cache->capacity;
+  int64_t target = store->capacity;
 
-  while(size > target) {
-    // get key of last element
-    struct _openslide_cache_value *value = g_queue_peek_tail(cache->list);
+  // removing a value can move a shared buffer's charge to another, so
+  // recheck the total each time
+  while(store->total_size + incoming_size > target) {
+    // ask the policy for a victim
+    struct _openslide_cache_value *value = store->policy->victim(store);
     if (value == NULL) {
-      return; // cache is empty
+      return; // store is empty
     }
     struct _openslide_cache_key *key = value->key;
 
-    //g_debug("EVICT: size: %d", value->entry->size);
+    //g_debug("EVICT: size: %d", value->charge);
 
-    size -= value->entry->size;
+    store->evictions++;
 
     // remove from hashtable, this will trigger removal from everything
-    bool result = g_hash_table_remove(cache->hashtable, key);
+    bool result = g_hash_table_remove(store->hashtable, key);
     g_assert(result);
   }
 }
@@ -99,7 +262,8 @@ static guint hash_func(gconstpointer key) {
   const struct _openslide_cache_key *c_key = key;
 
   // assume 32-bit hash
-  return (guint) (((ptr_int) c_key->plane) ^
+  return (guint) (((ptr_int) c_key->slide_id) ^
+                  (((uint64_t) c_key->plane) << 24) ^
                   ((34369 * (uint64_t) c_key->y) + ((uint64_t) c_key->x)));
 }
 
@@ -108,22 +272,84 @@ static gboolean key_equal_func(gconstpointer a,
   const struct _openslide_cache_key *c_a = a;
   const struct _openslide_cache_key *c_b = b;
 
-  return (c_a->plane == c_b->plane) && (c_a->x == c_b->x) && (c_a->y == c_b->y);
+  return (c_a->slide_id == c_b->slide_id) && (c_a->plane == c_b->plane) &&
+    (c_a->x == c_b->x) && (c_a->y == c_b->y);
 }
 
 static void hash_destroy_key(gpointer data) {
   g_slice_free(struct _openslide_cache_key, data);
 }
 
+// store mutex must be held
+static void set_value_charge(struct cache_store *store,
+                             struct _openslide_cache_value *value,
+                             int charge) {
+  int old_charge = value->charge;
+  value->charge = charge;
+  store->total_size += charge - old_charge;
+  if (store->policy->recharge) {
+    store->policy->recharge(store, value, old_charge);
+  }
+}
+
+// the charge a value for entry will have when added to the store.
+// store mutex must be held
+static int get_store_charge(struct cache_store *store,
+                            struct _openslide_cache_entry *entry) {
+  if (entry->solid == NULL) {
+    return entry->charge;
+  }
+  if (g_hash_table_lookup(store->solid_values, entry->solid)) {
+    return SOLID_ENTRY_CHARGE;
+  }
+  return entry->solid->size;
+}
+
+// track a value sharing a solid buffer, charging it for the buffer if it
+// is the first in the store.  store mutex must be held
+static void solid_value_add(struct cache_store *store,
+                            struct _openslide_cache_value *value) {
+  struct solid_tile *solid = value->entry->solid;
+  GQueue *values = g_hash_table_lookup(store->solid_values, solid);
+  if (values == NULL) {
+    values = g_queue_new();
+    g_hash_table_insert(store->solid_values, solid, values);
+  }
+  g_queue_push_tail(values, value);
+  value->solid_link = g_queue_peek_tail_link(values);
+  value->charge = g_queue_get_length(values) == 1 ? solid->size
+                                                   : SOLID_ENTRY_CHARGE;
+}
+
+// stop tracking a value sharing a solid buffer.  if it was charged for
+// the buffer and others still share it, the next one is charged instead.
+// store mutex must be held
+static void solid_value_remove(struct cache_store *store,
+                               struct _openslide_cache_value *value) {
+  struct solid_tile *solid = value->entry->solid;
+  GQueue *values = g_hash_table_lookup(store->solid_values, solid);
+  bool charged = value->solid_link == g_queue_peek_head_link(values);
+  g_queue_delete_link(values, value->solid_link);
+  if (g_queue_is_empty(values)) {
+    g_hash_table_remove(store->solid_values, solid);
+    g_queue_free(values);
+  } else if (charged) {
+    set_value_charge(store, g_queue_peek_head(values), solid->size);
+  }
+}
+
 static void hash_destroy_value(gpointer data) {
   struct _openslide_cache_value *value = data;
 
-  // remove the item from the list
-  g_queue_delete_link(value->cache->list, value->link);
+  // remove the item from the policy's bookkeeping
+  value->store->policy->remove(value->store, value);
 
   // decrement the total size
-  value->cache->total_size -= value->entry->size;
-  g_assert(value->cache->total_size >= 0);
+  value->store->total_size -= value->charge;
+  if (value->entry->solid) {
+    solid_value_remove(value->store, value);
+  }
+  g_assert(value->store->total_size >= 0);
 
   // unref the entry
   _openslide_cache_entry_unref(value->entry);
@@ -132,179 +358,1902 @@ static void hash_destroy_value(gpointer data) {
   g_slice_free(struct _openslide_cache_value, value);
 }
 
-struct _openslide_cache *_openslide_cache_create(int capacity_in_bytes) {
-  struct _openslide_cache *cache = g_slice_new0(struct _openslide_cache);
+// LRU policy: a single list, most recently used at the head
 
-  // init mutex
-  cache->mutex = g_mutex_new();
+static void *lru_create(void) {
+  return g_queue_new();
+}
 
-  // init queue
-  cache->list = g_queue_new();
+static void lru_destroy(void *data) {
+  g_queue_free(data);
+}
 
-  // init hashtable
-  cache->hashtable = g_hash_table_new_full(hash_func,
-					   key_equal_func,
-					   hash_destroy_key,
-					   hash_destroy_value);
+static void lru_insert(struct cache_store *store,
+                       struct _openslide_cache_value *value) {
+  GQueue *list = store->policy_data;
+  g_queue_push_head(list, value);
+  value->link = g_queue_peek_head_link(list);
+}
 
-  // init byte_capacity
-  cache->capacity = capacity_in_bytes;
+static void lru_touch(struct cache_store *store,
+                      struct _openslide_cache_value *value) {
+  // move to front of list
+  GQueue *list = store->policy_data;
+  g_queue_unlink(list, value->link);
+  g_queue_push_head_link(list, value->link);
+}
 
-  return cache;
+static void lru_remove(struct cache_store *store,
+                       struct _openslide_cache_value *value) {
+  g_queue_delete_link(store->policy_data, value->link);
 }
 
-void _openslide_cache_destroy(struct _openslide_cache *cache) {
-  // clear hashtable (auto-deletes all data)
-  g_mutex_lock(cache->mutex);
-  g_hash_table_unref(cache->hashtable);
-  g_mutex_unlock(cache->mutex);
+static struct _openslide_cache_value *lru_victim(struct cache_store *store) {
+  return g_queue_peek_tail(store->policy_data);
+}
 
-  // clear list
-  g_queue_free(cache->list);
+static const struct cache_policy lru_policy = {
+  .create = lru_create,
+  .destroy = lru_destroy,
+  .insert = lru_insert,
+  .touch = lru_touch,
+  .remove = lru_remove,
+  .victim = lru_victim,
+};
 
-  // free mutex
-  g_mutex_free(cache->mutex);
+// S3-FIFO policy (Yang et al., SOSP '23).  New entries go into a small
+// probationary FIFO and are only promoted to the main FIFO if they are
+// read again before reaching its tail, so a one-pass scan over a slide
+// cycles through the small queue without displacing the working set.
+// Entries in the main queue get another trip around for each recent
+// read.  Keys evicted from the small queue are remembered in a ghost
+// queue, and go straight to the main queue if they come back soon.
+// Hits only bump a counter, so lookups don't reorder any list.
+
+#define S3FIFO_SMALL_PERCENT 10
+#define S3FIFO_MAX_FREQ 3
+
+enum s3fifo_queue {
+  S3FIFO_SMALL,
+  S3FIFO_MAIN,
+};
 
-  // destroy struct
-  g_slice_free(struct _openslide_cache, cache);
+struct s3fifo_ghost {
+  struct _openslide_cache_key key;
+  int size;
+  GList *link;
+};
+
+struct s3fifo {
+  // values; newest at the head
+  GQueue *small;
+  GQueue *main;
+  int64_t small_size;
+
+  // recently evicted keys; newest at the head
+  GQueue *ghost;
+  GHashTable *ghost_keys;  // key -> struct s3fifo_ghost
+  int64_t ghost_size;
+};
+
+static int64_t s3fifo_small_target(struct cache_store *store) {
+  return store->capacity / 100 * S3FIFO_SMALL_PERCENT;
 }
 
+static void *s3fifo_create(void) {
+  struct s3fifo *s = g_slice_new0(struct s3fifo);
+  s->small = g_queue_new();
+  s->main = g_queue_new();
+  s->ghost = g_queue_new();
+  s->ghost_keys = g_hash_table_new(hash_func, key_equal_func);
+  return s;
+}
 
-int _openslide_cache_get_capacity(struct _openslide_cache *cache) {
-  g_mutex_lock(cache->mutex);
-  int capacity = cache->capacity;
-  g_mutex_unlock(cache->mutex);
-  return capacity;
+static void s3fifo_ghost_remove(struct s3fifo *s, struct s3fifo_ghost *ghost) {
+  g_hash_table_remove(s->ghost_keys, &ghost->key);
+  g_queue_delete_link(s->ghost, ghost->link);
+  s->ghost_size -= ghost->size;
+  g_slice_free(struct s3fifo_ghost, ghost);
 }
 
-void _openslide_cache_set_capacity(struct _openslide_cache *cache,
-				   int capacity_in_bytes) {
-  g_assert(capacity_in_bytes >= 0);
+static void s3fifo_ghost_add(struct cache_store *store,
+                             struct _openslide_cache_value *value) {
+  struct s3fifo *s = store->policy_data;
+
+  struct s3fifo_ghost *ghost = g_slice_new(struct s3fifo_ghost);
+  ghost->key = *value->key;
+  ghost->size = value->charge;
+  g_queue_push_head(s->ghost, ghost);
+  ghost->link = g_queue_peek_head_link(s->ghost);
+  g_hash_table_insert(s->ghost_keys, &ghost->key, ghost);
+  s->ghost_size += ghost->size;
+
+  // remember about as much as the main queue can hold
+  int64_t target = store->capacity - s3fifo_small_target(store);
+  while (s->ghost_size > target) {
+    s3fifo_ghost_remove(s, g_queue_peek_tail(s->ghost));
+  }
+}
 
-  g_mutex_lock(cache->mutex);
-  cache->capacity = capacity_in_bytes;
-  possibly_evict(cache, 0);
-  g_mutex_unlock(cache->mutex);
+// ghosts compare slide ids by address, which may be reused
+static void s3fifo_forget_slide(struct cache_store *store,
+                                const char *slide_id) {
+  struct s3fifo *s = store->policy_data;
+  GList *link = s->ghost->head;
+  while (link) {
+    struct s3fifo_ghost *ghost = link->data;
+    link = link->next;
+    if (ghost->key.slide_id == slide_id) {
+      s3fifo_ghost_remove(s, ghost);
+    }
+  }
 }
 
-// put and get
+static void s3fifo_destroy(void *data) {
+  struct s3fifo *s = data;
+  struct s3fifo_ghost *ghost;
+  while ((ghost = g_queue_peek_tail(s->ghost)) != NULL) {
+    s3fifo_ghost_remove(s, ghost);
+  }
+  g_hash_table_unref(s->ghost_keys);
+  g_queue_free(s->ghost);
+  g_queue_free(s->main);
+  g_queue_free(s->small);
+  g_slice_free(struct s3fifo, s);
+}
 
-// the cache retains one reference, and the caller gets another one.  the
-// entry must be unreffed when the caller is done with it.
-void _openslide_cache_put(struct _openslide_cache *cache,
-			  void *plane,
-			  int64_t x,
-			  int64_t y,
-			  void *data,
-			  int size_in_bytes,
-			  struct _openslide_cache_entry **_entry) {
-  // always create cache entry for caller's reference
-  struct _openslide_cache_entry *entry =
-      g_slice_new(struct _openslide_cache_entry);
-  // one ref for the caller
-  g_atomic_int_set(&entry->refcount, 1);
-  entry->data = data;
-  entry->size = size_in_bytes;
-  *_entry = entry;
+static void s3fifo_insert(struct cache_store *store,
+                          struct _openslide_cache_value *value) {
+  struct s3fifo *s = store->policy_data;
+  struct s3fifo_ghost *ghost = g_hash_table_lookup(s->ghost_keys, value->key);
+
+  value->freq = 0;
+  if (ghost) {
+    // evicted recently; skip probation
+    s3fifo_ghost_remove(s, ghost);
+    value->queue = S3FIFO_MAIN;
+    g_queue_push_head(s->main, value);
+    value->link = g_queue_peek_head_link(s->main);
+  } else {
+    value->queue = S3FIFO_SMALL;
+    g_queue_push_head(s->small, value);
+    value->link = g_queue_peek_head_link(s->small);
+    s->small_size += value->charge;
+  }
+}
 
-  // lock
-  g_mutex_lock(cache->mutex);
+static void s3fifo_touch(struct cache_store *store G_GNUC_UNUSED,
+                         struct _openslide_cache_value *value) {
+  if (value->freq < S3FIFO_MAX_FREQ) {
+    value->freq++;
+  }
+}
 
-  // don't try to put anything in the cache that cannot possibly fit
-  if (size_in_bytes > cache->capacity) {
-    //g_debug("refused %p", entry);
-    g_mutex_unlock(cache->mutex);
-    _openslide_performance_warn_once(&cache->warned_overlarge_entry,
-                                     "Rejecting overlarge cache entry of "
-                                     "size %d bytes", size_in_bytes);
-    return;
+static void s3fifo_remove(struct cache_store *store,
+                          struct _openslide_cache_value *value) {
+  struct s3fifo *s = store->policy_data;
+  if (value->queue == S3FIFO_SMALL) {
+    g_queue_delete_link(s->small, value->link);
+    s->small_size -= value->charge;
+  } else {
+    g_queue_delete_link(s->main, value->link);
   }
+}
 
-  possibly_evict(cache, size_in_bytes); // already checks for size >= 0
+static void s3fifo_recharge(struct cache_store *store,
+                            struct _openslide_cache_value *value,
+                            int old_charge) {
+  struct s3fifo *s = store->policy_data;
+  if (value->queue == S3FIFO_SMALL) {
+    s->small_size += value->charge - old_charge;
+  }
+}
 
-  // create key
-  struct _openslide_cache_key *key = g_slice_new(struct _openslide_cache_key);
-  key->plane = plane;
-  key->x = x;
-  key->y = y;
+static struct _openslide_cache_value *s3fifo_victim(struct cache_store *store) {
+  struct s3fifo *s = store->policy_data;
+
+  while (true) {
+    if (s->small_size > s3fifo_small_target(store) ||
+        g_queue_is_empty(s->main)) {
+      struct _openslide_cache_value *value = g_queue_peek_tail(s->small);
+      if (value == NULL) {
+        return NULL; // store is empty
+      }
+      if (value->freq > 1) {
+        // read again while on probation; promote
+        g_queue_unlink(s->small, value->link);
+        s->small_size -= value->charge;
+        g_queue_push_head_link(s->main, value->link);
+        value->queue = S3FIFO_MAIN;
+        value->freq = 0;
+        continue;
+      }
+      s3fifo_ghost_add(store, value);
+      return value;
+    } else {
+      struct _openslide_cache_value *value = g_queue_peek_tail(s->main);
+      if (value->freq > 0) {
+        // give it another trip
+        g_queue_unlink(s->main, value->link);
+        g_queue_push_head_link(s->main, value->link);
+        value->freq--;
+        continue;
+      }
+      return value;
+    }
+  }
+}
 
-  // create value
-  struct _openslide_cache_value *value =
-    g_slice_new(struct _openslide_cache_value);
-  value->key = key;
-  value->cache = cache;
-  value->entry = entry;
+static const struct cache_policy s3fifo_policy = {
+  .create = s3fifo_create,
+  .destroy = s3fifo_destroy,
+  .insert = s3fifo_insert,
+  .touch = s3fifo_touch,
+  .remove = s3fifo_remove,
+  .recharge = s3fifo_recharge,
+  .victim = s3fifo_victim,
+  .forget_slide = s3fifo_forget_slide,
+};
 
-  // insert at head of queue
-  g_queue_push_head(cache->list, value);
-  value->link = g_queue_peek_head_link(cache->list);
+// GreedyDual-Size policy (Cao and Irani, USITS '97).  Each value has a
+// priority of the inflation value plus the cost of producing it per
+// byte, and the value with the lowest priority is evicted.  The inflation
+// value rises to the priority of each victim, so values which aren't read
+// again eventually age out however costly they were.  Reads restore a
+// value's priority relative to the current inflation value.  Values of
+// unknown cost count as cheap.
+
+struct gds {
+  GSequence *values;  // by priority, lowest first
+  double inflation;
+};
 
-  // insert into hash table
-  g_hash_table_replace(cache->hashtable, key, value);
+static gint gds_compare(gconstpointer a, gconstpointer b,
+                        gpointer data G_GNUC_UNUSED) {
+  const struct _openslide_cache_value *va = a;
+  const struct _openslide_cache_value *vb = b;
+  return (va->priority > vb->priority) - (va->priority < vb->priority);
+}
 
-  // increase size
-  cache->total_size += size_in_bytes;
+static double gds_value(struct _openslide_cache_value *value,
+                        int charge) {
+  int64_t cost = MAX(value->entry->cost, 1);
+  return (double) cost / MAX(charge, 1);
+}
 
-  // another ref for the cache
-  g_atomic_int_inc(&entry->refcount);
+static double gds_priority(struct gds *g,
+                           struct _openslide_cache_value *value) {
+  return g->inflation + gds_value(value, value->charge);
+}
 
-  // unlock
-  g_mutex_unlock(cache->mutex);
+static void *gds_create(void) {
+  struct gds *g = g_slice_new0(struct gds);
+  g->values = g_sequence_new(NULL);
+  return g;
+}
 
-  //g_debug("insert %p", entry);
+static void gds_destroy(void *data) {
+  struct gds *g = data;
+  g_sequence_free(g->values);
+  g_slice_free(struct gds, g);
 }
 
-// entry must be unreffed when the caller is done with the data
-void *_openslide_cache_get(struct _openslide_cache *cache,
-			   void *plane,
-			   int64_t x,
-			   int64_t y,
-			   struct _openslide_cache_entry **_entry) {
-  // lock
-  g_mutex_lock(cache->mutex);
+static void gds_insert(struct cache_store *store,
+                       struct _openslide_cache_value *value) {
+  struct gds *g = store->policy_data;
+  value->priority = gds_priority(g, value);
+  value->iter = g_sequence_insert_sorted(g->values, value, gds_compare, NULL);
+}
 
-  // create key
-  struct _openslide_cache_key key = { .plane = plane, .x = x, .y = y };
+static void gds_touch(struct cache_store *store,
+                      struct _openslide_cache_value *value) {
+  struct gds *g = store->policy_data;
+  value->priority = gds_priority(g, value);
+  g_sequence_sort_changed(value->iter, gds_compare, NULL);
+}
 
-  // lookup key, maybe return NULL
-  struct _openslide_cache_value *value = g_hash_table_lookup(cache->hashtable,
-							     &key);
-  if (value == NULL) {
-    g_mutex_unlock(cache->mutex);
-    *_entry = NULL;
+static void gds_remove(struct cache_store *store G_GNUC_UNUSED,
+                       struct _openslide_cache_value *value) {
+  g_sequence_remove(value->iter);
+}
+
+static void gds_recharge(struct cache_store *store G_GNUC_UNUSED,
+                         struct _openslide_cache_value *value,
+                         int old_charge) {
+  // keep the inflation value it was last given
+  value->priority += gds_value(value, value->charge) -
+                     gds_value(value, old_charge);
+  g_sequence_sort_changed(value->iter, gds_compare, NULL);
+}
+
+static struct _openslide_cache_value *gds_victim(struct cache_store *store) {
+  struct gds *g = store->policy_data;
+  GSequenceIter *iter = g_sequence_get_begin_iter(g->values);
+  if (g_sequence_iter_is_end(iter)) {
+    return NULL; // store is empty
+  }
+  struct _openslide_cache_value *value = g_sequence_get(iter);
+  g->inflation = value->priority;
+  return value;
+}
+
+static const struct cache_policy gds_policy = {
+  .create = gds_create,
+  .destroy = gds_destroy,
+  .insert = gds_insert,
+  .touch = gds_touch,
+  .remove = gds_remove,
+  .recharge = gds_recharge,
+  .victim = gds_victim,
+};
+
+static const struct cache_policy *get_policy(enum openslide_cache_policy policy) {
+  switch (policy) {
+  case OPENSLIDE_CACHE_POLICY_LRU:
+    return &lru_policy;
+  case OPENSLIDE_CACHE_POLICY_S3FIFO:
+    return &s3fifo_policy;
+  case OPENSLIDE_CACHE_POLICY_GREEDY_DUAL_SIZE:
+    return &gds_policy;
+  default:
     return NULL;
   }
+}
 
-  // if found, move to front of list
-  GList *link = value->link;
-  g_queue_unlink(cache->list, link);
-  g_queue_push_head_link(cache->list, link);
+// scramble the key hash so that shard and lock selection don't correlate
+// with the hash table's bucket selection
+static guint mix_hash(guint hash) {
+  return hash * 2654435769U;
+}
 
-  // acquire entry reference for the caller
-  struct _openslide_cache_entry *entry = value->entry;
-  g_atomic_int_inc(&entry->refcount);
+static struct cache_shard *get_shard(struct _openslide_cache *cache,
+                                     guint hash) {
+  return &cache->shards[(mix_hash(hash) >> 16) & (cache->shard_count - 1)];
+}
 
-  //g_debug("cache hit! %p %p %"PRId64" %"PRId64, (void *) entry, (void *) plane, x, y);
+// divide a tier's capacity among shards
+// all shard mutexes must be held
+static void distribute_capacity(struct _openslide_cache *cache,
+                                enum cache_tier tier,
+                                int64_t capacity_in_bytes) {
+  for (int i = 0; i < cache->shard_count; i++) {
+    struct cache_store *store = &cache->shards[i].tiers[tier];
+    store->capacity = capacity_in_bytes / cache->shard_count;
+    if (i < capacity_in_bytes % cache->shard_count) {
+      store->capacity++;
+    }
+  }
+}
 
-  // unlock
-  g_mutex_unlock(cache->mutex);
+static int shard_count_for_capacity(int64_t capacity_in_bytes) {
+  int count = 1;
+  while (count < CACHE_MAX_SHARDS &&
+         capacity_in_bytes / (count * 2) >= CACHE_MIN_SHARD_CAPACITY) {
+    count *= 2;
+  }
+  return count;
+}
 
-  // return data
-  *_entry = entry;
-  return entry->data;
+struct _openslide_cache *_openslide_cache_create(int64_t capacity_in_bytes,
+                                                 enum openslide_cache_policy policy) {
+  const struct cache_policy *ops = get_policy(policy);
+  g_assert(ops != NULL);
+
+  struct _openslide_cache *cache = g_slice_new0(struct _openslide_cache);
+
+  // one ref for the caller
+  g_atomic_int_set(&cache->refcount, 1);
+
+  // init shards.  the compressed tier starts out disabled, and is sharded
+  // like the decoded tier.
+  cache->shard_count = shard_count_for_capacity(capacity_in_bytes);
+  cache->shards = g_new0(struct cache_shard, cache->shard_count);
+  for (int i = 0; i < cache->shard_count; i++) {
+    struct cache_shard *shard = &cache->shards[i];
+    shard->mutex = g_mutex_new();
+    shard->pending = g_hash_table_new(hash_func, key_equal_func);
+    for (int tier = 0; tier < CACHE_TIER_COUNT; tier++) {
+      struct cache_store *store = &shard->tiers[tier];
+      store->policy = ops;
+      store->policy_data = ops->create();
+      store->hashtable = g_hash_table_new_full(hash_func,
+                                               key_equal_func,
+                                               hash_destroy_key,
+                                               hash_destroy_value);
+      store->solid_values = g_hash_table_new(g_direct_hash, g_direct_equal);
+    }
+  }
+
+  // init byte_capacity
+  distribute_capacity(cache, CACHE_TIER_DECODED, capacity_in_bytes);
+
+  return cache;
 }
 
-// value unref
-void _openslide_cache_entry_unref(struct _openslide_cache_entry *entry) {
-  //g_debug("unref %p, refs %d", entry, g_atomic_int_get(&entry->refcount));
+static void cache_destroy(struct _openslide_cache *cache) {
+  for (int i = 0; i < cache->shard_count; i++) {
+    struct cache_shard *shard = &cache->shards[i];
 
-  if (g_atomic_int_dec_and_test(&entry->refcount)) {
-    // free the data
-    g_slice_free1(entry->size, entry->data);
+    for (int tier = 0; tier < CACHE_TIER_COUNT; tier++) {
+      struct cache_store *store = &shard->tiers[tier];
 
-    // free the entry
-    g_slice_free(struct _openslide_cache_entry, entry);
+      // clear hashtable (auto-deletes all data)
+      g_mutex_lock(shard->mutex);
+      g_hash_table_unref(store->hashtable);
+      g_mutex_unlock(shard->mutex);
 
-    //g_debug("free %p", entry);
+      // clear policy state
+      store->policy->destroy(store->policy_data);
+      g_assert(g_hash_table_size(store->solid_values) == 0);
+      g_hash_table_unref(store->solid_values);
+    }
+
+    // claims hold a cache reference, so there are none left
+    g_assert(g_hash_table_size(shard->pending) == 0);
+    g_hash_table_unref(shard->pending);
+
+    // free mutex
+    g_mutex_free(shard->mutex);
+  }
+  g_free(cache->shards);
+
+  // stop persistent tier
+  if (cache->disk) {
+    _openslide_diskcache_destroy(cache->disk);
+    g_atomic_int_add(&disk_cache_count, -1);
+  }
+
+  // detach from shared tier
+  if (cache->shm) {
+    _openslide_shmcache_destroy(cache->shm);
+  }
+
+  // destroy struct
+  g_slice_free(struct _openslide_cache, cache);
+}
+
+struct _openslide_cache *_openslide_cache_ref(struct _openslide_cache *cache) {
+  g_atomic_int_inc(&cache->refcount);
+  return cache;
+}
+
+void _openslide_cache_unref(struct _openslide_cache *cache) {
+  if (g_atomic_int_dec_and_test(&cache->refcount)) {
+    cache_destroy(cache);
+  }
+}
+
+
+static int64_t get_tier_capacity(struct _openslide_cache *cache,
+                                 enum cache_tier tier) {
+  int64_t capacity = 0;
+  for (int i = 0; i < cache->shard_count; i++) {
+    struct cache_shard *shard = &cache->shards[i];
+    g_mutex_lock(shard->mutex);
+    capacity += shard->tiers[tier].capacity;
+    g_mutex_unlock(shard->mutex);
+  }
+  return capacity;
+}
+
+static void set_tier_capacity(struct _openslide_cache *cache,
+                              enum cache_tier tier,
+                              int64_t capacity_in_bytes) {
+  g_assert(capacity_in_bytes >= 0);
+
+  // the shard count is fixed at creation, so a much smaller capacity
+  // leaves little room per shard
+  for (int i = 0; i < cache->shard_count; i++) {
+    g_mutex_lock(cache->shards[i].mutex);
+  }
+  distribute_capacity(cache, tier, capacity_in_bytes);
+  for (int i = 0; i < cache->shard_count; i++) {
+    possibly_evict(&cache->shards[i].tiers[tier], 0);
+    g_mutex_unlock(cache->shards[i].mutex);
+  }
+}
+
+int64_t _openslide_cache_get_capacity(struct _openslide_cache *cache) {
+  return get_tier_capacity(cache, CACHE_TIER_DECODED);
+}
+
+void _openslide_cache_set_capacity(struct _openslide_cache *cache,
+				   int64_t capacity_in_bytes) {
+  set_tier_capacity(cache, CACHE_TIER_DECODED, capacity_in_bytes);
+}
+
+int64_t _openslide_cache_get_compressed_capacity(struct _openslide_cache *cache) {
+  return get_tier_capacity(cache, CACHE_TIER_COMPRESSED);
+}
+
+void _openslide_cache_set_compressed_capacity(struct _openslide_cache *cache,
+                                              int64_t capacity_in_bytes) {
+  set_tier_capacity(cache, CACHE_TIER_COMPRESSED, capacity_in_bytes);
+}
+
+// bindings
+
+struct _openslide_cache_binding *_openslide_cache_binding_create(openslide_t *osr,
+                                                                 const char *slide_id,
+                                                                 struct _openslide_cache *cache) {
+  static gint next_anonymous_id;
+
+  struct _openslide_cache_binding *cb =
+    g_slice_new0(struct _openslide_cache_binding);
+  for (int i = 0; i < BINDING_LOCK_COUNT; i++) {
+    cb->mutexes[i] = g_mutex_new();
+  }
+  cb->cache = _openslide_cache_ref(cache);
+  cb->osr = osr;
+
+  cb->plane_count = osr->level_count +
+                    (osr->cache_planes ? osr->cache_planes->len : 0);
+  for (int i = 0; i < BINDING_LOCK_COUNT; i++) {
+    cb->plane_stats[i] = g_new0(struct plane_stats, cb->plane_count);
+  }
+
+  if (slide_id) {
+    cb->slide_id = g_intern_string(slide_id);
+    cb->persistent = true;
+  } else {
+    // no content hash; entries can't be shared with other handles.  the
+    // id is compared by address, so its tiles, and whatever policies
+    // remember of them, are removed before it is freed, and can't be
+    // confused with those of a later handle.
+    cb->slide_id = g_strdup_printf("anonymous-%d",
+                                   g_atomic_int_exchange_and_add(&next_anonymous_id, 1));
+  }
+
+  return cb;
+}
+
+static gboolean key_has_slide_id(gpointer key,
+                                 gpointer value G_GNUC_UNUSED,
+                                 gpointer user_data) {
+  const struct _openslide_cache_key *c_key = key;
+  return c_key->slide_id == user_data;
+}
+
+// remove every tile of a slide from a cache
+static void cache_remove_slide(struct _openslide_cache *cache,
+                               const char *slide_id) {
+  for (int i = 0; i < cache->shard_count; i++) {
+    struct cache_shard *shard = &cache->shards[i];
+    g_mutex_lock(shard->mutex);
+    for (int tier = 0; tier < CACHE_TIER_COUNT; tier++) {
+      struct cache_store *store = &shard->tiers[tier];
+      g_hash_table_foreach_remove(store->hashtable,
+                                  key_has_slide_id, (gpointer) slide_id);
+      if (store->policy->forget_slide) {
+        store->policy->forget_slide(store, slide_id);
+      }
+    }
+    g_mutex_unlock(shard->mutex);
+  }
+}
+
+void _openslide_cache_binding_destroy(struct _openslide_cache_binding *cb) {
+  if (!cb->persistent) {
+    cache_remove_slide(cb->cache, cb->slide_id);
+    g_free((char *) cb->slide_id);
+  }
+  _openslide_cache_unref(cb->cache);
+  for (int i = 0; i < BINDING_LOCK_COUNT; i++) {
+    g_mutex_free(cb->mutexes[i]);
+    g_free(cb->plane_stats[i]);
+  }
+  g_slice_free(struct _openslide_cache_binding, cb);
+}
+
+void _openslide_cache_binding_set(struct _openslide_cache_binding *cb,
+                                  struct _openslide_cache *cache) {
+  _openslide_cache_ref(cache);
+
+  for (int i = 0; i < BINDING_LOCK_COUNT; i++) {
+    g_mutex_lock(cb->mutexes[i]);
+  }
+  struct _openslide_cache *old_cache = cb->cache;
+  cb->cache = cache;
+  for (int i = 0; i < BINDING_LOCK_COUNT; i++) {
+    g_mutex_unlock(cb->mutexes[i]);
+  }
+
+  // nothing else can find these tiles
+  if (!cb->persistent && old_cache != cache) {
+    cache_remove_slide(old_cache, cb->slide_id);
+  }
+  _openslide_cache_unref(old_cache);
+}
+
+// the binding lock for a key hash; held while using the bound cache, so
+// that the cache can't be swapped out from under us.  it also protects
+// the stats in the same stripe.
+static int binding_get_stripe(guint hash) {
+  return (mix_hash(hash) >> 24) & (BINDING_LOCK_COUNT - 1);
+}
+
+// get a reference to the binding's current cache, for use without
+// holding a binding lock.  any one lock excludes writers.
+static struct _openslide_cache *binding_ref_cache(struct _openslide_cache_binding *cb) {
+  g_mutex_lock(cb->mutexes[0]);
+  struct _openslide_cache *cache = _openslide_cache_ref(cb->cache);
+  g_mutex_unlock(cb->mutexes[0]);
+  return cache;
+}
+
+// levels are numbered first, then registered planes.  returns -1 if the
+// plane is unknown.
+static int32_t binding_get_plane_index(struct _openslide_cache_binding *cb,
+                                       void *plane) {
+  openslide_t *osr = cb->osr;
+  for (int32_t i = 0; i < osr->level_count; i++) {
+    if ((void *) osr->levels[i] == plane) {
+      return i;
+    }
+  }
+  if (osr->cache_planes) {
+    for (uint32_t i = 0; i < osr->cache_planes->len; i++) {
+      if (osr->cache_planes->pdata[i] == plane) {
+        return osr->level_count + i;
+      }
+    }
   }
+  return -1;
+}
+
+// the level containing a plane, or -1 if unknown
+static int32_t binding_get_plane_level(struct _openslide_cache_binding *cb,
+                                       int32_t plane_index) {
+  openslide_t *osr = cb->osr;
+  if (plane_index < osr->level_count) {
+    return plane_index;
+  }
+  void *level = osr->cache_plane_levels->pdata[plane_index - osr->level_count];
+  for (int32_t i = 0; i < osr->level_count; i++) {
+    if ((void *) osr->levels[i] == level) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void _openslide_cache_add_plane(openslide_t *osr,
+                                struct _openslide_level *level,
+                                void *plane) {
+  if (osr->cache_planes == NULL) {
+    osr->cache_planes = g_ptr_array_new();
+    osr->cache_plane_levels = g_ptr_array_new();
+  }
+  g_ptr_array_add(osr->cache_planes, plane);
+  g_ptr_array_add(osr->cache_plane_levels, level);
+}
+
+// put and get
+
+static struct _openslide_cache_entry *entry_new(void *data, int size,
+                                                bool slab) {
+  struct _openslide_cache_entry *entry =
+      g_slice_new(struct _openslide_cache_entry);
+  // one ref for the caller
+  g_atomic_int_set(&entry->refcount, 1);
+  entry->data = data;
+  entry->size = size;
+  entry->charge = size;
+  entry->slab = slab;
+  entry->solid = NULL;
+  entry->cost = 0;
+  return entry;
+}
+
+// solid tiles
+
+// shared buffers by color and size
+static GMutex *solid_lock;
+static GHashTable *solid_tiles;
+
+static guint solid_tile_hash(gconstpointer key) {
+  const struct solid_tile *solid = key;
+  return solid->color ^ ((guint) solid->size * 31);
+}
+
+static gboolean solid_tile_equal(gconstpointer a, gconstpointer b) {
+  const struct solid_tile *sa = a;
+  const struct solid_tile *sb = b;
+  return sa->color == sb->color && sa->size == sb->size;
+}
+
+static gpointer solid_tiles_init(gpointer data G_GNUC_UNUSED) {
+  solid_lock = g_mutex_new();
+  solid_tiles = g_hash_table_new(solid_tile_hash, solid_tile_equal);
+  return NULL;
+}
+
+// whether every pixel of a tile is the same
+static bool is_solid(const uint32_t *data, int size, uint32_t *color) {
+  if (size < 4 || size % 4) {
+    return false;
+  }
+  int64_t count = size / 4;
+  uint32_t first = data[0];
+  int64_t i = 0;
+#if defined(__SSE2__)
+  const __m128i want = _mm_set1_epi32((int) first);
+  for (; i + 16 <= count; i += 16) {
+    // four vectors per test, to keep the loads in flight
+    __m128i a = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *) (data + i)),
+                                want);
+    __m128i b = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *) (data + i + 4)),
+                                want);
+    __m128i c = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *) (data + i + 8)),
+                                want);
+    __m128i d = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *) (data + i + 12)),
+                                want);
+    __m128i all = _mm_and_si128(_mm_and_si128(a, b), _mm_and_si128(c, d));
+    if (_mm_movemask_epi8(all) != 0xffff) {
+      return false;
+    }
+  }
+#endif
+  for (; i < count; i++) {
+    if (data[i] != first) {
+      return false;
+    }
+  }
+  *color = first;
+  return true;
+}
+
+// returns NULL if there are already too many shared buffers
+static struct solid_tile *solid_tile_ref(uint32_t color, int size) {
+  static GOnce once = G_ONCE_INIT;
+  g_once(&once, solid_tiles_init, NULL);
+
+  struct solid_tile key = {
+    .color = color,
+    .size = size,
+  };
+  g_mutex_lock(solid_lock);
+  struct solid_tile *solid = g_hash_table_lookup(solid_tiles, &key);
+  if (solid == NULL) {
+    if (g_hash_table_size(solid_tiles) >= SOLID_MAX_TILES) {
+      g_mutex_unlock(solid_lock);
+      return NULL;
+    }
+    solid = g_slice_new(struct solid_tile);
+    solid->color = color;
+    solid->size = size;
+    solid->data = g_malloc(size);
+    for (int i = 0; i < size / 4; i++) {
+      solid->data[i] = color;
+    }
+    solid->refcount = 0;
+    g_hash_table_insert(solid_tiles, solid, solid);
+  }
+  solid->refcount++;
+  g_mutex_unlock(solid_lock);
+  return solid;
+}
+
+static void solid_tile_unref(struct solid_tile *solid) {
+  g_mutex_lock(solid_lock);
+  bool last = --solid->refcount == 0;
+  if (last) {
+    g_hash_table_remove(solid_tiles, solid);
+  }
+  g_mutex_unlock(solid_lock);
+  if (last) {
+    g_free(solid->data);
+    g_slice_free(struct solid_tile, solid);
+  }
+}
+
+// returns NULL if the tile can't share a buffer
+static struct _openslide_cache_entry *entry_new_solid(uint32_t color,
+                                                      int size) {
+  struct solid_tile *solid = solid_tile_ref(color, size);
+  if (solid == NULL) {
+    return NULL;
+  }
+  // stores charge the buffer themselves
+  struct _openslide_cache_entry *entry = entry_new(solid->data, size, false);
+  entry->charge = SOLID_ENTRY_CHARGE;
+  entry->solid = solid;
+  return entry;
+}
+
+bool _openslide_cache_entry_get_solid_color(struct _openslide_cache_entry *entry,
+                                            uint32_t *color) {
+  // fixed for the life of the entry
+  if (entry->solid == NULL) {
+    return false;
+  }
+  *color = entry->solid->color;
+  return true;
+}
+
+static int64_t elapsed_usec(const GTimeVal *start) {
+  GTimeVal now;
+  g_get_current_time(&now);
+  int64_t usec = (int64_t) (now.tv_sec - start->tv_sec) * G_USEC_PER_SEC +
+                 (now.tv_usec - start->tv_usec);
+  // wall clock may have stepped
+  return MAX(usec, 0);
+}
+
+// takes a reference to entry for the cache.  if copy_from is specified,
+// entry->data is filled from it, but only if the tier can hold the entry.
+// returns false if the tier could not hold it.
+static bool cache_put(struct _openslide_cache_binding *cb,
+                      enum cache_tier tier,
+                      void *plane,
+                      int64_t x,
+                      int64_t y,
+                      struct _openslide_cache_entry *entry,
+                      const void *copy_from) {
+  // unknown planes are never cached
+  int32_t plane_index = binding_get_plane_index(cb, plane);
+  if (plane_index < 0) {
+    return false;
+  }
+
+  // create key
+  struct _openslide_cache_key *key = g_slice_new(struct _openslide_cache_key);
+  key->slide_id = cb->slide_id;
+  key->plane = plane_index;
+  key->x = x;
+  key->y = y;
+  guint hash = hash_func(key);
+
+  // lock
+  int stripe = binding_get_stripe(hash);
+  GMutex *binding_mutex = cb->mutexes[stripe];
+  g_mutex_lock(binding_mutex);
+  struct _openslide_cache *cache = cb->cache;
+  struct cache_shard *shard = get_shard(cache, hash);
+  g_mutex_lock(shard->mutex);
+  struct cache_store *store = &shard->tiers[tier];
+  struct plane_stats *stats = &cb->plane_stats[stripe][plane_index];
+
+  // don't try to put anything in the cache that cannot possibly fit
+  int charge = get_store_charge(store, entry);
+  if (charge > store->capacity) {
+    //g_debug("refused %p", entry);
+    store->rejected++;
+    g_mutex_unlock(shard->mutex);
+    // the compressed tier is optional and tiles vary in size; only
+    // complain about decoded tiles
+    if (tier == CACHE_TIER_DECODED) {
+      stats->rejected++;
+      _openslide_performance_warn_once(&cache->warned_overlarge_entry,
+                                       "Rejecting overlarge cache entry of "
+                                       "size %d bytes", charge);
+    }
+    g_mutex_unlock(binding_mutex);
+    g_slice_free(struct _openslide_cache_key, key);
+    return false;
+  }
+
+  possibly_evict(store, charge); // already checks for size >= 0
+
+  if (copy_from) {
+    entry->data = g_memdup(copy_from, entry->size);
+  }
+
+  // create value
+  struct _openslide_cache_value *value =
+    g_slice_new(struct _openslide_cache_value);
+  value->key = key;
+  value->store = store;
+  value->entry = entry;
+  value->charge = entry->charge;
+  value->solid_link = NULL;
+
+  // insert into hash table.  this may drop an existing value for the key,
+  // so it must happen before the policy sees the new value.
+  g_hash_table_replace(store->hashtable, key, value);
+  if (entry->solid) {
+    solid_value_add(store, value);
+  }
+
+  // hand to the policy
+  store->policy->insert(store, value);
+
+  // increase size
+  store->total_size += value->charge;
+  store->insertions++;
+  if (tier == CACHE_TIER_DECODED) {
+    stats->insertions++;
+  }
+
+  // another ref for the cache
+  g_atomic_int_inc(&entry->refcount);
+
+  // if eviction above removed the value charged for a shared buffer,
+  // this value is charged for the buffer instead, and may not fit
+  if (value->charge > charge) {
+    possibly_evict(store, 0);
+  }
+
+  // unlock
+  g_mutex_unlock(shard->mutex);
+  g_mutex_unlock(binding_mutex);
+
+  //g_debug("insert %p", entry);
+  return true;
+}
+
+// returns a new reference, or NULL
+static struct _openslide_cache_entry *cache_get(struct _openslide_cache_binding *cb,
+                                                enum cache_tier tier,
+                                                void *plane,
+                                                int64_t x,
+                                                int64_t y) {
+  int32_t plane_index = binding_get_plane_index(cb, plane);
+  if (plane_index < 0) {
+    return NULL;
+  }
+
+  // create key
+  struct _openslide_cache_key key = {
+    .slide_id = cb->slide_id,
+    .plane = plane_index,
+    .x = x,
+    .y = y,
+  };
+  guint hash = hash_func(&key);
+
+  // lock
+  int stripe = binding_get_stripe(hash);
+  GMutex *binding_mutex = cb->mutexes[stripe];
+  g_mutex_lock(binding_mutex);
+  struct cache_shard *shard = get_shard(cb->cache, hash);
+  g_mutex_lock(shard->mutex);
+  struct cache_store *store = &shard->tiers[tier];
+  struct plane_stats *stats = &cb->plane_stats[stripe][plane_index];
+
+  // lookup key, maybe return NULL
+  struct _openslide_cache_value *value = g_hash_table_lookup(store->hashtable,
+							     &key);
+  if (value == NULL) {
+    store->misses++;
+    if (tier == CACHE_TIER_DECODED) {
+      stats->misses++;
+    }
+    g_mutex_unlock(shard->mutex);
+    g_mutex_unlock(binding_mutex);
+    return NULL;
+  }
+
+  // if found, tell the policy
+  store->policy->touch(store, value);
+  store->hits++;
+  if (tier == CACHE_TIER_DECODED) {
+    stats->hits++;
+  }
+
+  // acquire entry reference for the caller
+  struct _openslide_cache_entry *entry = value->entry;
+  g_atomic_int_inc(&entry->refcount);
+
+  //g_debug("cache hit! %p %p %"PRId64" %"PRId64, (void *) entry, (void *) plane, x, y);
+
+  // unlock
+  g_mutex_unlock(shard->mutex);
+  g_mutex_unlock(binding_mutex);
+
+  return entry;
+}
+
+// single-flight decoding
+
+// claims held by the current thread, newest first, which must be settled
+// before the tile read that took them returns
+static GStaticPrivate thread_claims = G_STATIC_PRIVATE_INIT;
+
+static void claim_unref(struct cache_claim *claim) {
+  if (--claim->refcount == 0) {
+    g_cond_free(claim->cond);
+    if (claim->entry) {
+      _openslide_cache_entry_unref(claim->entry);
+    }
+    g_slice_free(struct cache_claim, claim);
+  }
+}
+
+// hand the result to any waiters and drop the owner's reference
+static void claim_finish(struct cache_claim *claim,
+                         struct _openslide_cache_entry *entry) {
+  GSList *claims = g_static_private_get(&thread_claims);
+  g_static_private_set(&thread_claims, g_slist_remove(claims, claim), NULL);
+
+  struct _openslide_cache *cache = claim->cache;
+  struct cache_shard *shard = get_shard(cache, hash_func(&claim->key));
+  g_mutex_lock(shard->mutex);
+  g_hash_table_remove(shard->pending, &claim->key);
+  if (entry) {
+    g_atomic_int_inc(&entry->refcount);
+  }
+  claim->entry = entry;
+  claim->done = true;
+  g_cond_broadcast(claim->cond);
+  claim_unref(claim);
+  g_mutex_unlock(shard->mutex);
+
+  _openslide_cache_unref(cache);
+}
+
+// this thread's claim on a key, if any
+static struct cache_claim *claim_find(struct _openslide_cache_binding *cb,
+                                      int32_t plane_index,
+                                      int64_t x,
+                                      int64_t y) {
+  struct _openslide_cache_key key = {
+    .slide_id = cb->slide_id,
+    .plane = plane_index,
+    .x = x,
+    .y = y,
+  };
+  for (GSList *cur = g_static_private_get(&thread_claims); cur;
+       cur = cur->next) {
+    struct cache_claim *claim = cur->data;
+    if (key_equal_func(&claim->key, &key)) {
+      return claim;
+    }
+  }
+  return NULL;
+}
+
+int _openslide_cache_get_claim_mark(void) {
+  return g_slist_length(g_static_private_get(&thread_claims));
+}
+
+void _openslide_cache_abandon_claims(int mark) {
+  // claims are prepended, so those taken since the mark are at the head.
+  // a tile read nested in another, such as a missing tile rendered from
+  // a lower level, must leave the outer claim for its owner to settle.
+  GSList *claims;
+  while ((claims = g_static_private_get(&thread_claims)) != NULL &&
+         (int) g_slist_length(claims) > mark) {
+    // waiters will retry, and one of them will claim the tile
+    claim_finish(claims->data, NULL);
+  }
+}
+
+// after a decoded tier miss, either wait for the thread already producing
+// the tile, or claim it for the caller.  returns a new reference, or NULL
+// if the caller now owns the claim.
+static struct _openslide_cache_entry *claim_or_wait(struct _openslide_cache_binding *cb,
+                                                    int32_t plane_index,
+                                                    int64_t x,
+                                                    int64_t y) {
+  struct _openslide_cache_key key = {
+    .slide_id = cb->slide_id,
+    .plane = plane_index,
+    .x = x,
+    .y = y,
+  };
+  guint hash = hash_func(&key);
+
+  // waiting doesn't hold the binding lock, so take our own reference to
+  // the cache
+  int stripe = binding_get_stripe(hash);
+  g_mutex_lock(cb->mutexes[stripe]);
+  struct _openslide_cache *cache = _openslide_cache_ref(cb->cache);
+  g_mutex_unlock(cb->mutexes[stripe]);
+
+  struct cache_shard *shard = get_shard(cache, hash);
+  struct cache_store *store = &shard->tiers[CACHE_TIER_DECODED];
+  struct _openslide_cache_entry *entry = NULL;
+  g_mutex_lock(shard->mutex);
+  while (true) {
+    // the tile may have arrived since the lookup
+    struct _openslide_cache_value *value =
+      g_hash_table_lookup(store->hashtable, &key);
+    if (value) {
+      entry = value->entry;
+      g_atomic_int_inc(&entry->refcount);
+      break;
+    }
+
+    struct cache_claim *claim = g_hash_table_lookup(shard->pending, &key);
+    if (claim == NULL) {
+      // ours to produce; the claim takes over our cache reference
+      claim = g_slice_new0(struct cache_claim);
+      claim->key = key;
+      claim->cache = cache;
+      claim->owner = g_thread_self();
+      g_get_current_time(&claim->start);
+      claim->cond = g_cond_new();
+      claim->refcount = 1;
+      g_hash_table_insert(shard->pending, &claim->key, claim);
+      g_mutex_unlock(shard->mutex);
+
+      GSList *claims = g_static_private_get(&thread_claims);
+      g_static_private_set(&thread_claims, g_slist_prepend(claims, claim),
+                           NULL);
+      return NULL;
+    }
+    if (claim->owner == g_thread_self()) {
+      // already ours
+      break;
+    }
+
+    // wait for the owner
+    claim->refcount++;
+    while (!claim->done) {
+      g_cond_wait(claim->cond, shard->mutex);
+    }
+    entry = claim->entry;
+    if (entry) {
+      g_atomic_int_inc(&entry->refcount);
+      store->deduplicated++;
+    }
+    claim_unref(claim);
+    if (entry) {
+      break;
+    }
+    // abandoned; try again
+  }
+  g_mutex_unlock(shard->mutex);
+  _openslide_cache_unref(cache);
+
+  if (entry) {
+    g_mutex_lock(cb->mutexes[stripe]);
+    cb->plane_stats[stripe][plane_index].deduplicated++;
+    g_mutex_unlock(cb->mutexes[stripe]);
+  }
+  return entry;
+}
+
+// look for a decoded tile in the persistent tier, and promote it into
+// memory.  returns a new reference, or NULL.
+static struct _openslide_cache_entry *disk_get(struct _openslide_cache_binding *cb,
+                                               void *plane,
+                                               int64_t x,
+                                               int64_t y,
+                                               int size_in_bytes) {
+  if (g_atomic_int_get(&disk_cache_count) == 0) {
+    return NULL;
+  }
+  int32_t plane_index = binding_get_plane_index(cb, plane);
+  if (plane_index < 0) {
+    return NULL;
+  }
+
+  struct _openslide_cache *cache = binding_ref_cache(cb);
+  struct _openslide_diskcache *dc = g_atomic_pointer_get(&cache->disk);
+  struct _openslide_cache_entry *entry = NULL;
+  if (dc) {
+    GTimeVal start;
+    g_get_current_time(&start);
+    void *data = _openslide_diskcache_get(dc, cb->slide_id, plane_index,
+                                          x, y, size_in_bytes);
+    if (data) {
+      // if evicted, it can be read back at the same cost
+      entry = entry_new(data, size_in_bytes, true);
+      entry->cost = elapsed_usec(&start);
+      cache_put(cb, CACHE_TIER_DECODED, plane, x, y, entry, NULL);
+    }
+  }
+  _openslide_cache_unref(cache);
+  return entry;
+}
+
+// look for a decoded tile in the shared-memory tier, and promote it into
+// memory.  returns a new reference, or NULL.
+static struct _openslide_cache_entry *shared_get(struct _openslide_cache_binding *cb,
+                                                 void *plane,
+                                                 int64_t x,
+                                                 int64_t y,
+                                                 int size_in_bytes) {
+  int32_t plane_index = binding_get_plane_index(cb, plane);
+  if (plane_index < 0) {
+    return NULL;
+  }
+
+  struct _openslide_cache *cache = binding_ref_cache(cb);
+  struct _openslide_shmcache *sc = g_atomic_pointer_get(&cache->shm);
+  struct _openslide_cache_entry *entry = NULL;
+  if (sc) {
+    GTimeVal start;
+    g_get_current_time(&start);
+    void *data = _openslide_shmcache_get(sc, cb->slide_id, plane_index,
+                                         x, y, size_in_bytes);
+    if (data) {
+      struct _openslide_cache_key key = {
+        .slide_id = cb->slide_id,
+        .plane = plane_index,
+        .x = x,
+        .y = y,
+      };
+      struct cache_shard *shard = get_shard(cache, hash_func(&key));
+      g_mutex_lock(shard->mutex);
+      shard->tiers[CACHE_TIER_DECODED].shared_hits++;
+      g_mutex_unlock(shard->mutex);
+      entry = entry_new(data, size_in_bytes, true);
+      entry->cost = elapsed_usec(&start);
+      cache_put(cb, CACHE_TIER_DECODED, plane, x, y, entry, NULL);
+    }
+  }
+  _openslide_cache_unref(cache);
+  return entry;
+}
+
+// copy a newly decoded tile to the shared-memory tier
+static void shared_put(struct _openslide_cache_binding *cb,
+                       void *plane,
+                       int64_t x,
+                       int64_t y,
+                       struct _openslide_cache_entry *entry) {
+  int32_t plane_index = binding_get_plane_index(cb, plane);
+  if (plane_index < 0) {
+    return;
+  }
+
+  struct _openslide_cache *cache = binding_ref_cache(cb);
+  struct _openslide_shmcache *sc = g_atomic_pointer_get(&cache->shm);
+  if (sc) {
+    _openslide_shmcache_put(sc, cb->slide_id, plane_index, x, y,
+                            entry->data, entry->size);
+  }
+  _openslide_cache_unref(cache);
+}
+
+// queue a newly decoded tile for the persistent tier
+static void disk_put(struct _openslide_cache_binding *cb,
+                     void *plane,
+                     int64_t x,
+                     int64_t y,
+                     struct _openslide_cache_entry *entry) {
+  if (g_atomic_int_get(&disk_cache_count) == 0) {
+    return;
+  }
+  int32_t plane_index = binding_get_plane_index(cb, plane);
+  if (plane_index < 0) {
+    return;
+  }
+
+  struct _openslide_cache *cache = binding_ref_cache(cb);
+  struct _openslide_diskcache *dc = g_atomic_pointer_get(&cache->disk);
+  if (dc) {
+    g_atomic_int_inc(&entry->refcount);
+    _openslide_diskcache_put(dc, cb->slide_id, plane_index, x, y,
+                             entry->data, entry->size, entry);
+  }
+  _openslide_cache_unref(cache);
+}
+
+// zero-copy tile capture
+
+// the current thread's capture, between begin and end
+struct capture {
+  GSList *entries;  // references to entries returned to this thread
+  bool painted;  // the destination has been painted
+  struct _openslide_cache_entry *entry;  // kept tile
+  cairo_surface_t *surface;
+};
+
+static GStaticPrivate thread_capture = G_STATIC_PRIVATE_INIT;
+
+static void capture_note_entry(struct _openslide_cache_entry *entry) {
+  struct capture *capture = g_static_private_get(&thread_capture);
+  if (capture && entry) {
+    g_atomic_int_inc(&entry->refcount);
+    capture->entries = g_slist_prepend(capture->entries, entry);
+  }
+}
+
+void _openslide_cache_capture_begin(void) {
+  g_assert(g_static_private_get(&thread_capture) == NULL);
+  g_static_private_set(&thread_capture, g_slice_new0(struct capture), NULL);
+}
+
+struct _openslide_cache_entry *_openslide_cache_capture_end(cairo_surface_t **surface) {
+  struct capture *capture = g_static_private_get(&thread_capture);
+  g_assert(capture);
+  g_static_private_set(&thread_capture, NULL, NULL);
+
+  for (GSList *cur = capture->entries; cur; cur = cur->next) {
+    _openslide_cache_entry_unref(cur->data);
+  }
+  g_slist_free(capture->entries);
+  struct _openslide_cache_entry *entry = capture->entry;
+  *surface = capture->surface;
+  g_slice_free(struct capture, capture);
+  return entry;
+}
+
+bool _openslide_cache_capture_keep(cairo_surface_t *surface) {
+  struct capture *capture = g_static_private_get(&thread_capture);
+  if (capture == NULL || capture->painted || capture->entry) {
+    return false;
+  }
+
+  // only surfaces wrapping a cached tile
+  unsigned char *data = cairo_image_surface_get_data(surface);
+  for (GSList *cur = capture->entries; cur; cur = cur->next) {
+    struct _openslide_cache_entry *entry = cur->data;
+    if (entry->data == data) {
+      g_atomic_int_inc(&entry->refcount);
+      capture->entry = entry;
+      capture->surface = cairo_surface_reference(surface);
+      return true;
+    }
+  }
+  return false;
+}
+
+cairo_surface_t *_openslide_cache_capture_unkeep(void) {
+  struct capture *capture = g_static_private_get(&thread_capture);
+  if (capture == NULL) {
+    return NULL;
+  }
+  capture->painted = true;
+
+  // keep the pixels alive until the end of the capture
+  cairo_surface_t *surface = capture->surface;
+  if (capture->entry) {
+    capture->entries = g_slist_prepend(capture->entries, capture->entry);
+    capture->entry = NULL;
+    capture->surface = NULL;
+  }
+  return surface;
+}
+
+// batched reads
+
+// tiles retained for the duration of a batch, so that each is produced
+// once however small the cache.  tiles from before the last
+// _openslide_cache_batch_age() are kept until the next one, and move
+// back to entries if they are used again.
+struct _openslide_cache_batch {
+  GMutex *mutex;
+  GHashTable *entries;  // key -> entry
+  GHashTable *previous;  // key -> entry
+  int64_t total_size;
+  int64_t previous_size;
+};
+
+// the batch the current thread is reading for, if any
+static GStaticPrivate thread_batch = G_STATIC_PRIVATE_INIT;
+
+struct _openslide_cache_batch *_openslide_cache_batch_create(void) {
+  struct _openslide_cache_batch *batch =
+    g_slice_new0(struct _openslide_cache_batch);
+  batch->mutex = g_mutex_new();
+  batch->entries = g_hash_table_new_full(hash_func, key_equal_func,
+                                         hash_destroy_key,
+                                         (GDestroyNotify) _openslide_cache_entry_unref);
+  batch->previous = g_hash_table_new_full(hash_func, key_equal_func,
+                                          hash_destroy_key,
+                                          (GDestroyNotify) _openslide_cache_entry_unref);
+  return batch;
+}
+
+void _openslide_cache_batch_destroy(struct _openslide_cache_batch *batch) {
+  g_hash_table_destroy(batch->previous);
+  g_hash_table_destroy(batch->entries);
+  g_mutex_free(batch->mutex);
+  g_slice_free(struct _openslide_cache_batch, batch);
+}
+
+void _openslide_cache_batch_enter(struct _openslide_cache_batch *batch) {
+  g_static_private_set(&thread_batch, batch, NULL);
+}
+
+struct _openslide_cache_batch *_openslide_cache_batch_get_current(void) {
+  return g_static_private_get(&thread_batch);
+}
+
+void _openslide_cache_batch_leave(void) {
+  g_static_private_set(&thread_batch, NULL, NULL);
+}
+
+int64_t _openslide_cache_batch_get_size(struct _openslide_cache_batch *batch) {
+  g_mutex_lock(batch->mutex);
+  int64_t size = batch->total_size + batch->previous_size;
+  g_mutex_unlock(batch->mutex);
+  return size;
+}
+
+void _openslide_cache_batch_age(struct _openslide_cache_batch *batch) {
+  g_mutex_lock(batch->mutex);
+  g_hash_table_remove_all(batch->previous);
+  GHashTable *table = batch->previous;
+  batch->previous = batch->entries;
+  batch->entries = table;
+  batch->previous_size = batch->total_size;
+  batch->total_size = 0;
+  g_mutex_unlock(batch->mutex);
+}
+
+// returns a new reference, or NULL
+static struct _openslide_cache_entry *batch_get(struct _openslide_cache_batch *batch,
+                                                struct _openslide_cache_binding *cb,
+                                                int32_t plane_index,
+                                                int64_t x,
+                                                int64_t y) {
+  struct _openslide_cache_key key = {
+    .slide_id = cb->slide_id,
+    .plane = plane_index,
+    .x = x,
+    .y = y,
+  };
+  g_mutex_lock(batch->mutex);
+  struct _openslide_cache_entry *entry =
+    g_hash_table_lookup(batch->entries, &key);
+  gpointer old_key;
+  if (entry == NULL &&
+      g_hash_table_lookup_extended(batch->previous, &key, &old_key,
+                                   (gpointer *) &entry)) {
+    // still in use; keep it another generation
+    g_hash_table_steal(batch->previous, old_key);
+    g_hash_table_insert(batch->entries, old_key, entry);
+    batch->previous_size -= entry->charge;
+    batch->total_size += entry->charge;
+  }
+  if (entry) {
+    g_atomic_int_inc(&entry->refcount);
+  }
+  g_mutex_unlock(batch->mutex);
+  return entry;
+}
+
+static void batch_put(struct _openslide_cache_batch *batch,
+                      struct _openslide_cache_binding *cb,
+                      int32_t plane_index,
+                      int64_t x,
+                      int64_t y,
+                      struct _openslide_cache_entry *entry) {
+  struct _openslide_cache_key *key = g_slice_new(struct _openslide_cache_key);
+  key->slide_id = cb->slide_id;
+  key->plane = plane_index;
+  key->x = x;
+  key->y = y;
+
+  g_mutex_lock(batch->mutex);
+  if (g_hash_table_lookup(batch->entries, key)) {
+    hash_destroy_key(key);
+  } else {
+    g_atomic_int_inc(&entry->refcount);
+    g_hash_table_insert(batch->entries, key, entry);
+    batch->total_size += entry->charge;
+  }
+  g_mutex_unlock(batch->mutex);
+}
+
+// statistics
+
+// decoded tier, plus hits and size of the compressed tier
+static void cache_get_stats(struct _openslide_cache *cache,
+                            openslide_cache_stats_t *stats) {
+  memset(stats, 0, sizeof(*stats));
+  for (int i = 0; i < cache->shard_count; i++) {
+    struct cache_shard *shard = &cache->shards[i];
+    struct cache_store *store = &shard->tiers[CACHE_TIER_DECODED];
+    g_mutex_lock(shard->mutex);
+    stats->hits += store->hits;
+    stats->misses += store->misses;
+    stats->insertions += store->insertions;
+    stats->evictions += store->evictions;
+    stats->rejected += store->rejected;
+    stats->deduplicated += store->deduplicated;
+    stats->shared_hits += store->shared_hits;
+    stats->bytes += store->total_size;
+    stats->entries += g_hash_table_size(store->hashtable);
+    struct cache_store *compressed = &shard->tiers[CACHE_TIER_COMPRESSED];
+    stats->compressed_hits += compressed->hits;
+    stats->compressed_bytes += compressed->total_size;
+    g_mutex_unlock(shard->mutex);
+  }
+  stats->arena_bytes = _openslide_slab_get_arena_bytes();
+}
+
+void _openslide_cache_binding_get_stats(struct _openslide_cache_binding *cb,
+                                        openslide_cache_stats_t *stats) {
+  struct _openslide_cache *cache = binding_ref_cache(cb);
+  cache_get_stats(cache, stats);
+  _openslide_cache_unref(cache);
+}
+
+// lookups and insertions are those made through this binding.  bytes and
+// entries cover all of the slide's tiles in the current cache, which
+// requires walking the cache.  evictions are not tracked per level.
+void _openslide_cache_binding_get_level_stats(struct _openslide_cache_binding *cb,
+                                              int32_t level,
+                                              openslide_cache_stats_t *stats) {
+  memset(stats, 0, sizeof(*stats));
+  stats->arena_bytes = _openslide_slab_get_arena_bytes();
+
+  bool *in_level = g_new0(bool, cb->plane_count);
+  for (int32_t plane = 0; plane < cb->plane_count; plane++) {
+    in_level[plane] = binding_get_plane_level(cb, plane) == level;
+  }
+
+  for (int i = 0; i < BINDING_LOCK_COUNT; i++) {
+    g_mutex_lock(cb->mutexes[i]);
+    for (int32_t plane = 0; plane < cb->plane_count; plane++) {
+      if (in_level[plane]) {
+        struct plane_stats *ps = &cb->plane_stats[i][plane];
+        stats->hits += ps->hits;
+        stats->misses += ps->misses;
+        stats->insertions += ps->insertions;
+        stats->rejected += ps->rejected;
+        stats->deduplicated += ps->deduplicated;
+      }
+    }
+    g_mutex_unlock(cb->mutexes[i]);
+  }
+
+  struct _openslide_cache *cache = binding_ref_cache(cb);
+  for (int i = 0; i < cache->shard_count; i++) {
+    struct cache_shard *shard = &cache->shards[i];
+    struct cache_store *store = &shard->tiers[CACHE_TIER_DECODED];
+    g_mutex_lock(shard->mutex);
+    GHashTableIter iter;
+    g_hash_table_iter_init(&iter, store->hashtable);
+    struct _openslide_cache_key *key;
+    struct _openslide_cache_value *value;
+    while (g_hash_table_iter_next(&iter, (gpointer *) &key,
+                                  (gpointer *) &value)) {
+      if (key->slide_id == cb->slide_id && key->plane < cb->plane_count &&
+          in_level[key->plane]) {
+        stats->bytes += value->charge;
+        stats->entries++;
+      }
+    }
+    g_mutex_unlock(shard->mutex);
+  }
+  _openslide_cache_unref(cache);
+
+  g_free(in_level);
+}
+
+static void log_stats(struct _openslide_cache_binding *cb) {
+  openslide_cache_stats_t stats;
+  _openslide_cache_binding_get_stats(cb, &stats);
+  g_message("cache: %"PRIu64" hits, %"PRIu64" misses, "
+            "%"PRIu64" insertions, %"PRIu64" evictions, "
+            "%"PRIu64" rejected, %"PRIu64" deduplicated, "
+            "%"PRIu64" bytes in %"PRIu64" entries",
+            stats.hits, stats.misses, stats.insertions, stats.evictions,
+            stats.rejected, stats.deduplicated, stats.bytes, stats.entries);
+  for (int32_t level = 0; level < cb->osr->level_count; level++) {
+    _openslide_cache_binding_get_level_stats(cb, level, &stats);
+    g_message("cache: %s level %d: %"PRIu64" hits, %"PRIu64" misses, "
+              "%"PRIu64" insertions, %"PRIu64" rejected, "
+              "%"PRIu64" deduplicated, %"PRIu64" bytes in %"PRIu64" entries",
+              cb->slide_id, level, stats.hits, stats.misses,
+              stats.insertions, stats.rejected, stats.deduplicated,
+              stats.bytes, stats.entries);
+  }
+}
+
+// publish a tile the caller has produced.  cached is the entry to keep,
+// which may be a compact copy of entry.
+static void put_entry(struct _openslide_cache_binding *cb,
+                      void *plane,
+                      int64_t x,
+                      int64_t y,
+                      struct _openslide_cache_entry *entry,
+                      struct _openslide_cache_entry *cached) {
+  capture_note_entry(entry);
+
+  // the tile was produced since the miss that claimed it
+  int32_t plane_index = binding_get_plane_index(cb, plane);
+  struct cache_claim *claim = NULL;
+  if (plane_index >= 0) {
+    claim = claim_find(cb, plane_index, x, y);
+  }
+  if (claim) {
+    cached->cost = elapsed_usec(&claim->start);
+  }
+
+  cache_put(cb, CACHE_TIER_DECODED, plane, x, y, cached, NULL);
+
+  // share with waiting threads, even if the cache couldn't hold it
+  if (claim) {
+    claim_finish(claim, cached);
+  }
+
+  struct _openslide_cache_batch *batch = g_static_private_get(&thread_batch);
+  if (batch && plane_index >= 0) {
+    batch_put(batch, cb, plane_index, x, y, cached);
+  }
+
+  if (cb->persistent) {
+    shared_put(cb, plane, x, y, cached);
+    disk_put(cb, plane, x, y, cached);
+  }
+}
+
+// the cache retains one reference, and the caller gets another one.  the
+// entry must be unreffed when the caller is done with it.  a tile of a
+// single color is cached as a shared buffer, while the caller's buffer is
+// freed with the caller's reference.
+void _openslide_cache_put(struct _openslide_cache_binding *cb,
+			  void *plane,
+			  int64_t x,
+			  int64_t y,
+			  void *data,
+			  int size_in_bytes,
+			  struct _openslide_cache_entry **_entry) {
+  // always create cache entry for caller's reference
+  struct _openslide_cache_entry *entry = entry_new(data, size_in_bytes, true);
+  *_entry = entry;
+
+  uint32_t color;
+  struct _openslide_cache_entry *cached = NULL;
+  if (is_solid(data, size_in_bytes, &color)) {
+    cached = entry_new_solid(color, size_in_bytes);
+  }
+  if (cached) {
+    put_entry(cb, plane, x, y, entry, cached);
+    _openslide_cache_entry_unref(cached);
+  } else {
+    put_entry(cb, plane, x, y, entry, entry);
+  }
+}
+
+void *_openslide_cache_put_solid(struct _openslide_cache_binding *cb,
+                                 void *plane,
+                                 int64_t x,
+                                 int64_t y,
+                                 uint32_t color,
+                                 int size_in_bytes,
+                                 struct _openslide_cache_entry **_entry) {
+  struct _openslide_cache_entry *entry = entry_new_solid(color,
+                                                         size_in_bytes);
+  if (entry == NULL) {
+    uint32_t *data = _openslide_slab_alloc(size_in_bytes);
+    for (int i = 0; i < size_in_bytes / 4; i++) {
+      data[i] = color;
+    }
+    entry = entry_new(data, size_in_bytes, true);
+  }
+  *_entry = entry;
+  put_entry(cb, plane, x, y, entry, entry);
+  return entry->data;
+}
+
+// entry must be unreffed when the caller is done with the data.  if NULL
+// is returned, the caller has undertaken to produce the tile, and other
+// threads reading it will wait until the caller puts it or calls
+// _openslide_cache_abandon_claims().
+void *_openslide_cache_get(struct _openslide_cache_binding *cb,
+			   void *plane,
+			   int64_t x,
+			   int64_t y,
+			   int size_in_bytes,
+			   struct _openslide_cache_entry **_entry) {
+  int32_t plane_index = binding_get_plane_index(cb, plane);
+  struct _openslide_cache_batch *batch = g_static_private_get(&thread_batch);
+  if (plane_index < 0) {
+    batch = NULL;
+  }
+
+  struct _openslide_cache_entry *entry = NULL;
+  if (batch) {
+    entry = batch_get(batch, cb, plane_index, x, y);
+  }
+  if (entry == NULL) {
+    entry = cache_get(cb, CACHE_TIER_DECODED, plane, x, y);
+    if (entry == NULL && plane_index >= 0) {
+      entry = claim_or_wait(cb, plane_index, x, y);
+      if (entry == NULL && cb->persistent) {
+        entry = shared_get(cb, plane, x, y, size_in_bytes);
+        if (entry == NULL) {
+          entry = disk_get(cb, plane, x, y, size_in_bytes);
+          if (entry) {
+            shared_put(cb, plane, x, y, entry);
+          }
+        }
+        struct cache_claim *claim = claim_find(cb, plane_index, x, y);
+        if (entry && claim) {
+          claim_finish(claim, entry);
+        }
+      }
+    }
+    if (entry && batch) {
+      batch_put(batch, cb, plane_index, x, y, entry);
+    }
+  }
+  *_entry = entry;
+  capture_note_entry(entry);
+
+  if (_openslide_debug(OPENSLIDE_DEBUG_CACHE)) {
+    guint lookups = g_atomic_int_exchange_and_add(&cb->debug_lookups, 1);
+    if (lookups % CACHE_DEBUG_INTERVAL == CACHE_DEBUG_INTERVAL - 1) {
+      log_stats(cb);
+    }
+  }
+
+  return entry ? entry->data : NULL;
+}
+
+// doesn't count as a hit or miss, or wait for a tile being produced
+bool _openslide_cache_contains(struct _openslide_cache_binding *cb,
+                               void *plane,
+                               int64_t x,
+                               int64_t y) {
+  int32_t plane_index = binding_get_plane_index(cb, plane);
+  if (plane_index < 0) {
+    return false;
+  }
+  struct _openslide_cache_key key = {
+    .slide_id = cb->slide_id,
+    .plane = plane_index,
+    .x = x,
+    .y = y,
+  };
+
+  struct _openslide_cache_batch *batch = g_static_private_get(&thread_batch);
+  if (batch) {
+    g_mutex_lock(batch->mutex);
+    bool found = g_hash_table_lookup(batch->entries, &key) ||
+                 g_hash_table_lookup(batch->previous, &key);
+    g_mutex_unlock(batch->mutex);
+    if (found) {
+      return true;
+    }
+  }
+
+  guint hash = hash_func(&key);
+  int stripe = binding_get_stripe(hash);
+  g_mutex_lock(cb->mutexes[stripe]);
+  struct cache_shard *shard = get_shard(cb->cache, hash);
+  g_mutex_lock(shard->mutex);
+  struct cache_store *store = &shard->tiers[CACHE_TIER_DECODED];
+  bool found = g_hash_table_lookup(store->hashtable, &key) != NULL;
+  g_mutex_unlock(shard->mutex);
+  g_mutex_unlock(cb->mutexes[stripe]);
+  return found;
+}
+
+void _openslide_cache_put_compressed(struct _openslide_cache_binding *cb,
+                                     void *plane,
+                                     int64_t x,
+                                     int64_t y,
+                                     const void *data,
+                                     int size_in_bytes) {
+  if (cb == NULL) {
+    return;
+  }
+
+  // only copy the data if the tier has room for it
+  struct _openslide_cache_entry *entry = entry_new(NULL, size_in_bytes, false);
+  cache_put(cb, CACHE_TIER_COMPRESSED, plane, x, y, entry, data);
+  _openslide_cache_entry_unref(entry);
+}
+
+void *_openslide_cache_get_compressed(struct _openslide_cache_binding *cb,
+                                      void *plane,
+                                      int64_t x,
+                                      int64_t y,
+                                      int *size_in_bytes) {
+  if (cb == NULL) {
+    return NULL;
+  }
+
+  struct _openslide_cache_entry *entry =
+    cache_get(cb, CACHE_TIER_COMPRESSED, plane, x, y);
+  if (entry == NULL) {
+    return NULL;
+  }
+
+  // copy outside the locks
+  void *data = g_memdup(entry->data, entry->size);
+  *size_in_bytes = entry->size;
+  _openslide_cache_entry_unref(entry);
+  return data;
+}
+
+// value unref
+void _openslide_cache_entry_unref(struct _openslide_cache_entry *entry) {
+  //g_debug("unref %p, refs %d", entry, g_atomic_int_get(&entry->refcount));
+
+  if (g_atomic_int_dec_and_test(&entry->refcount)) {
+    // free the data
+    if (entry->solid) {
+      solid_tile_unref(entry->solid);
+    } else if (entry->slab) {
+      _openslide_slab_free(entry->size, entry->data);
+    } else {
+      g_free(entry->data);
+    }
+
+    // free the entry
+    g_slice_free(struct _openslide_cache_entry, entry);
+
+    //g_debug("free %p", entry);
+  }
+}
+
+
+// public API
+
+openslide_cache_t *openslide_cache_create(size_t capacity) {
+  return openslide_cache_create_with_policy(capacity,
+                                            OPENSLIDE_CACHE_POLICY_LRU);
+}
+
+openslide_cache_t *openslide_cache_create_with_policy(size_t capacity,
+                                                      enum openslide_cache_policy policy) {
+  if (get_policy(policy) == NULL) {
+    return NULL;
+  }
+  return _openslide_cache_create(MIN(capacity, (uint64_t) G_MAXINT64), policy);
+}
+
+void openslide_cache_set_compressed_capacity(openslide_cache_t *cache,
+                                             size_t capacity) {
+  _openslide_cache_set_compressed_capacity(cache,
+                                           MIN(capacity, (uint64_t) G_MAXINT64));
+}
+
+bool openslide_cache_set_persistent_dir(openslide_cache_t *cache,
+                                        const char *dirname,
+                                        size_t capacity) {
+  if (g_atomic_pointer_get(&cache->disk)) {
+    return false;
+  }
+
+  GError *tmp_err = NULL;
+  struct _openslide_diskcache *dc =
+    _openslide_diskcache_create(dirname,
+                                MIN(capacity, (uint64_t) G_MAXINT64),
+                                &tmp_err);
+  if (dc == NULL) {
+    g_warning("%s", tmp_err->message);
+    g_clear_error(&tmp_err);
+    return false;
+  }
+  if (!g_atomic_pointer_compare_and_exchange((volatile gpointer *) &cache->disk,
+                                             NULL, dc)) {
+    // lost a race
+    _openslide_diskcache_destroy(dc);
+    return false;
+  }
+  g_atomic_int_inc(&disk_cache_count);
+  return true;
+}
+
+bool openslide_cache_set_shared_memory(openslide_cache_t *cache,
+                                       const char *name,
+                                       size_t capacity) {
+  if (g_atomic_pointer_get(&cache->shm)) {
+    return false;
+  }
+
+  GError *tmp_err = NULL;
+  struct _openslide_shmcache *sc =
+    _openslide_shmcache_create(name,
+                               MIN(capacity, (uint64_t) G_MAXINT64),
+                               &tmp_err);
+  if (sc == NULL) {
+    g_warning("%s", tmp_err->message);
+    g_clear_error(&tmp_err);
+    return false;
+  }
+  if (!g_atomic_pointer_compare_and_exchange((volatile gpointer *) &cache->shm,
+                                             NULL, sc)) {
+    // lost a race
+    _openslide_shmcache_destroy(sc);
+    return false;
+  }
+  return true;
+}
+
+bool openslide_cache_remove_shared_memory(const char *name) {
+  GError *tmp_err = NULL;
+  if (!_openslide_shmcache_remove(name, &tmp_err)) {
+    g_warning("%s", tmp_err->message);
+    g_clear_error(&tmp_err);
+    return false;
+  }
+  return true;
+}
+
+void openslide_cache_release(openslide_cache_t *cache) {
+  _openslide_cache_unref(cache);
 }
@@ -0,0 +1,519 @@
+/*
+ *  OpenSlide, a library for reading whole slide image files
+ *
+ *  Copyright (c) 2026 OpenSlide contributors
+ *  All rights reserved.
+ *
+ *  OpenSlide is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, version 2.1.
+ *
+ *  OpenSlide is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with OpenSlide. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Tile compositing.
+ *
+ * Grids paint tiles through cairo with the SATURATE operator, which
+ * Pixman only implements with a generic per-pixel path.  When a tile is
+ * being painted at an integer offset into an ARGB32 image surface, as is
+ * always the case for openslide_read_region(), composite it here
+ * instead.  In practice nearly every destination pixel is either still
+ * clear, in which case SATURATE is a copy, or already opaque, in which
+ * case it is a no-op; the vector kernels check for those cases a few
+ * pixels at a time and fall back to the exact arithmetic otherwise.
+ *
+ * Cached tiles of a single color share a buffer, which is recognized
+ * here and painted as a fill without reading it.
+ *
+ * While openslide_get_tile() is capturing, a cached tile which would
+ * exactly cover the destination is handed to the cache's capture
+ * instead of being painted; see _openslide_cache_capture_begin().
+ *
+ * Reads in other pixel formats are painted as ARGB32 a piece at a time
+ * and converted here, in a second pass over each piece once it is
+ * painted.
+ */
+
+#include <config.h>
+
+#include "openslide-private.h"
+
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+#include <cairo.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#define ALPHA_MASK 0xff000000U
+
+// the largest distance from a whole pixel at which a translation is
+// composited natively; far below pixman's 1/65536 pixel resolution
+#define NATIVE_TRANSLATE_EPSILON 1e-6
+
+// a * b / 255, rounded, as Pixman does it
+static inline uint32_t mul_un8(uint32_t a, uint32_t b) {
+  uint32_t t = a * b + 0x80;
+  return ((t >> 8) + t) >> 8;
+}
+
+// premultiplied SATURATE of one pixel
+static inline uint32_t saturate_pixel(uint32_t dst, uint32_t src) {
+  uint32_t sa = src >> 24;
+  uint32_t da = dst >> 24;
+  if (sa == 0 || da == 0xff) {
+    return dst;
+  }
+  if (da == 0) {
+    return src;
+  }
+
+  // scale the source down to fit in the room left in the destination
+  uint32_t f = 0xff;
+  if (sa > 0xff - da) {
+    f = ((0xff - da) * 0xff + sa / 2) / sa;
+  }
+  uint32_t result = 0;
+  for (int shift = 0; shift < 32; shift += 8) {
+    uint32_t c = mul_un8((src >> shift) & 0xff, f) + ((dst >> shift) & 0xff);
+    result |= MIN(c, 0xff) << shift;
+  }
+  return result;
+}
+
+static void saturate_row_generic(uint32_t *dst, const uint32_t *src,
+                                 int32_t w, uint32_t src_or) {
+  for (int32_t i = 0; i < w; i++) {
+    dst[i] = saturate_pixel(dst[i], src[i] | src_or);
+  }
+}
+
+#if defined(__AVX2__)
+static void saturate_row(uint32_t *dst, const uint32_t *src,
+                         int32_t w, uint32_t src_or) {
+  const __m256i alpha = _mm256_set1_epi32(ALPHA_MASK);
+  const __m256i opaque = _mm256_set1_epi32(src_or);
+  const __m256i zero = _mm256_setzero_si256();
+  int32_t i = 0;
+  for (; i + 8 <= w; i += 8) {
+    __m256i d = _mm256_loadu_si256((const __m256i *) (dst + i));
+    __m256i da = _mm256_and_si256(d, alpha);
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(da, zero)) == -1) {
+      // all clear; copy
+      __m256i s = _mm256_loadu_si256((const __m256i *) (src + i));
+      _mm256_storeu_si256((__m256i *) (dst + i), _mm256_or_si256(s, opaque));
+    } else if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(da, alpha)) != -1) {
+      saturate_row_generic(dst + i, src + i, 8, src_or);
+    }
+    // else all opaque; nothing to do
+  }
+  saturate_row_generic(dst + i, src + i, w - i, src_or);
+}
+#elif defined(__SSE2__)
+static void saturate_row(uint32_t *dst, const uint32_t *src,
+                         int32_t w, uint32_t src_or) {
+  const __m128i alpha = _mm_set1_epi32(ALPHA_MASK);
+  const __m128i opaque = _mm_set1_epi32(src_or);
+  const __m128i zero = _mm_setzero_si128();
+  int32_t i = 0;
+  for (; i + 4 <= w; i += 4) {
+    __m128i d = _mm_loadu_si128((const __m128i *) (dst + i));
+    __m128i da = _mm_and_si128(d, alpha);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(da, zero)) == 0xffff) {
+      // all clear; copy
+      __m128i s = _mm_loadu_si128((const __m128i *) (src + i));
+      _mm_storeu_si128((__m128i *) (dst + i), _mm_or_si128(s, opaque));
+    } else if (_mm_movemask_epi8(_mm_cmpeq_epi32(da, alpha)) != 0xffff) {
+      saturate_row_generic(dst + i, src + i, 4, src_or);
+    }
+    // else all opaque; nothing to do
+  }
+  saturate_row_generic(dst + i, src + i, w - i, src_or);
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+static void saturate_row(uint32_t *dst, const uint32_t *src,
+                         int32_t w, uint32_t src_or) {
+  const uint32x4_t opaque = vdupq_n_u32(src_or);
+  int32_t i = 0;
+  for (; i + 4 <= w; i += 4) {
+    uint32x4_t da = vshrq_n_u32(vld1q_u32(dst + i), 24);
+    if (vmaxvq_u32(da) == 0) {
+      // all clear; copy
+      vst1q_u32(dst + i, vorrq_u32(vld1q_u32(src + i), opaque));
+    } else if (vminvq_u32(da) != 0xff) {
+      saturate_row_generic(dst + i, src + i, 4, src_or);
+    }
+    // else all opaque; nothing to do
+  }
+  saturate_row_generic(dst + i, src + i, w - i, src_or);
+}
+#else
+static void saturate_row(uint32_t *dst, const uint32_t *src,
+                         int32_t w, uint32_t src_or) {
+  saturate_row_generic(dst, src, w, src_or);
+}
+#endif
+
+void _openslide_composite_saturate(uint32_t *dst, int dst_stride,
+                                   const uint32_t *src, int src_stride,
+                                   int32_t w, int32_t h,
+                                   bool src_opaque) {
+  uint32_t src_or = src_opaque ? ALPHA_MASK : 0;
+  for (int32_t y = 0; y < h; y++) {
+    saturate_row((uint32_t *) ((char *) dst + (int64_t) y * dst_stride),
+                 (const uint32_t *) ((const char *) src +
+                                     (int64_t) y * src_stride),
+                 w, src_or);
+  }
+}
+
+// SATURATE of a single premultiplied color over a row
+static void saturate_fill_row(uint32_t *dst, uint32_t color, int32_t w) {
+  int32_t i = 0;
+#if defined(__SSE2__)
+  const __m128i alpha = _mm_set1_epi32(ALPHA_MASK);
+  const __m128i src = _mm_set1_epi32((int) color);
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 4 <= w; i += 4) {
+    __m128i da = _mm_and_si128(_mm_loadu_si128((const __m128i *) (dst + i)),
+                               alpha);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(da, zero)) == 0xffff) {
+      // all clear; fill
+      _mm_storeu_si128((__m128i *) (dst + i), src);
+    } else if (_mm_movemask_epi8(_mm_cmpeq_epi32(da, alpha)) != 0xffff) {
+      for (int32_t j = i; j < i + 4; j++) {
+        dst[j] = saturate_pixel(dst[j], color);
+      }
+    }
+    // else all opaque; nothing to do
+  }
+#endif
+  for (; i < w; i++) {
+    dst[i] = saturate_pixel(dst[i], color);
+  }
+}
+
+// the destination rectangle of a tile painted at the current origin, in
+// device space, or false if cairo must do it
+static bool get_native_rect(cairo_t *cr, cairo_surface_t *target,
+                            int32_t tw, int32_t th,
+                            int64_t *dx, int64_t *dy,
+                            int64_t *x0, int64_t *y0,
+                            int64_t *x1, int64_t *y1) {
+  // only integer translations.  offsets which cancel in the level plane,
+  // as across the pieces of a region, may leave a rounding error far
+  // below what pixman would resolve.
+  cairo_matrix_t m;
+  cairo_get_matrix(cr, &m);
+  if (m.xx != 1 || m.yy != 1 || m.xy != 0 || m.yx != 0 ||
+      fabs(m.x0 - round(m.x0)) > NATIVE_TRANSLATE_EPSILON ||
+      fabs(m.y0 - round(m.y0)) > NATIVE_TRANSLATE_EPSILON) {
+    return false;
+  }
+  double off_x, off_y;
+  cairo_surface_get_device_offset(target, &off_x, &off_y);
+  if (off_x != 0 || off_y != 0) {
+    return false;
+  }
+  *dx = round(m.x0);
+  *dy = round(m.y0);
+
+  // intersect with the surface
+  *x0 = MAX(*dx, 0);
+  *y0 = MAX(*dy, 0);
+  *x1 = MIN(*dx + tw, cairo_image_surface_get_width(target));
+  *y1 = MIN(*dy + th, cairo_image_surface_get_height(target));
+
+  // and with the clip, if it's a single rectangle
+  cairo_rectangle_list_t *clip = cairo_copy_clip_rectangle_list(cr);
+  bool ok = clip->status == CAIRO_STATUS_SUCCESS &&
+            clip->num_rectangles <= 1;
+  if (ok && clip->num_rectangles == 1) {
+    // in user space
+    cairo_rectangle_t *r = &clip->rectangles[0];
+    if (r->x != floor(r->x) || r->y != floor(r->y) ||
+        r->width != floor(r->width) || r->height != floor(r->height)) {
+      ok = false;
+    } else {
+      *x0 = MAX(*x0, (int64_t) r->x + *dx);
+      *y0 = MAX(*y0, (int64_t) r->y + *dy);
+      *x1 = MIN(*x1, (int64_t) (r->x + r->width) + *dx);
+      *y1 = MIN(*y1, (int64_t) (r->y + r->height) + *dy);
+    }
+  } else if (ok) {
+    // clipped away
+    *x1 = *x0;
+  }
+  cairo_rectangle_list_destroy(clip);
+  return ok;
+}
+
+// paint a kept tile, which exactly covers the target, underneath whatever
+// is about to be painted
+static void paint_kept_surface(cairo_t *cr, cairo_surface_t *kept) {
+  cairo_surface_t *target = cairo_get_target(cr);
+  cairo_surface_flush(target);
+  _openslide_composite_saturate((uint32_t *) cairo_image_surface_get_data(target),
+                                cairo_image_surface_get_stride(target),
+                                (const uint32_t *) cairo_image_surface_get_data(kept),
+                                cairo_image_surface_get_stride(kept),
+                                cairo_image_surface_get_width(kept),
+                                cairo_image_surface_get_height(kept),
+                                cairo_image_surface_get_format(kept) ==
+                                CAIRO_FORMAT_RGB24);
+  cairo_surface_mark_dirty(target);
+  cairo_surface_destroy(kept);
+}
+
+static void free_solid_color(void *data) {
+  g_slice_free(uint32_t, data);
+}
+
+// the color of a surface marked by _openslide_cairo_mark_solid()
+static cairo_user_data_key_t solid_color_key;
+
+void _openslide_cairo_mark_solid(cairo_surface_t *surface,
+                                 struct _openslide_cache_entry *entry) {
+  uint32_t color;
+  if (!_openslide_cache_entry_get_solid_color(entry, &color)) {
+    return;
+  }
+  uint32_t *data = g_slice_new(uint32_t);
+  *data = color;
+  if (cairo_surface_set_user_data(surface, &solid_color_key, data,
+                                  free_solid_color)) {
+    // no memory; paint it normally
+    free_solid_color(data);
+  }
+}
+
+void _openslide_cairo_paint_surface(cairo_t *cr, cairo_surface_t *surface) {
+  // painting into an image surface, not a group?
+  cairo_surface_t *target = cairo_get_group_target(cr);
+  bool native = target == cairo_get_target(cr) &&
+                cairo_surface_get_type(target) == CAIRO_SURFACE_TYPE_IMAGE &&
+                cairo_image_surface_get_format(target) == CAIRO_FORMAT_ARGB32 &&
+                cairo_surface_get_type(surface) == CAIRO_SURFACE_TYPE_IMAGE &&
+                (cairo_image_surface_get_format(surface) == CAIRO_FORMAT_ARGB32 ||
+                 cairo_image_surface_get_format(surface) == CAIRO_FORMAT_RGB24) &&
+                cairo_get_operator(cr) == CAIRO_OPERATOR_SATURATE &&
+                cairo_image_surface_get_data(target) != NULL;
+
+  int32_t tw = cairo_image_surface_get_width(surface);
+  int32_t th = cairo_image_surface_get_height(surface);
+  int64_t dx, dy, x0, y0, x1, y1;
+  if (native) {
+    native = get_native_rect(cr, target, tw, th, &dx, &dy, &x0, &y0, &x1, &y1);
+  }
+
+  // a cached tile covering the whole of a zero-copy destination need not
+  // be painted at all.  RGB24 tiles may leave alpha unset, so only ARGB32
+  // tiles can be handed out as they are.
+  if (native && dx == 0 && dy == 0 && x0 == 0 && y0 == 0 &&
+      cairo_image_surface_get_format(surface) == CAIRO_FORMAT_ARGB32 &&
+      tw == cairo_image_surface_get_width(target) &&
+      th == cairo_image_surface_get_height(target) &&
+      x1 == tw && y1 == th &&
+      _openslide_cache_capture_keep(surface)) {
+    return;
+  }
+  cairo_surface_t *kept = _openslide_cache_capture_unkeep();
+  if (kept) {
+    paint_kept_surface(cr, kept);
+  }
+
+  // a tile of one color is a fill.  outside the native path, only for
+  // operators which leave the area outside the tile alone.
+  uint32_t color = 0;
+  uint32_t *solid_color = cairo_surface_get_user_data(surface,
+                                                      &solid_color_key);
+  bool solid = solid_color != NULL &&
+               cairo_surface_get_type(surface) == CAIRO_SURFACE_TYPE_IMAGE &&
+               cairo_image_surface_get_format(surface) == CAIRO_FORMAT_ARGB32;
+  if (solid) {
+    color = *solid_color;
+  }
+  bool bounded = cairo_get_operator(cr) == CAIRO_OPERATOR_SATURATE ||
+                 cairo_get_operator(cr) == CAIRO_OPERATOR_OVER;
+  if (solid && bounded && color >> 24 == 0) {
+    // transparent; nothing to paint
+    return;
+  }
+
+  if (!native) {
+    if (solid && bounded && color >> 24 == 0xff) {
+      cairo_save(cr);
+      cairo_set_source_rgb(cr,
+                           ((color >> 16) & 0xff) / 255.0,
+                           ((color >> 8) & 0xff) / 255.0,
+                           (color & 0xff) / 255.0);
+      cairo_rectangle(cr, 0, 0, tw, th);
+      cairo_fill(cr);
+      cairo_restore(cr);
+    } else {
+      cairo_set_source_surface(cr, surface, 0, 0);
+      cairo_paint(cr);
+    }
+    return;
+  }
+  if (x0 >= x1 || y0 >= y1) {
+    return;
+  }
+
+  cairo_surface_flush(target);
+  int dst_stride = cairo_image_surface_get_stride(target);
+  if (solid) {
+    for (int64_t y = y0; y < y1; y++) {
+      saturate_fill_row((uint32_t *) (cairo_image_surface_get_data(target) +
+                                      y * dst_stride + x0 * 4),
+                        color, x1 - x0);
+    }
+    cairo_surface_mark_dirty_rectangle(target, x0, y0, x1 - x0, y1 - y0);
+    return;
+  }
+  cairo_surface_flush(surface);
+  int src_stride = cairo_image_surface_get_stride(surface);
+  uint32_t *dst = (uint32_t *) (cairo_image_surface_get_data(target) +
+                                y0 * dst_stride + x0 * 4);
+  const uint32_t *src =
+    (const uint32_t *) (cairo_image_surface_get_data(surface) +
+                        (y0 - dy) * src_stride + (x0 - dx) * 4);
+  _openslide_composite_saturate(dst, dst_stride, src, src_stride,
+                                x1 - x0, y1 - y0,
+                                cairo_image_surface_get_format(surface) ==
+                                CAIRO_FORMAT_RGB24);
+  cairo_surface_mark_dirty_rectangle(target, x0, y0, x1 - x0, y1 - y0);
+}
+
+int32_t _openslide_pixel_format_get_bytes(enum openslide_pixel_format format) {
+  switch (format) {
+  case OPENSLIDE_PIXEL_FORMAT_ARGB32_PREMULTIPLIED:
+  case OPENSLIDE_PIXEL_FORMAT_RGBA:
+  case OPENSLIDE_PIXEL_FORMAT_BGRA:
+    return 4;
+  case OPENSLIDE_PIXEL_FORMAT_RGB:
+    return 3;
+  case OPENSLIDE_PIXEL_FORMAT_GRAY8:
+    return 1;
+  }
+  return 0;
+}
+
+bool _openslide_pixel_format_check_stride(enum openslide_pixel_format format,
+                                          int64_t w, int64_t *stride,
+                                          GError **err) {
+  int32_t bytes = _openslide_pixel_format_get_bytes(format);
+  if (!bytes) {
+    g_set_error(err, OPENSLIDE_ERROR, OPENSLIDE_ERROR_FAILED,
+                "Unknown pixel format %d", format);
+    return false;
+  }
+  if (*stride == 0) {
+    *stride = w * bytes;
+  }
+  if (*stride < w * bytes) {
+    g_set_error(err, OPENSLIDE_ERROR, OPENSLIDE_ERROR_FAILED,
+                "Stride %"PRId64" too small for width %"PRId64,
+                *stride, w);
+    return false;
+  }
+  return true;
+}
+
+void _openslide_clear_pixels(void *dest, enum openslide_pixel_format format,
+                             int64_t stride, int64_t w, int64_t h) {
+  if (!dest) {
+    return;
+  }
+  int64_t row_bytes = w * _openslide_pixel_format_get_bytes(format);
+  if (stride == row_bytes) {
+    memset(dest, 0, h * row_bytes);
+  } else {
+    for (int64_t y = 0; y < h; y++) {
+      memset((uint8_t *) dest + y * stride, 0, row_bytes);
+    }
+  }
+}
+
+// un-premultiply one channel
+static inline uint8_t unpremultiply(uint32_t c, uint32_t a) {
+  return (c * 255 + a / 2) / a;
+}
+
+static void convert_row(uint8_t *dst, const uint32_t *src, int32_t w,
+                        enum openslide_pixel_format format) {
+  if (format == OPENSLIDE_PIXEL_FORMAT_ARGB32_PREMULTIPLIED) {
+    memcpy(dst, src, w * 4);
+    return;
+  }
+
+  int32_t bytes = _openslide_pixel_format_get_bytes(format);
+  for (int32_t i = 0; i < w; i++, dst += bytes) {
+    uint32_t p = src[i];
+    uint32_t a = p >> 24;
+    uint32_t r = (p >> 16) & 0xff;
+    uint32_t g = (p >> 8) & 0xff;
+    uint32_t b = p & 0xff;
+    if (a == 0) {
+      r = g = b = 0;
+    } else if (a != 0xff) {
+      r = unpremultiply(r, a);
+      g = unpremultiply(g, a);
+      b = unpremultiply(b, a);
+    }
+
+    switch (format) {
+    case OPENSLIDE_PIXEL_FORMAT_RGBA:
+      dst[0] = r;
+      dst[1] = g;
+      dst[2] = b;
+      dst[3] = a;
+      break;
+    case OPENSLIDE_PIXEL_FORMAT_BGRA:
+      dst[0] = b;
+      dst[1] = g;
+      dst[2] = r;
+      dst[3] = a;
+      break;
+    case OPENSLIDE_PIXEL_FORMAT_RGB:
+      dst[0] = r;
+      dst[1] = g;
+      dst[2] = b;
+      break;
+    case OPENSLIDE_PIXEL_FORMAT_GRAY8:
+      // Rec. 601 luma
+      dst[0] = (r * 77 + g * 150 + b * 29 + 128) >> 8;
+      break;
+    default:
+      g_assert_not_reached();
+    }
+  }
+}
+
+void _openslide_convert_pixels(void *dst, int64_t dst_stride,
+                               enum openslide_pixel_format format,
+                               const uint32_t *src, int src_stride,
+                               int32_t w, int32_t h) {
+  for (int32_t y = 0; y < h; y++) {
+    convert_row((uint8_t *) dst + y * dst_stride,
+                (const uint32_t *) ((const uint8_t *) src + y * src_stride),
+                w, format);
+  }
+}
@@ -0,0 +1,288 @@
+/*
+ *  OpenSlide, a library for reading whole slide image files
+ *
+ *  Copyright (c) 2026 OpenSlide contributors
+ *  All rights reserved.
+ *
+ *  OpenSlide is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, version 2.1.
+ *
+ *  OpenSlide is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with OpenSlide. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Deadline-bounded reads.
+ *
+ * A thread reading with a deadline enters it, and simple grids then ask
+ * before each tile whether to read it.  Tiles in memory are always read.
+ * Others are decoded only while the time left exceeds the slowest decode
+ * seen so far; after that, they are skipped.  The reading thread paints
+ * a skipped tile from the next coarser level, much as Aperio renders
+ * missing tiles, reading only tiles of that level which are in memory
+ * and falling back further for the rest, and records the tile as
+ * provisional.  Worker threads decoding ahead of the reader share its
+ * deadline, but leave the tiles they skip for the reader to paint.
+ *
+ * Once a vendor is reading a tile, whatever else it reads to produce the
+ * tile is read in full, since the tile will be cached.
+ */
+
+#include <config.h>
+
+#include "openslide-private.h"
+
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+#include <cairo.h>
+
+struct provisional_rect {
+  double x;  // level plane of the read
+  double y;
+  double w;
+  double h;
+};
+
+struct _openslide_deadline {
+  GTimer *timer;
+  double time_limit;  // seconds
+  volatile gint slowest;  // usec, of any tile decoded so far
+  GArray *provisional;  // struct provisional_rect; reader thread only
+};
+
+// a thread's use of a deadline
+struct deadline_thread {
+  struct _openslide_deadline *deadline;
+  bool fallback;
+  int fallback_depth;  // nesting of coarser levels being painted
+  int reading;  // nesting of tile reads
+  double decode_start;  // of the outermost tile read, or -1 if cached
+};
+
+static GStaticPrivate thread_deadline = G_STATIC_PRIVATE_INIT;
+
+struct _openslide_deadline *_openslide_deadline_create(int64_t time_limit_ms) {
+  struct _openslide_deadline *deadline =
+    g_slice_new0(struct _openslide_deadline);
+  deadline->timer = g_timer_new();
+  deadline->time_limit = MAX(time_limit_ms, 0) / 1000.0;
+  deadline->provisional = g_array_new(false, false,
+                                      sizeof(struct provisional_rect));
+  return deadline;
+}
+
+void _openslide_deadline_destroy(struct _openslide_deadline *deadline) {
+  g_array_free(deadline->provisional, true);
+  g_timer_destroy(deadline->timer);
+  g_slice_free(struct _openslide_deadline, deadline);
+}
+
+void _openslide_deadline_enter(struct _openslide_deadline *deadline,
+                               bool fallback) {
+  g_assert(g_static_private_get(&thread_deadline) == NULL);
+  if (deadline == NULL) {
+    return;
+  }
+  struct deadline_thread *dt = g_slice_new0(struct deadline_thread);
+  dt->deadline = deadline;
+  dt->fallback = fallback;
+  dt->decode_start = -1;
+  g_static_private_set(&thread_deadline, dt, NULL);
+}
+
+void _openslide_deadline_leave(void) {
+  struct deadline_thread *dt = g_static_private_get(&thread_deadline);
+  if (dt) {
+    g_slice_free(struct deadline_thread, dt);
+    g_static_private_set(&thread_deadline, NULL, NULL);
+  }
+}
+
+struct _openslide_deadline *_openslide_deadline_get_current(void) {
+  struct deadline_thread *dt = g_static_private_get(&thread_deadline);
+  return dt ? dt->deadline : NULL;
+}
+
+void *_openslide_deadline_suspend(void) {
+  struct deadline_thread *dt = g_static_private_get(&thread_deadline);
+  g_static_private_set(&thread_deadline, NULL, NULL);
+  return dt;
+}
+
+void _openslide_deadline_resume(void *saved) {
+  g_assert(g_static_private_get(&thread_deadline) == NULL);
+  g_static_private_set(&thread_deadline, saved, NULL);
+}
+
+static double get_elapsed(struct _openslide_deadline *deadline) {
+  return g_timer_elapsed(deadline->timer, NULL);
+}
+
+// whether another tile can be decoded in time
+static bool have_time(struct _openslide_deadline *deadline) {
+  double slowest = (double) g_atomic_int_get(&deadline->slowest) /
+                   G_USEC_PER_SEC;
+  return get_elapsed(deadline) + slowest < deadline->time_limit;
+}
+
+static void note_decode_time(struct _openslide_deadline *deadline,
+                             double seconds) {
+  gint usec = MIN(seconds * G_USEC_PER_SEC, G_MAXINT);
+  gint slowest;
+  do {
+    slowest = g_atomic_int_get(&deadline->slowest);
+    if (usec <= slowest) {
+      return;
+    }
+  } while (!g_atomic_int_compare_and_exchange(&deadline->slowest,
+                                              slowest, usec));
+}
+
+static struct _openslide_level *get_next_level(struct _openslide_level **levels,
+                                               int32_t level_count,
+                                               struct _openslide_level *level) {
+  for (int32_t i = 0; i < level_count - 1; i++) {
+    if (levels[i] == level) {
+      return levels[i + 1];
+    }
+  }
+  return NULL;
+}
+
+// the next smaller level, or NULL if there is none
+static struct _openslide_level *get_coarser_level(openslide_t *osr,
+                                                  struct _openslide_level *level) {
+  struct _openslide_level *next = get_next_level(osr->levels,
+                                                 osr->level_count, level);
+  for (int32_t i = 0; next == NULL && i < osr->zlevel_count; i++) {
+    next = get_next_level(osr->zlevels[i]->levels,
+                          osr->zlevels[i]->level_count, level);
+  }
+  return next;
+}
+
+// paint a w x h tile at (x, y) in the level plane from the next coarser
+// level, with cr translated to the tile
+static void paint_fallback(openslide_t *osr, cairo_t *cr,
+                           struct deadline_thread *dt,
+                           struct _openslide_level *level,
+                           double x, double y, double w, double h) {
+  struct _openslide_level *coarser = get_coarser_level(osr, level);
+  if (coarser == NULL) {
+    // leave it transparent
+    return;
+  }
+  double ds = level->downsample;
+  double relative_ds = coarser->downsample / ds;
+
+  // the coarser region starts at or just before the tile, and extends a
+  // pixel past it, so rounding leaves no seam
+  int64_t x0 = floor(x * ds);
+  int64_t y0 = floor(y * ds);
+  cairo_save(cr);
+  cairo_rectangle(cr, 0, 0, w, h);
+  cairo_clip(cr);
+  cairo_translate(cr, x0 / ds - x, y0 / ds - y);
+  cairo_scale(cr, relative_ds, relative_ds);
+
+  // errors will recur, and be reported, when the tile is read in full
+  dt->fallback_depth++;
+  osr->ops->paint_region(osr, cr, x0, y0, coarser,
+                         ceil(w / relative_ds) + 1,
+                         ceil(h / relative_ds) + 1,
+                         NULL);
+  dt->fallback_depth--;
+  cairo_restore(cr);
+}
+
+bool _openslide_deadline_skip_tile(openslide_t *osr, cairo_t *cr,
+                                   void *plane,
+                                   struct _openslide_level *level,
+                                   int64_t col, int64_t row,
+                                   double x, double y, double w, double h) {
+  struct deadline_thread *dt = g_static_private_get(&thread_deadline);
+  if (dt == NULL) {
+    return false;
+  }
+  if (dt->reading) {
+    // a tile of another level, needed to produce the one being read
+    dt->reading++;
+    return false;
+  }
+
+  struct _openslide_deadline *deadline = dt->deadline;
+  if (_openslide_cache_contains(osr->cache, plane, col, row)) {
+    // it could be evicted before the vendor gets it, but rarely
+    dt->reading++;
+    dt->decode_start = -1;
+    return false;
+  }
+  if (dt->fallback_depth == 0 && have_time(deadline)) {
+    dt->reading++;
+    dt->decode_start = get_elapsed(deadline);
+    return false;
+  }
+
+  if (dt->fallback) {
+    if (dt->fallback_depth == 0) {
+      struct provisional_rect rect = {
+        .x = x,
+        .y = y,
+        .w = w,
+        .h = h,
+      };
+      g_array_append_val(deadline->provisional, rect);
+    }
+    paint_fallback(osr, cr, dt, level, x, y, w, h);
+  }
+  return true;
+}
+
+void _openslide_deadline_tile_done(void) {
+  struct deadline_thread *dt = g_static_private_get(&thread_deadline);
+  if (dt == NULL) {
+    return;
+  }
+  g_assert(dt->reading > 0);
+  if (--dt->reading == 0 && dt->decode_start >= 0) {
+    note_decode_time(dt->deadline,
+                     get_elapsed(dt->deadline) - dt->decode_start);
+    dt->decode_start = -1;
+  }
+}
+
+bool _openslide_deadline_mark_provisional(struct _openslide_deadline *deadline,
+                                          uint8_t *mask,
+                                          double x, double y,
+                                          int64_t w, int64_t h) {
+  bool found = false;
+  for (guint i = 0; i < deadline->provisional->len; i++) {
+    struct provisional_rect *rect =
+      &g_array_index(deadline->provisional, struct provisional_rect, i);
+    // any pixel the tile touches is provisional
+    int64_t x0 = CLAMP(floor(rect->x - x), 0, w);
+    int64_t y0 = CLAMP(floor(rect->y - y), 0, h);
+    int64_t x1 = CLAMP(ceil(rect->x + rect->w - x), 0, w);
+    int64_t y1 = CLAMP(ceil(rect->y + rect->h - y), 0, h);
+    if (x0 >= x1 || y0 >= y1) {
+      continue;
+    }
+    found = true;
+    if (mask == NULL) {
+      break;
+    }
+    for (int64_t row = y0; row < y1; row++) {
+      memset(mask + row * w + x0, 255, x1 - x0);
+    }
+  }
+  return found;
+}
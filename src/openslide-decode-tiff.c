@@ -266,6 +266,8 @@ DONE:
 
 bool _openslide_tiff_read_tile(struct _openslide_tiff_level *tiffl,
                                TIFF *tiff,
+                               struct _openslide_cache_binding *cb,
+                               void *plane,
                                uint32_t *dest,
                                int64_t tile_col, int64_t tile_row,
                                GError **err) {
@@ -292,7 +294,7 @@ bool _openslide_tiff_read_tile(struct _openslide_tiff_level *tiffl,
     // read data
     void *buf;
     int32_t buflen;
-    if (!_openslide_tiff_read_tile_data(tiffl, tiff,
+    if (!_openslide_tiff_read_tile_data(tiffl, tiff, cb, plane,
                                         &buf, &buflen,
                                         tile_col, tile_row,
                                         err)) {
@@ -320,9 +322,22 @@ bool _openslide_tiff_read_tile(struct _openslide_tiff_level *tiffl,
 
 bool _openslide_tiff_read_tile_data(struct _openslide_tiff_level *tiffl,
                                     TIFF *tiff,
+                                    struct _openslide_cache_binding *cb,
+                                    void *plane,
                                     void **_buf, int32_t *_len,
                                     int64_t tile_col, int64_t tile_row,
                                     GError **err) {
+  // check the compressed cache tier
+  int cached_size;
+  void *cached = _openslide_cache_get_compressed(cb, plane,
+                                                 tile_col, tile_row,
+                                                 &cached_size);
+  if (cached) {
+    *_buf = cached;
+    *_len = cached_size;
+    return true;
+  }
+
   // set directory
   SET_DIR_OR_FAIL(tiff, tiffl->dir);
 
@@ -353,12 +368,94 @@ bool _openslide_tiff_read_tile_data(struct _openslide_tiff_level *tiffl,
     return false;
   }
 
+  // keep a copy
+  _openslide_cache_put_compressed(cb, plane, tile_col, tile_row, buf, size);
+
   // set outputs
   *_buf = buf;
   *_len = size;
   return true;
 }
 
+bool _openslide_tiff_read_raw_tile(struct _openslide_tiff_level *tiffl,
+                                   TIFF *tiff,
+                                   struct _openslide_cache_binding *cb,
+                                   void *plane,
+                                   void **_buf, int32_t *_len,
+                                   int64_t tile_col, int64_t tile_row,
+                                   GError **err) {
+  *_buf = NULL;
+  *_len = 0;
+  if (!tiffl->tile_read_direct ||
+      tile_col < 0 || tile_col >= tiffl->tiles_across ||
+      tile_row < 0 || tile_row >= tiffl->tiles_down) {
+    return true;
+  }
+
+  bool is_missing;
+  if (!_openslide_tiff_check_missing_tile(tiffl, tiff, tile_col, tile_row,
+                                          &is_missing, err)) {
+    return false;
+  }
+  if (is_missing) {
+    return true;
+  }
+
+  // read tables
+  const uint8_t *tables;
+  uint32_t tables_len;
+  if (!TIFFGetField(tiff, TIFFTAG_JPEGTABLES, &tables_len, &tables) ||
+      tables_len < 4) {
+    // no separate tables
+    tables = NULL;
+    tables_len = 0;
+  }
+
+  // read data
+  void *data;
+  int32_t data_len;
+  if (!_openslide_tiff_read_tile_data(tiffl, tiff, cb, plane,
+                                      &data, &data_len,
+                                      tile_col, tile_row,
+                                      err)) {
+    return false;
+  }
+  const uint8_t *d = data;
+  if (data_len < 4 || d[0] != 0xFF || d[1] != 0xD8) {
+    // no passthrough; the caller can decode the tile instead
+    g_free(data);
+    return true;
+  }
+
+  // Adobe marker giving the color space from the TIFF photometric tag,
+  // which decoders would otherwise guess (wrongly, for Aperio RGB)
+  const uint8_t adobe[] = {
+    0xFF, 0xEE, 0x00, 0x0E, 'A', 'd', 'o', 'b', 'e',
+    0x00, 0x64, 0x00, 0x00, 0x00, 0x00,
+    tiffl->photometric == PHOTOMETRIC_YCBCR ? 1 : 0,
+  };
+
+  // SOI, Adobe marker, tables without SOI and EOI, tile without SOI
+  int32_t tables_body = tables ? tables_len - 4 : 0;
+  int32_t len = 2 + sizeof(adobe) + tables_body + data_len - 2;
+  uint8_t *buf = g_malloc(len);
+  uint8_t *p = buf;
+  *p++ = 0xFF;
+  *p++ = 0xD8;
+  memcpy(p, adobe, sizeof(adobe));
+  p += sizeof(adobe);
+  if (tables_body) {
+    memcpy(p, tables + 2, tables_body);
+    p += tables_body;
+  }
+  memcpy(p, d + 2, data_len - 2);
+  g_free(data);
+
+  *_buf = buf;
+  *_len = len;
+  return true;
+}
+
 // sets out-argument to indicate whether the tile data is zero bytes long
 // returns false on error
 bool _openslide_tiff_check_missing_tile(struct _openslide_tiff_level *tiffl,
@@ -57,18 +57,34 @@ bool _openslide_tiff_check_missing_tile(struct _openslide_tiff_level *tiffl,
                                         bool *is_missing,
                                         GError **err);
 
+// cb and plane locate the tile in the compressed cache tier; cb may be NULL
 bool _openslide_tiff_read_tile(struct _openslide_tiff_level *tiffl,
                                TIFF *tiff,
+                               struct _openslide_cache_binding *cb,
+                               void *plane,
                                uint32_t *dest,
                                int64_t tile_col, int64_t tile_row,
                                GError **err);
 
 bool _openslide_tiff_read_tile_data(struct _openslide_tiff_level *tiffl,
                                     TIFF *tiff,
+                                    struct _openslide_cache_binding *cb,
+                                    void *plane,
                                     void **buf, int32_t *len,
                                     int64_t tile_col, int64_t tile_row,
                                     GError **err);
 
+// a self-contained JPEG for a tile of a level with tile_read_direct, with
+// the tables merged in and the color space made explicit.  *buf is a
+// g_malloc'd buffer, or NULL if the tile is missing or not a JPEG.
+bool _openslide_tiff_read_raw_tile(struct _openslide_tiff_level *tiffl,
+                                   TIFF *tiff,
+                                   struct _openslide_cache_binding *cb,
+                                   void *plane,
+                                   void **buf, int32_t *len,
+                                   int64_t tile_col, int64_t tile_row,
+                                   GError **err);
+
 bool _openslide_tiff_clip_tile(struct _openslide_tiff_level *tiffl,
                                uint32_t *tiledata,
                                int64_t tile_col, int64_t tile_row,
@@ -0,0 +1,496 @@
+/*
+ *  OpenSlide, a library for reading whole slide image files
+ *
+ *  Copyright (c) 2026 OpenSlide contributors
+ *  All rights reserved.
+ *
+ *  OpenSlide is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, version 2.1.
+ *
+ *  OpenSlide is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with OpenSlide. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Persistent decoded-tile cache.
+ *
+ * Each tile is a file <dir>/<slide-id>/<plane>-<x>-<y>.tile, holding a
+ * fixed-size header followed by the ARGB pixels.  The header is padded
+ * to a page, so the pixels are page-aligned in the file, ready to be
+ * mapped.  Tiles are nevertheless read with stdio into slab buffers: a
+ * cache entry must own slab memory, the checksum touches every page
+ * anyway, and mapping a file shorter than its header claims would fault
+ * rather than fail the read.  Files are written to a temporary name and
+ * renamed into place, and carry a checksum, so a crash leaves either a
+ * complete tile or no tile.
+ *
+ * Writes happen on a background thread so that the read path never
+ * waits on them; if the writer falls behind, tiles are simply not
+ * persisted.  An in-memory index of the directory tracks file sizes and
+ * recency for size-bounded LRU eviction, and lets misses skip the
+ * filesystem entirely.  It is loaded when the cache is opened, so tiles
+ * from earlier runs are found straight away.
+ *
+ * Several processes may share the directory.  Each indexes only the
+ * files it has seen, so the writer rescans the directory every so often
+ * and evicts against the size of everything there, not just what this
+ * process wrote.  The directory can exceed its capacity by what other
+ * processes write between rescans.
+ */
+
+#include <config.h>
+
+#include "openslide-private.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#ifdef HAVE_FSYNC
+#include <unistd.h>
+#endif
+
+#define DISK_MAGIC "OSTILE01"
+#define DISK_HEADER_SIZE 4096
+#define DISK_SUFFIX ".tile"
+#define DISK_TEMP_SUFFIX ".tmp"
+#define DISK_TEMP_MAX_AGE 3600  // seconds
+
+// drop writes beyond this many pending tiles
+#define DISK_MAX_PENDING 64
+
+// seconds between rescans of the directory for other processes' files
+#define DISK_RESCAN_INTERVAL 30
+
+struct disk_header {
+  char magic[8];
+  int32_t size;
+  uint32_t reserved;
+  uint64_t checksum;
+};
+
+// a tile file, in the index
+struct disk_entry {
+  char *key;  // path relative to the cache directory
+  int64_t size;  // of the file
+  GList *link;
+};
+
+struct _openslide_diskcache {
+  char *dirname;
+  GThreadPool *writer;
+  volatile gint shutting_down;
+
+  // protects the index
+  GMutex *mutex;
+  GHashTable *index;  // key -> struct disk_entry
+  GQueue *lru;  // most recently used at the head
+  int64_t capacity;
+  int64_t total_size;
+
+  time_t last_scan;  // used by the writer thread
+};
+
+struct disk_job {
+  char *key;
+  void *data;
+  int size;
+  struct _openslide_cache_entry *entry;  // keeps data alive
+};
+
+static char *make_key(const char *slide_id, int32_t plane,
+                      int64_t x, int64_t y) {
+  return g_strdup_printf("%s/%d-%"PRId64"-%"PRId64 DISK_SUFFIX,
+                         slide_id, plane, x, y);
+}
+
+// cheap enough to run on every read
+static uint64_t checksum(const void *data, int size) {
+  const uint32_t *p = data;
+  uint64_t a = 1;
+  uint64_t b = 0;
+  for (int i = 0; i < size / 4; i++) {
+    a += p[i];
+    b += a;
+  }
+  return (b << 32) ^ a;
+}
+
+// index mutex must be held
+static void index_remove(struct _openslide_diskcache *dc,
+                         struct disk_entry *de) {
+  g_hash_table_remove(dc->index, de->key);
+  g_queue_delete_link(dc->lru, de->link);
+  dc->total_size -= de->size;
+  g_free(de->key);
+  g_slice_free(struct disk_entry, de);
+}
+
+// index mutex must be held
+static void index_add(struct _openslide_diskcache *dc,
+                      char *key, int64_t size) {
+  struct disk_entry *de = g_hash_table_lookup(dc->index, key);
+  if (de) {
+    index_remove(dc, de);
+  }
+  de = g_slice_new(struct disk_entry);
+  de->key = key;
+  de->size = size;
+  g_queue_push_head(dc->lru, de);
+  de->link = g_queue_peek_head_link(dc->lru);
+  g_hash_table_insert(dc->index, de->key, de);
+  dc->total_size += size;
+}
+
+// called on the writer thread
+static void evict(struct _openslide_diskcache *dc) {
+  g_mutex_lock(dc->mutex);
+  while (dc->total_size > dc->capacity) {
+    struct disk_entry *de = g_queue_peek_tail(dc->lru);
+    if (de == NULL) {
+      break;
+    }
+    char *path = g_build_filename(dc->dirname, de->key, NULL);
+    g_unlink(path);
+    g_free(path);
+    index_remove(dc, de);
+  }
+  g_mutex_unlock(dc->mutex);
+}
+
+struct scanned_file {
+  char *key;
+  int64_t size;
+  time_t mtime;
+};
+
+static gint compare_mtime(gconstpointer a, gconstpointer b) {
+  const struct scanned_file *fa = *(struct scanned_file * const *) a;
+  const struct scanned_file *fb = *(struct scanned_file * const *) b;
+  return (fa->mtime > fb->mtime) - (fa->mtime < fb->mtime);
+}
+
+// bring the index up to date with the directory, which other processes
+// may be writing to and evicting from.  tiles already indexed keep their
+// recency; tiles new to us are the most recent, newest first.  called
+// when opening, and then on the writer thread.
+static void scan(struct _openslide_diskcache *dc) {
+  GPtrArray *files = g_ptr_array_new();
+  time_t now = time(NULL);
+
+  GDir *dir = g_dir_open(dc->dirname, 0, NULL);
+  if (dir == NULL) {
+    g_ptr_array_free(files, true);
+    return;
+  }
+  const char *slide_id;
+  while ((slide_id = g_dir_read_name(dir)) != NULL) {
+    char *slide_path = g_build_filename(dc->dirname, slide_id, NULL);
+    GDir *slide_dir = g_dir_open(slide_path, 0, NULL);
+    if (slide_dir) {
+      const char *name;
+      while ((name = g_dir_read_name(slide_dir)) != NULL) {
+        char *path = g_build_filename(slide_path, name, NULL);
+        struct stat st;
+        if (g_stat(path, &st)) {
+          // raced with another process
+        } else if (g_str_has_suffix(name, DISK_TEMP_SUFFIX)) {
+          // left over from a crash, unless another process is writing it
+          if (st.st_mtime < now - DISK_TEMP_MAX_AGE) {
+            g_unlink(path);
+          }
+        } else if (g_str_has_suffix(name, DISK_SUFFIX)) {
+          struct scanned_file *f = g_slice_new(struct scanned_file);
+          f->key = g_strdup_printf("%s/%s", slide_id, name);
+          f->size = st.st_size;
+          f->mtime = st.st_mtime;
+          g_ptr_array_add(files, f);
+        }
+        g_free(path);
+      }
+      g_dir_close(slide_dir);
+    }
+    g_free(slide_path);
+  }
+  g_dir_close(dir);
+
+  // oldest first, so the newest end up at the head of the LRU list
+  g_ptr_array_sort(files, compare_mtime);
+  GHashTable *found = g_hash_table_new(g_str_hash, g_str_equal);
+  for (guint i = 0; i < files->len; i++) {
+    struct scanned_file *f = files->pdata[i];
+    g_hash_table_insert(found, f->key, f);
+  }
+
+  g_mutex_lock(dc->mutex);
+  // forget tiles evicted by other processes
+  GList *cur = dc->lru->head;
+  while (cur) {
+    GList *next = cur->next;
+    struct disk_entry *de = cur->data;
+    if (!g_hash_table_lookup(found, de->key)) {
+      index_remove(dc, de);
+    }
+    cur = next;
+  }
+  g_hash_table_destroy(found);
+  for (guint i = 0; i < files->len; i++) {
+    struct scanned_file *f = files->pdata[i];
+    if (!g_hash_table_lookup(dc->index, f->key)) {
+      index_add(dc, f->key, f->size);
+    } else {
+      g_free(f->key);
+    }
+    g_slice_free(struct scanned_file, f);
+  }
+  g_mutex_unlock(dc->mutex);
+  g_ptr_array_free(files, true);
+  dc->last_scan = now;
+
+  evict(dc);
+}
+
+// called on the writer thread
+static bool write_tile(struct _openslide_diskcache *dc,
+                       const char *key,
+                       const void *data, int size) {
+  char *path = g_build_filename(dc->dirname, key, NULL);
+  // unique across processes sharing the directory
+  char *temp_path = g_strdup_printf("%s.%08x" DISK_TEMP_SUFFIX,
+                                    path, g_random_int());
+  bool success = false;
+
+  char *parent = g_path_get_dirname(path);
+  g_mkdir_with_parents(parent, 0777);
+  g_free(parent);
+
+  FILE *f = _openslide_fopen(temp_path, "wb", NULL);
+  if (f == NULL) {
+    goto OUT;
+  }
+
+  char header_buf[DISK_HEADER_SIZE] = {0};
+  struct disk_header header = {
+    .size = size,
+    .checksum = checksum(data, size),
+  };
+  memcpy(header.magic, DISK_MAGIC, sizeof(header.magic));
+  memcpy(header_buf, &header, sizeof(header));
+
+  bool ok = fwrite(header_buf, sizeof(header_buf), 1, f) == 1 &&
+            fwrite(data, size, 1, f) == 1 &&
+            fflush(f) == 0;
+#ifdef HAVE_FSYNC
+  // make sure the data is on disk before the rename makes it visible
+  ok = ok && fsync(fileno(f)) == 0;
+#endif
+  if (fclose(f) || !ok) {
+    g_unlink(temp_path);
+    goto OUT;
+  }
+
+#ifdef G_OS_WIN32
+  // rename() won't replace an existing file on Windows.  elsewhere it
+  // replaces atomically, and readers never see the tile missing.
+  g_unlink(path);
+#endif
+  if (g_rename(temp_path, path)) {
+    g_unlink(temp_path);
+    goto OUT;
+  }
+  success = true;
+
+OUT:
+  g_free(temp_path);
+  g_free(path);
+  return success;
+}
+
+static void job_free(struct disk_job *job) {
+  if (job->entry) {
+    _openslide_cache_entry_unref(job->entry);
+  }
+  g_free(job->key);
+  g_slice_free(struct disk_job, job);
+}
+
+static void writer_func(gpointer data, gpointer user_data) {
+  struct disk_job *job = data;
+  struct _openslide_diskcache *dc = user_data;
+
+  if (g_atomic_int_get(&dc->shutting_down)) {
+    job_free(job);
+    return;
+  }
+
+  g_mutex_lock(dc->mutex);
+  bool exists = g_hash_table_lookup(dc->index, job->key) != NULL;
+  g_mutex_unlock(dc->mutex);
+  if (!exists && write_tile(dc, job->key, job->data, job->size)) {
+    g_mutex_lock(dc->mutex);
+    index_add(dc, job->key, DISK_HEADER_SIZE + job->size);
+    job->key = NULL;  // now owned by the index
+    g_mutex_unlock(dc->mutex);
+    if (time(NULL) - dc->last_scan >= DISK_RESCAN_INTERVAL) {
+      scan(dc);
+    } else {
+      evict(dc);
+    }
+  }
+  job_free(job);
+}
+
+struct _openslide_diskcache *_openslide_diskcache_create(const char *dirname,
+                                                         int64_t capacity,
+                                                         GError **err) {
+  if (g_mkdir_with_parents(dirname, 0777)) {
+    _openslide_io_error(err, "Couldn't create cache directory %s", dirname);
+    return NULL;
+  }
+
+  struct _openslide_diskcache *dc = g_slice_new0(struct _openslide_diskcache);
+  dc->dirname = g_strdup(dirname);
+  dc->mutex = g_mutex_new();
+  dc->index = g_hash_table_new(g_str_hash, g_str_equal);
+  dc->lru = g_queue_new();
+  dc->capacity = capacity;
+
+  // load the index before any lookups
+  scan(dc);
+
+  GError *tmp_err = NULL;
+  dc->writer = g_thread_pool_new(writer_func, dc, 1, true, &tmp_err);
+  if (dc->writer == NULL) {
+    g_propagate_error(err, tmp_err);
+    _openslide_diskcache_destroy(dc);
+    return NULL;
+  }
+
+  return dc;
+}
+
+void _openslide_diskcache_destroy(struct _openslide_diskcache *dc) {
+  if (dc->writer) {
+    // discard pending writes
+    g_atomic_int_set(&dc->shutting_down, 1);
+    g_thread_pool_free(dc->writer, false, true);
+  }
+
+  struct disk_entry *de;
+  while ((de = g_queue_peek_tail(dc->lru)) != NULL) {
+    index_remove(dc, de);
+  }
+  g_queue_free(dc->lru);
+  g_hash_table_unref(dc->index);
+  g_mutex_free(dc->mutex);
+  g_free(dc->dirname);
+  g_slice_free(struct _openslide_diskcache, dc);
+}
+
+// drop a tile from the index
+static void forget(struct _openslide_diskcache *dc, const char *key) {
+  g_mutex_lock(dc->mutex);
+  struct disk_entry *de = g_hash_table_lookup(dc->index, key);
+  if (de) {
+    index_remove(dc, de);
+  }
+  g_mutex_unlock(dc->mutex);
+}
+
+void *_openslide_diskcache_get(struct _openslide_diskcache *dc,
+                               const char *slide_id,
+                               int32_t plane,
+                               int64_t x, int64_t y,
+                               int size_in_bytes) {
+  char *key = make_key(slide_id, plane, x, y);
+
+  // check the index, and mark as recently used
+  g_mutex_lock(dc->mutex);
+  struct disk_entry *de = g_hash_table_lookup(dc->index, key);
+  if (de) {
+    g_queue_unlink(dc->lru, de->link);
+    g_queue_push_head_link(dc->lru, de->link);
+  }
+  g_mutex_unlock(dc->mutex);
+  if (de == NULL) {
+    g_free(key);
+    return NULL;
+  }
+
+  char *path = g_build_filename(dc->dirname, key, NULL);
+  void *data = NULL;
+  struct disk_header header;
+  GError *tmp_err = NULL;
+  FILE *f = _openslide_fopen(path, "rb", &tmp_err);
+  if (f == NULL) {
+    // forget a tile removed by another process, but keep one we merely
+    // couldn't open just now
+    bool missing = g_error_matches(tmp_err, G_FILE_ERROR, G_FILE_ERROR_NOENT);
+    g_clear_error(&tmp_err);
+    if (missing) {
+      forget(dc, key);
+    }
+    g_free(path);
+    g_free(key);
+    return NULL;
+  }
+  if (fread(&header, sizeof(header), 1, f) != 1 ||
+      memcmp(header.magic, DISK_MAGIC, sizeof(header.magic)) ||
+      header.size != size_in_bytes ||
+      fseeko(f, DISK_HEADER_SIZE, SEEK_SET)) {
+    goto FAIL;
+  }
+  data = _openslide_slab_alloc(header.size);
+  if (fread(data, header.size, 1, f) != 1 ||
+      checksum(data, header.size) != header.checksum) {
+    goto FAIL;
+  }
+  fclose(f);
+
+  g_free(path);
+  g_free(key);
+  return data;
+
+FAIL:
+  // damaged, or not the tile we expected; delete it
+  fclose(f);
+  if (data) {
+    _openslide_slab_free(size_in_bytes, data);
+  }
+  g_unlink(path);
+  forget(dc, key);
+  g_free(path);
+  g_free(key);
+  return NULL;
+}
+
+void _openslide_diskcache_put(struct _openslide_diskcache *dc,
+                              const char *slide_id,
+                              int32_t plane,
+                              int64_t x, int64_t y,
+                              void *data, int size_in_bytes,
+                              struct _openslide_cache_entry *entry) {
+  if (g_thread_pool_unprocessed(dc->writer) >= DISK_MAX_PENDING) {
+    // falling behind
+    _openslide_cache_entry_unref(entry);
+    return;
+  }
+
+  struct disk_job *job = g_slice_new0(struct disk_job);
+  job->key = make_key(slide_id, plane, x, y);
+  job->data = data;
+  job->size = size_in_bytes;
+  job->entry = entry;
+  g_thread_pool_push(dc->writer, job, NULL);
+}
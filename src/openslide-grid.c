@@ -61,6 +61,16 @@ struct grid_ops {
                        struct _openslide_level *level,
                        int32_t w, int32_t h,
                        GError **err);
+  // false if there is no such tile
+  bool (*get_tile_size)(struct _openslide_grid *grid,
+                        int64_t col, int64_t row,
+                        int32_t *w, int32_t *h);
+  // paint an existing tile at the origin
+  bool (*paint_tile)(struct _openslide_grid *grid,
+                     cairo_t *cr, void *arg,
+                     struct _openslide_level *level,
+                     int64_t col, int64_t row,
+                     GError **err);
   void (*destroy)(struct _openslide_grid *grid);
 };
 
@@ -78,6 +88,10 @@ struct _openslide_grid {
 
   double tile_advance_x;
   double tile_advance_y;
+
+  // position of the grid in the level plane, for tiles that are skipped
+  double origin_x;
+  double origin_y;
 };
 
 struct simple_grid {
@@ -86,6 +100,7 @@ struct simple_grid {
   int64_t tiles_across;
   int64_t tiles_down;
   _openslide_grid_simple_read_fn read_tile;
+  void *cache_plane;  // NULL if tiles are cached by level
 };
 
 struct tilemap_grid {
@@ -216,10 +231,23 @@ static bool read_tiles(cairo_t *cr,
       double translate_x = ((tile_x - region->start_tile_x) *
                             grid->tile_advance_x) - region->offset_x;
       //      g_debug("read_tiles %"PRId64" %"PRId64, tile_x, tile_y);
+      if (!_openslide_check_cancel(err)) {
+        return false;
+      }
       cairo_translate(cr, translate_x, translate_y);
-      bool success = callback(grid, region, cr,
-                              level, tile_x, tile_y,
-                              arg, err);
+      bool success = true;
+      if (!_openslide_tissue_skip_tile(grid->osr, cr, level,
+                                       grid->origin_x +
+                                       tile_x * grid->tile_advance_x,
+                                       grid->origin_y +
+                                       tile_y * grid->tile_advance_y,
+                                       grid->tile_advance_x,
+                                       grid->tile_advance_y)) {
+        success = callback(grid, region, cr,
+                           level, tile_x, tile_y,
+                           arg, err);
+        _openslide_tissue_tile_done();
+      }
       cairo_set_matrix(cr, &matrix);
       if (!success) {
         return false;
@@ -275,8 +303,25 @@ static bool simple_read_tile(struct _openslide_grid *_grid,
                              GError **err) {
   struct simple_grid *grid = (struct simple_grid *) _grid;
 
-  if (!grid->read_tile(grid->base.osr, cr, level,
-                       tile_col, tile_row, arg, err)) {
+  // with a deadline, the tile may be painted from a coarser level
+  void *plane = grid->cache_plane ? grid->cache_plane : level;
+  if (_openslide_deadline_skip_tile(grid->base.osr, cr, plane, level,
+                                    tile_col, tile_row,
+                                    grid->base.origin_x +
+                                    tile_col * grid->base.tile_advance_x,
+                                    grid->base.origin_y +
+                                    tile_row * grid->base.tile_advance_y,
+                                    grid->base.tile_advance_x,
+                                    grid->base.tile_advance_y)) {
+    return true;
+  }
+
+  int claims = _openslide_cache_get_claim_mark();
+  bool success = grid->read_tile(grid->base.osr, cr, level,
+                                 tile_col, tile_row, arg, err);
+  _openslide_cache_abandon_claims(claims);
+  _openslide_deadline_tile_done();
+  if (!success) {
     return false;
   }
   if (_openslide_debug(OPENSLIDE_DEBUG_TILES)) {
@@ -337,6 +382,35 @@ static bool simple_paint_region(struct _openslide_grid *_grid,
   return result;
 }
 
+static bool simple_get_tile_size(struct _openslide_grid *_grid,
+                                 int64_t col, int64_t row,
+                                 int32_t *w, int32_t *h) {
+  struct simple_grid *grid = (struct simple_grid *) _grid;
+
+  if (col < 0 || row < 0 ||
+      col >= grid->tiles_across || row >= grid->tiles_down) {
+    return false;
+  }
+  *w = grid->base.tile_advance_x;
+  *h = grid->base.tile_advance_y;
+  return true;
+}
+
+static bool simple_paint_tile(struct _openslide_grid *_grid,
+                              cairo_t *cr,
+                              void *arg,
+                              struct _openslide_level *level,
+                              int64_t col, int64_t row,
+                              GError **err) {
+  struct simple_grid *grid = (struct simple_grid *) _grid;
+
+  int claims = _openslide_cache_get_claim_mark();
+  bool success = grid->read_tile(grid->base.osr, cr, level,
+                                 col, row, arg, err);
+  _openslide_cache_abandon_claims(claims);
+  return success;
+}
+
 static void simple_destroy(struct _openslide_grid *_grid) {
   struct simple_grid *grid = (struct simple_grid *) _grid;
 
@@ -346,6 +420,8 @@ static void simple_destroy(struct _openslide_grid *_grid) {
 static const struct grid_ops simple_grid_ops = {
   .get_bounds = simple_get_bounds,
   .paint_region = simple_paint_region,
+  .get_tile_size = simple_get_tile_size,
+  .paint_tile = simple_paint_tile,
   .destroy = simple_destroy,
 };
 
@@ -366,6 +442,14 @@ struct _openslide_grid *_openslide_grid_create_simple(openslide_t *osr,
   return (struct _openslide_grid *) grid;
 }
 
+void _openslide_grid_simple_set_cache_plane(struct _openslide_grid *_grid,
+                                            void *plane) {
+  struct simple_grid *grid = (struct simple_grid *) _grid;
+  g_assert(grid->base.ops == &simple_grid_ops);
+
+  grid->cache_plane = plane;
+}
+
 
 
 static guint tilemap_tile_hash_func(gconstpointer key) {
@@ -439,9 +523,11 @@ static bool tilemap_read_tile(struct _openslide_grid *_grid,
   cairo_matrix_t matrix;
   cairo_get_matrix(cr, &matrix);
   cairo_translate(cr, tile->offset_x, tile->offset_y);
+  int claims = _openslide_cache_get_claim_mark();
   bool success = grid->read_tile(grid->base.osr, cr, level,
                                  tile->col, tile->row, tile->data,
                                  arg, err);
+  _openslide_cache_abandon_claims(claims);
   if (success && _openslide_debug(OPENSLIDE_DEBUG_TILES)) {
     char *coordinates = g_strdup_printf("%"PRId64", %"PRId64,
                                         tile_col, tile_row);
@@ -491,6 +577,47 @@ static bool tilemap_paint_region(struct _openslide_grid *_grid,
   return result;
 }
 
+static struct tilemap_tile *tilemap_lookup_tile(struct tilemap_grid *grid,
+                                               int64_t col, int64_t row) {
+  struct tilemap_tile coords = {
+    .col = col,
+    .row = row,
+  };
+  return g_hash_table_lookup(grid->tiles, &coords);
+}
+
+static bool tilemap_get_tile_size(struct _openslide_grid *_grid,
+                                  int64_t col, int64_t row,
+                                  int32_t *w, int32_t *h) {
+  struct tilemap_grid *grid = (struct tilemap_grid *) _grid;
+
+  struct tilemap_tile *tile = tilemap_lookup_tile(grid, col, row);
+  if (tile == NULL) {
+    return false;
+  }
+  *w = ceil(tile->w);
+  *h = ceil(tile->h);
+  return true;
+}
+
+static bool tilemap_paint_tile(struct _openslide_grid *_grid,
+                               cairo_t *cr,
+                               void *arg,
+                               struct _openslide_level *level,
+                               int64_t col, int64_t row,
+                               GError **err) {
+  struct tilemap_grid *grid = (struct tilemap_grid *) _grid;
+
+  // the tile itself, without its offset from the grid
+  struct tilemap_tile *tile = tilemap_lookup_tile(grid, col, row);
+  int claims = _openslide_cache_get_claim_mark();
+  bool success = grid->read_tile(grid->base.osr, cr, level,
+                                 tile->col, tile->row, tile->data,
+                                 arg, err);
+  _openslide_cache_abandon_claims(claims);
+  return success;
+}
+
 static void tilemap_destroy(struct _openslide_grid *_grid) {
   struct tilemap_grid *grid = (struct tilemap_grid *) _grid;
 
@@ -501,6 +628,8 @@ static void tilemap_destroy(struct _openslide_grid *_grid) {
 static const struct grid_ops tilemap_grid_ops = {
   .get_bounds = tilemap_get_bounds,
   .paint_region = tilemap_paint_region,
+  .get_tile_size = tilemap_get_tile_size,
+  .paint_tile = tilemap_paint_tile,
   .destroy = tilemap_destroy,
 };
 
@@ -707,13 +836,26 @@ static bool range_paint_region(struct _openslide_grid *_grid,
       continue;
     }
     prev_tile = tile;
+    if (!_openslide_check_cancel(err)) {
+      goto DONE;
+    }
 
     // draw
     //g_debug("tile x %g y %g", tile->x, tile->y);
     cairo_translate(cr, tile->x - x, tile->y - y);
+    if (_openslide_tissue_skip_tile(grid->base.osr, cr, level,
+                                    grid->base.origin_x + tile->x,
+                                    grid->base.origin_y + tile->y,
+                                    tile->w, tile->h)) {
+      cairo_set_matrix(cr, &matrix);
+      continue;
+    }
+    int claims = _openslide_cache_get_claim_mark();
     bool success = grid->read_tile(grid->base.osr, cr, level,
                                    tile->id, tile->data,
                                    arg, err);
+    _openslide_cache_abandon_claims(claims);
+    _openslide_tissue_tile_done();
     if (success && _openslide_debug(OPENSLIDE_DEBUG_TILES)) {
       char *coordinates = g_strdup_printf("%"PRId64, tile->id);
       label_tile(cr, COLOR_TILE, tile->w, tile->h, coordinates);
@@ -733,6 +875,37 @@ DONE:
   return result;
 }
 
+static bool range_get_tile_size(struct _openslide_grid *_grid,
+                                int64_t col, int64_t row,
+                                int32_t *w, int32_t *h) {
+  struct range_grid *grid = (struct range_grid *) _grid;
+
+  if (col < 0 || (uint64_t) col >= grid->tiles->len || row != 0) {
+    return false;
+  }
+  struct range_tile *tile = grid->tiles->pdata[col];
+  *w = ceil(tile->w);
+  *h = ceil(tile->h);
+  return true;
+}
+
+static bool range_paint_tile(struct _openslide_grid *_grid,
+                             cairo_t *cr,
+                             void *arg,
+                             struct _openslide_level *level,
+                             int64_t col, int64_t row G_GNUC_UNUSED,
+                             GError **err) {
+  struct range_grid *grid = (struct range_grid *) _grid;
+
+  struct range_tile *tile = grid->tiles->pdata[col];
+  int claims = _openslide_cache_get_claim_mark();
+  bool success = grid->read_tile(grid->base.osr, cr, level,
+                                 tile->id, tile->data,
+                                 arg, err);
+  _openslide_cache_abandon_claims(claims);
+  return success;
+}
+
 static void range_destroy(struct _openslide_grid *_grid) {
   struct range_grid *grid = (struct range_grid *) _grid;
 
@@ -756,6 +929,8 @@ static void range_destroy(struct _openslide_grid *_grid) {
 static const struct grid_ops range_grid_ops = {
   .get_bounds = range_get_bounds,
   .paint_region = range_paint_region,
+  .get_tile_size = range_get_tile_size,
+  .paint_tile = range_paint_tile,
   .destroy = range_destroy,
 };
 
@@ -879,6 +1054,12 @@ void _openslide_grid_get_bounds(struct _openslide_grid *grid,
   }
 }
 
+void _openslide_grid_set_origin(struct _openslide_grid *grid,
+                                double x, double y) {
+  grid->origin_x = x;
+  grid->origin_y = y;
+}
+
 bool _openslide_grid_paint_region(struct _openslide_grid *grid,
                                   cairo_t *cr,
                                   void *arg,
@@ -889,6 +1070,113 @@ bool _openslide_grid_paint_region(struct _openslide_grid *grid,
   return grid->ops->paint_region(grid, cr, arg, x, y, level, w, h, err);
 }
 
+// a thread's clear buffer for painting tiles into.  while tiles come
+// from the cache in one piece it is never touched and is reused; once
+// painted, it becomes the pixels of the returned tile.
+struct tile_scratch {
+  uint32_t *data;
+  gsize size;
+};
+
+static GStaticPrivate thread_tile_scratch = G_STATIC_PRIVATE_INIT;
+
+static void tile_scratch_free(void *data) {
+  struct tile_scratch *scratch = data;
+  g_free(scratch->data);
+  g_slice_free(struct tile_scratch, scratch);
+}
+
+static struct tile_scratch *get_tile_scratch(gsize size) {
+  struct tile_scratch *scratch = g_static_private_get(&thread_tile_scratch);
+  if (scratch == NULL) {
+    scratch = g_slice_new0(struct tile_scratch);
+    g_static_private_set(&thread_tile_scratch, scratch, tile_scratch_free);
+  }
+  if (scratch->size < size) {
+    g_free(scratch->data);
+    scratch->data = g_malloc0(size);
+    scratch->size = size;
+  }
+  return scratch;
+}
+
+static cairo_user_data_key_t tile_data_key;
+
+bool _openslide_grid_get_tile(struct _openslide_grid *grid,
+                              void *arg,
+                              struct _openslide_level *level,
+                              int64_t col, int64_t row,
+                              struct _openslide_tile **tile,
+                              GError **err) {
+  *tile = NULL;
+
+  int32_t w, h;
+  if (!grid->ops->get_tile_size(grid, col, row, &w, &h)) {
+    return true;
+  }
+
+  // paint into the scratch buffer.  if the tile comes from the cache in
+  // one piece, the capture keeps the cached tile and the buffer is never
+  // touched.
+  struct tile_scratch *scratch = get_tile_scratch((gsize) w * h * 4);
+  cairo_surface_t *surface =
+    cairo_image_surface_create_for_data((unsigned char *) scratch->data,
+                                        CAIRO_FORMAT_ARGB32,
+                                        w, h, w * 4);
+  cairo_t *cr = cairo_create(surface);
+  cairo_set_operator(cr, CAIRO_OPERATOR_SATURATE);
+  _openslide_cache_capture_begin();
+  bool success = grid->ops->paint_tile(grid, cr, arg, level, col, row, err);
+  cairo_surface_t *kept_surface;
+  struct _openslide_cache_entry *kept =
+    _openslide_cache_capture_end(&kept_surface);
+  if (success) {
+    success = _openslide_check_cairo_status(cr, err);
+  }
+  cairo_destroy(cr);
+
+  if (!success || kept) {
+    cairo_surface_destroy(surface);
+    surface = NULL;
+  }
+
+  // tile labels are drawn straight onto the buffer
+  if (!kept || _openslide_debug(OPENSLIDE_DEBUG_TILES)) {
+    // painted; hand the buffer over to the tile
+    if (surface &&
+        cairo_surface_set_user_data(surface, &tile_data_key,
+                                    scratch->data, g_free)) {
+      cairo_surface_destroy(surface);
+      surface = NULL;
+      g_set_error(err, OPENSLIDE_ERROR, OPENSLIDE_ERROR_FAILED,
+                  "Couldn't attach tile buffer");
+      success = false;
+    }
+    if (surface == NULL) {
+      g_free(scratch->data);
+    }
+    scratch->data = NULL;
+    scratch->size = 0;
+  }
+
+  if (!success) {
+    if (kept) {
+      cairo_surface_destroy(kept_surface);
+      _openslide_cache_entry_unref(kept);
+    }
+    return false;
+  }
+
+  *tile = g_slice_new0(struct _openslide_tile);
+  if (kept) {
+    (*tile)->entry = kept;
+    (*tile)->surface = kept_surface;
+  } else {
+    (*tile)->surface = surface;
+  }
+  return true;
+}
+
 void _openslide_grid_destroy(struct _openslide_grid *grid) {
   if (grid == NULL) {
     return;
@@ -68,7 +68,9 @@ struct _openslide {
   const char **property_names; // filled in automatically from hashtable
 
   // cache
-  struct _openslide_cache *cache;
+  struct _openslide_cache_binding *cache;
+  GPtrArray *cache_planes;  // cacheable planes other than levels
+  GPtrArray *cache_plane_levels;  // level containing each of cache_planes
 
   // error handling, NULL if no error
   gpointer error; // must use g_atomic_pointer!
@@ -76,6 +78,17 @@ struct _openslide {
   // z-level containers
   struct _openslide_zlevel **zlevels;
   int32_t zlevel_count;
+
+  // background decoding of prefetch hints
+  struct _openslide_prefetch *prefetch;
+
+  // memoized result of openslide_get_thumbnail()
+  GMutex *thumbnail_mutex;
+  uint32_t *thumbnail;  // NULL if none
+  int64_t thumbnail_max_dim;
+
+  // tissue masks and background skipping
+  struct _openslide_tissue *tissue;
 };
 
 struct _openslide_level {
@@ -103,9 +116,28 @@ struct _openslide_ops {
 		       struct _openslide_level *level,
 		       int32_t w, int32_t h,
 		       GError **err);
+  // optional; sets *tile to NULL if there is no such tile
+  bool (*get_tile)(openslide_t *osr,
+                   struct _openslide_level *level,
+                   int64_t col, int64_t row,
+                   struct _openslide_tile **tile,
+                   GError **err);
+  // optional; sets *buf to a g_malloc'd stream in the format's own
+  // encoding, or NULL if the tile cannot be passed through
+  bool (*read_raw_tile)(openslide_t *osr,
+                        struct _openslide_level *level,
+                        int64_t col, int64_t row,
+                        void **buf, int32_t *len,
+                        GError **err);
   void (*destroy)(openslide_t *osr);
 };
 
+/* a decoded native tile, returned by openslide_get_tile() */
+struct _openslide_tile {
+  struct _openslide_cache_entry *entry;  // owns the pixels, or NULL
+  cairo_surface_t *surface;  // references the entry's data if it is set
+};
+
 struct _openslide_tifflike;
 
 /* vendor detection and parsing */
@@ -214,6 +246,11 @@ struct _openslide_grid *_openslide_grid_create_simple(openslide_t *osr,
                                                       int32_t tile_h,
                                                       _openslide_grid_simple_read_fn read_tile);
 
+// the cache plane read_tile caches tiles under, if not the level being
+// painted.  tiles must be cached at their column and row.
+void _openslide_grid_simple_set_cache_plane(struct _openslide_grid *grid,
+                                            void *plane);
+
 struct _openslide_grid *_openslide_grid_create_tilemap(openslide_t *osr,
                                                        double tile_advance_x,
                                                        double tile_advance_y,
@@ -243,6 +280,12 @@ void _openslide_grid_get_bounds(struct _openslide_grid *grid,
                                 double *x, double *y,
                                 double *w, double *h);
 
+// where the grid's (0, 0) lies in the level plane, if the vendor paints
+// the grid offset.  tiles that are skipped rather than read are placed
+// by it.
+void _openslide_grid_set_origin(struct _openslide_grid *grid,
+                                double x, double y);
+
 bool _openslide_grid_paint_region(struct _openslide_grid *grid,
                                   cairo_t *cr,
                                   void *arg,
@@ -251,6 +294,15 @@ bool _openslide_grid_paint_region(struct _openslide_grid *grid,
                                   int32_t w, int32_t h,
                                   GError **err);
 
+// decode one tile.  range grid tiles are numbered in the order they were
+// added; row must be 0.  *tile is NULL if there is no such tile.
+bool _openslide_grid_get_tile(struct _openslide_grid *grid,
+                              void *arg,
+                              struct _openslide_level *level,
+                              int64_t col, int64_t row,
+                              struct _openslide_tile **tile,
+                              GError **err);
+
 void _openslide_grid_draw_tile_info(cairo_t *cr, const char *fmt, ...) G_GNUC_PRINTF(2, 3);
 
 void _openslide_grid_destroy(struct _openslide_grid *grid);
@@ -261,40 +313,213 @@ void _openslide_set_bounds_props_from_grid(openslide_t *osr,
                                            struct _openslide_grid *grid);
 
 
+/* Tile buffers */
+// decoded tiles put in the cache must be allocated here; the cache frees
+// them with _openslide_slab_free()
+void *_openslide_slab_alloc(int size);
+void _openslide_slab_free(int size, void *buf);
+
+// memory mapped for tile buffers, including free slots
+int64_t _openslide_slab_get_arena_bytes(void);
+
+
 /* Cache */
 #define _OPENSLIDE_USEFUL_CACHE_SIZE 1024*1024*32
 
+struct _openslide_diskcache;
+
 struct _openslide_cache_entry;
 
-// constructor/destructor
-struct _openslide_cache *_openslide_cache_create(int capacity_in_bytes);
+// constructor/refcounting
+struct _openslide_cache *_openslide_cache_create(int64_t capacity_in_bytes,
+                                                 enum openslide_cache_policy policy);
+
+struct _openslide_cache *_openslide_cache_ref(struct _openslide_cache *cache);
 
-void _openslide_cache_destroy(struct _openslide_cache *cache);
+void _openslide_cache_unref(struct _openslide_cache *cache);
 
 // cache size
-int _openslide_cache_get_capacity(struct _openslide_cache *cache);
+int64_t _openslide_cache_get_capacity(struct _openslide_cache *cache);
 
 void _openslide_cache_set_capacity(struct _openslide_cache *cache,
-				   int capacity_in_bytes);
+				   int64_t capacity_in_bytes);
+
+// compressed tier; disabled at zero capacity
+int64_t _openslide_cache_get_compressed_capacity(struct _openslide_cache *cache);
+
+void _openslide_cache_set_compressed_capacity(struct _openslide_cache *cache,
+                                              int64_t capacity_in_bytes);
+
+// binding of an openslide_t to a (possibly shared) cache.  entries are
+// keyed by slide_id, so handles with the same slide_id share tiles.
+// slide_id should be the quickhash1, or NULL if there is none.
+struct _openslide_cache_binding *_openslide_cache_binding_create(openslide_t *osr,
+                                                                 const char *slide_id,
+                                                                 struct _openslide_cache *cache);
+
+void _openslide_cache_binding_destroy(struct _openslide_cache_binding *cb);
+
+void _openslide_cache_binding_set(struct _openslide_cache_binding *cb,
+                                  struct _openslide_cache *cache);
+
+// tiles are cached by level.  vendors which pass other coordinate planes
+// to the cache must register them during open, in an order that is the
+// same every time the slide is opened.  level is the level the plane
+// belongs to, for statistics.
+void _openslide_cache_add_plane(openslide_t *osr,
+                                struct _openslide_level *level,
+                                void *plane);
+
+// statistics for the bound cache, and for one level of this binding
+void _openslide_cache_binding_get_stats(struct _openslide_cache_binding *cb,
+                                        openslide_cache_stats_t *stats);
+
+void _openslide_cache_binding_get_level_stats(struct _openslide_cache_binding *cb,
+                                              int32_t level,
+                                              openslide_cache_stats_t *stats);
 
 // put and get
-void _openslide_cache_put(struct _openslide_cache *cache,
-			  void *plane,  // coordinate plane (level or grid)
+void _openslide_cache_put(struct _openslide_cache_binding *cb,
+			  void *plane,  // coordinate plane (level)
 			  int64_t x,
 			  int64_t y,
 			  void *data,
 			  int size_in_bytes,
 			  struct _openslide_cache_entry **entry);
 
-void *_openslide_cache_get(struct _openslide_cache *cache,
+// put a tile whose pixels are all color, without producing it.  returns
+// the tile's pixels, which are shared with other tiles and must not be
+// modified.
+void *_openslide_cache_put_solid(struct _openslide_cache_binding *cb,
+                                 void *plane,
+                                 int64_t x,
+                                 int64_t y,
+                                 uint32_t color,
+                                 int size_in_bytes,
+                                 struct _openslide_cache_entry **entry);
+
+// on a miss, the caller is expected to produce the tile and put it, and
+// concurrent readers of the tile wait for it.  size_in_bytes is the size
+// the caller expects the tile to have.
+void *_openslide_cache_get(struct _openslide_cache_binding *cb,
 			   void *plane,
 			   int64_t x,
 			   int64_t y,
+			   int size_in_bytes,
 			   struct _openslide_cache_entry **entry);
 
+// whether a decoded tile is in memory, in the cache or the current
+// thread's batch, without getting it
+bool _openslide_cache_contains(struct _openslide_cache_binding *cb,
+                               void *plane,
+                               int64_t x,
+                               int64_t y);
+
+// whether an entry is a shared tile of a single color, and if so which
+bool _openslide_cache_entry_get_solid_color(struct _openslide_cache_entry *entry,
+                                            uint32_t *color);
+
+// release waiters for tiles this thread missed on but did not put.
+// called after each tile read, with the mark taken before it, so that
+// only the claims taken by that read are released.
+int _openslide_cache_get_claim_mark(void);
+void _openslide_cache_abandon_claims(int mark);
+
+// zero-copy tile reads.  between begin and end, a cached tile painted by
+// this thread so as to exactly cover an untouched destination is kept
+// rather than painted.  end returns a reference to the kept entry, or
+// NULL if the destination was painted instead.
+void _openslide_cache_capture_begin(void);
+struct _openslide_cache_entry *_openslide_cache_capture_end(cairo_surface_t **surface);
+
+// called by _openslide_cairo_paint_surface().  keep returns true if the
+// surface was kept and must not be painted.  unkeep returns the kept
+// surface, if any, which must now be painted underneath; either way,
+// nothing more is kept.
+bool _openslide_cache_capture_keep(cairo_surface_t *surface);
+cairo_surface_t *_openslide_cache_capture_unkeep(void);
+
+// batched reads.  decoded tiles a thread gets or puts while it has
+// entered a batch are retained by the batch until they age out or it is
+// destroyed, and are found there first.
+struct _openslide_cache_batch;
+struct _openslide_cache_batch *_openslide_cache_batch_create(void);
+void _openslide_cache_batch_destroy(struct _openslide_cache_batch *batch);
+void _openslide_cache_batch_enter(struct _openslide_cache_batch *batch);
+void _openslide_cache_batch_leave(void);
+struct _openslide_cache_batch *_openslide_cache_batch_get_current(void);
+int64_t _openslide_cache_batch_get_size(struct _openslide_cache_batch *batch);
+// drop tiles not used since the last call
+void _openslide_cache_batch_age(struct _openslide_cache_batch *batch);
+
+// compressed tile bytes, keyed like decoded tiles.  both copy the data;
+// get returns a g_malloc'd buffer or NULL.  cb may be NULL.
+void _openslide_cache_put_compressed(struct _openslide_cache_binding *cb,
+                                     void *plane,
+                                     int64_t x,
+                                     int64_t y,
+                                     const void *data,
+                                     int size_in_bytes);
+
+void *_openslide_cache_get_compressed(struct _openslide_cache_binding *cb,
+                                      void *plane,
+                                      int64_t x,
+                                      int64_t y,
+                                      int *size_in_bytes);
+
 // value unref
 void _openslide_cache_entry_unref(struct _openslide_cache_entry *entry);
 
+// persistent tier; tiles are keyed by slide_id, plane index, and position
+struct _openslide_diskcache *_openslide_diskcache_create(const char *dirname,
+                                                         int64_t capacity,
+                                                         GError **err);
+
+void _openslide_diskcache_destroy(struct _openslide_diskcache *dc);
+
+// returns a buffer of size_in_bytes from _openslide_slab_alloc(), or NULL.
+// an entry of any other size is discarded.
+void *_openslide_diskcache_get(struct _openslide_diskcache *dc,
+                               const char *slide_id,
+                               int32_t plane,
+                               int64_t x, int64_t y,
+                               int size_in_bytes);
+
+// writes asynchronously.  takes ownership of a reference to entry, which
+// must keep data alive.
+void _openslide_diskcache_put(struct _openslide_diskcache *dc,
+                              const char *slide_id,
+                              int32_t plane,
+                              int64_t x, int64_t y,
+                              void *data, int size_in_bytes,
+                              struct _openslide_cache_entry *entry);
+
+// shared-memory tier, keyed like the persistent tier.  the segment is
+// created if it doesn't exist, and is used as it is if it does.
+struct _openslide_shmcache;
+struct _openslide_shmcache *_openslide_shmcache_create(const char *name,
+                                                       int64_t capacity,
+                                                       GError **err);
+
+void _openslide_shmcache_destroy(struct _openslide_shmcache *sc);
+
+// returns a buffer of size_in_bytes from _openslide_slab_alloc(), or
+// NULL.  a record of any other size is discarded.
+void *_openslide_shmcache_get(struct _openslide_shmcache *sc,
+                              const char *slide_id,
+                              int32_t plane,
+                              int64_t x, int64_t y,
+                              int size_in_bytes);
+
+// copies the data before returning
+void _openslide_shmcache_put(struct _openslide_shmcache *sc,
+                             const char *slide_id,
+                             int32_t plane,
+                             int64_t x, int64_t y,
+                             const void *data, int size_in_bytes);
+
+bool _openslide_shmcache_remove(const char *name, GError **err);
+
 
 /* Internal error propagation */
 enum OpenSlideError {
@@ -304,6 +529,8 @@ enum OpenSlideError {
   OPENSLIDE_ERROR_CAIRO_ERROR,
   // no such value (e.g. for tifflike accessors)
   OPENSLIDE_ERROR_NO_VALUE,
+  // read cancelled by openslide_cancel()
+  OPENSLIDE_ERROR_CANCELLED,
 };
 #define OPENSLIDE_ERROR _openslide_error_quark()
 GQuark _openslide_error_quark(void);
@@ -312,8 +539,210 @@ void _openslide_io_error(GError **err, const char *fmt, ...) G_GNUC_PRINTF(2, 3)
 
 bool _openslide_check_cairo_status(cairo_t *cr, GError **err);
 
+/* Compositing */
+
+// premultiplied ARGB32 SATURATE; strides in bytes.  if src_opaque, the
+// source alpha channel is ignored, as for CAIRO_FORMAT_RGB24.
+void _openslide_composite_saturate(uint32_t *dst, int dst_stride,
+                                   const uint32_t *src, int src_stride,
+                                   int32_t w, int32_t h,
+                                   bool src_opaque);
+
+// paint an image surface at the current origin using the current
+// operator.  tiles painted into an image surface at integer offsets
+// bypass cairo.
+void _openslide_cairo_paint_surface(cairo_t *cr, cairo_surface_t *surface);
+
+// mark a surface wrapping the pixels of a cache entry with the entry's
+// color, if it is a solid tile, so that painting the surface is a fill
+void _openslide_cairo_mark_solid(cairo_surface_t *surface,
+                                 struct _openslide_cache_entry *entry);
+
+// bytes per pixel, or 0 if the format is unknown
+int32_t _openslide_pixel_format_get_bytes(enum openslide_pixel_format format);
+
+// check the format, and fill in a zero stride
+bool _openslide_pixel_format_check_stride(enum openslide_pixel_format format,
+                                          int64_t w, int64_t *stride,
+                                          GError **err);
+
+// clear w pixels of each of h rows
+void _openslide_clear_pixels(void *dest, enum openslide_pixel_format format,
+                             int64_t stride, int64_t w, int64_t h);
+
+// convert premultiplied ARGB32 pixels to format; strides in bytes.  dst
+// may be src, with the same stride.
+void _openslide_convert_pixels(void *dst, int64_t dst_stride,
+                               enum openslide_pixel_format format,
+                               const uint32_t *src, int src_stride,
+                               int32_t w, int32_t h);
+
+/* Region reads */
+// read a region of a level into dest, which must be clear, in the given
+// format and with a checked stride.  l may be NULL for a nonexistent
+// level, which reads nothing.
+bool _openslide_read_level_region(openslide_t *osr,
+                                  void *dest,
+                                  enum openslide_pixel_format format,
+                                  int64_t stride,
+                                  int64_t x, int64_t y,
+                                  struct _openslide_level *l,
+                                  int64_t w, int64_t h,
+                                  GError **err);
+
+// the same, with the region's origin at level-plane coordinates (x, y)
+bool _openslide_read_level_plane_region(openslide_t *osr,
+                                        void *dest,
+                                        enum openslide_pixel_format format,
+                                        int64_t stride,
+                                        int64_t x, int64_t y,
+                                        struct _openslide_level *l,
+                                        int64_t w, int64_t h,
+                                        GError **err);
+
+// read a region of w x h level 0 pixels from level l, scaled to
+// dest_w x dest_h, into dest
+bool _openslide_read_level_region_scaled(openslide_t *osr,
+                                         uint32_t *dest,
+                                         int64_t x, int64_t y,
+                                         struct _openslide_level *l,
+                                         int64_t w, int64_t h,
+                                         int64_t dest_w, int64_t dest_h,
+                                         GError **err);
+
+// scale a whole premultiplied ARGB image to dest_w x dest_h
+void _openslide_resample_image(uint32_t *dest,
+                               int64_t dest_w, int64_t dest_h,
+                               const uint32_t *src,
+                               int64_t src_w, int64_t src_h);
+
+/* Tissue detection */
+struct _openslide_tissue *_openslide_tissue_create(void);
+void _openslide_tissue_destroy(struct _openslide_tissue *tissue);
+
+// computed from the smallest level of the z-level on first use; owned by
+// osr.  cells are 255 for tissue and 0 for background.
+const uint8_t *_openslide_tissue_get_mask(openslide_t *osr, int32_t zlevel,
+                                          int64_t *w, int64_t *h,
+                                          GError **err);
+
+// background skipping.  a read gets the mask of the first z-level, NULL
+// if it can't be computed, before it starts, and then enters it on each
+// thread reading for it.  entering NULL skips nothing.
+struct _openslide_tissue_mask;
+struct _openslide_tissue_mask *_openslide_tissue_get_skip_mask(openslide_t *osr);
+void _openslide_tissue_skip_enter(struct _openslide_tissue_mask *mask);
+void _openslide_tissue_skip_leave(void);
+struct _openslide_tissue_mask *_openslide_tissue_skip_get_current(void);
+
+// grids call this before painting a tile at (x, y) in the level plane,
+// with cr translated to the tile.  if the current thread is skipping
+// background and there is no tissue near the tile, paints the background
+// color over w x h and returns true.  otherwise the tile is read, and the
+// grid must call _openslide_tissue_tile_done() afterward; tiles are never
+// skipped while another tile is being read.
+bool _openslide_tissue_skip_tile(openslide_t *osr, cairo_t *cr,
+                                 struct _openslide_level *level,
+                                 double x, double y, double w, double h);
+void _openslide_tissue_tile_done(void);
+
+// tiles skipped so far by reads of the handle
+uint64_t _openslide_tissue_get_skipped(struct _openslide_tissue *tissue);
+
+/* Parallel decoding */
+void _openslide_workers_set_count(int32_t count);
+int32_t _openslide_workers_get_count(void);
+
+// whether the calling thread belongs to the shared pool.  work started
+// from a pool thread runs serially on that thread.
+bool _openslide_workers_is_worker(void);
+
+// run a job on the shared pool.  background jobs wait for all queued
+// foreground jobs.
+void _openslide_workers_submit(void (*run)(void *data), void *data,
+                               bool background);
+
+// call run(data) on the calling thread and on up to count - 1 pool
+// threads at once, and return when all calls have returned.  run must
+// share out the work itself.
+void _openslide_workers_run(void (*run)(void *data), void *data,
+                            int32_t count);
+
+// paint a region through the vendor's paint_region, decoding its tiles
+// on worker threads first if there are any.  a large region is decoded
+// and painted in bands of tile rows, so that the tiles retained for
+// painting stay bounded.  prefetching for the slide is paused meanwhile.
+bool _openslide_workers_paint_region(openslide_t *osr,
+                                     cairo_t *cr,
+                                     int64_t x, int64_t y,
+                                     struct _openslide_level *level,
+                                     int64_t w, int64_t h,
+                                     GError **err);
+
+/* Prefetching */
+struct _openslide_prefetch *_openslide_prefetch_create(void);
+
+// queue the tiles of a region for background decoding into the cache.
+// returns an id for _openslide_prefetch_cancel().
+int _openslide_prefetch_add(openslide_t *osr,
+                            struct _openslide_level *level,
+                            int64_t x, int64_t y,
+                            int64_t w, int64_t h);
+void _openslide_prefetch_cancel(openslide_t *osr, int id);
+
+// cancels outstanding hints and waits for the prefetcher to stop
+void _openslide_prefetch_destroy(struct _openslide_prefetch *pf);
+
+/* Cancellation */
+// while a thread has entered a flag, grids stop painting once it is set
+void _openslide_cancel_enter(volatile gint *cancelled);
+void _openslide_cancel_leave(void);
+volatile gint *_openslide_cancel_get_current(void);
+
+// returns false and sets err if the current thread's read is cancelled
+bool _openslide_check_cancel(GError **err);
+
+/* Deadlines */
+struct _openslide_deadline *_openslide_deadline_create(int64_t time_limit_ms);
+void _openslide_deadline_destroy(struct _openslide_deadline *deadline);
+
+// while a thread has entered a deadline, simple grids stop decoding tiles
+// once there is no time left.  if fallback is set, skipped tiles are
+// painted from coarser levels and recorded as provisional; otherwise they
+// are left unpainted.  deadline may be NULL.
+void _openslide_deadline_enter(struct _openslide_deadline *deadline,
+                               bool fallback);
+void _openslide_deadline_leave(void);
+struct _openslide_deadline *_openslide_deadline_get_current(void);
+
+// set aside the current thread's deadline, if any, to read something in
+// full, and then put it back as it was
+void *_openslide_deadline_suspend(void);
+void _openslide_deadline_resume(void *saved);
+
+// simple grids call this before reading the tile at (col, row), cached
+// under plane, with cr translated to the tile, which covers w x h at
+// (x, y) in the level plane.  returns true if the tile was skipped.
+// otherwise the grid reads the tile and then calls
+// _openslide_deadline_tile_done().
+bool _openslide_deadline_skip_tile(openslide_t *osr, cairo_t *cr,
+                                   void *plane,
+                                   struct _openslide_level *level,
+                                   int64_t col, int64_t row,
+                                   double x, double y, double w, double h);
+void _openslide_deadline_tile_done(void);
+
+// set the bytes of mask, w x h with its origin at (x, y) in the level
+// plane of the read, that are covered by provisional tiles to 255.  mask
+// may be NULL.  returns whether any are.
+bool _openslide_deadline_mark_provisional(struct _openslide_deadline *deadline,
+                                          uint8_t *mask,
+                                          double x, double y,
+                                          int64_t w, int64_t h);
+
 /* Debug flags */
 enum _openslide_debug_flag {
+  OPENSLIDE_DEBUG_CACHE,
   OPENSLIDE_DEBUG_DETECTION,
   OPENSLIDE_DEBUG_JPEG_MARKERS,
   OPENSLIDE_DEBUG_PERFORMANCE,
@@ -350,19 +779,6 @@ extern const int32_t _openslide_G_Cb[256];
 extern const int32_t _openslide_G_Cr[256];
 extern const int16_t _openslide_B_Cb[256];
 
-// deprecated prefetch stuff (maybe we'll undeprecate it someday),
-// still needs these declarations for ABI compat
-// TODO: remove if soname bump
-#undef openslide_give_prefetch_hint
-OPENSLIDE_PUBLIC()
-int openslide_give_prefetch_hint(openslide_t *osr,
-				 int64_t x, int64_t y,
-				 int32_t level,
-				 int64_t w, int64_t h);
-#undef openslide_cancel_prefetch_hint
-OPENSLIDE_PUBLIC()
-void openslide_cancel_prefetch_hint(openslide_t *osr, int prefetch_id);
-
 /* Prevent use of dangerous functions and functions with mandatory wrappers.
    Every @p replacement must be unique to avoid conflicting-type errors. */
 #define _OPENSLIDE_POISON(replacement) error__use_ ## replacement ## _instead
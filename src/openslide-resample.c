@@ -0,0 +1,303 @@
+/*
+ *  OpenSlide, a library for reading whole slide image files
+ *
+ *  Copyright (c) 2026 OpenSlide contributors
+ *  All rights reserved.
+ *
+ *  OpenSlide is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, version 2.1.
+ *
+ *  OpenSlide is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with OpenSlide. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Area resampling.
+ *
+ * A scaled read is a box filter over the source level: each destination
+ * pixel is the average of the source pixels it covers, weighted by the
+ * fraction of each that it covers.  The filter is separable.  Source
+ * rows are read a band at a time, each row is reduced horizontally as
+ * soon as it is read, and reduced rows are accumulated into the few
+ * destination rows they contribute to, which are written out as soon as
+ * they are complete.  So besides the destination, memory use is one band
+ * of source rows plus a handful of destination rows.  Averaging is done
+ * on premultiplied pixels, so transparent areas don't darken their
+ * neighbors.
+ *
+ * The source is usually a level of the slide, but may be an image
+ * already in memory, such as an associated image.
+ */
+
+#include <config.h>
+
+#include "openslide-private.h"
+
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// band height for levels without tile geometry
+#define DEFAULT_BAND_HEIGHT 256
+
+// the source pixels covering each destination pixel along one axis
+struct axis {
+  int64_t *first;  // first source pixel
+  int32_t *count;  // number of source pixels
+  float *weights;  // max_count per destination pixel, summing to 1
+  int32_t max_count;
+};
+
+// destination pixel i covers [start + i * scale, start + (i + 1) * scale)
+// in the source
+static void axis_init(struct axis *axis, double start, double scale,
+                      int64_t n) {
+  axis->max_count = (int32_t) ceil(scale) + 1;
+  axis->first = g_new(int64_t, n);
+  axis->count = g_new(int32_t, n);
+  axis->weights = g_new0(float, n * axis->max_count);
+  for (int64_t i = 0; i < n; i++) {
+    double s = start + i * scale;
+    double e = s + scale;
+    int64_t first = floor(s);
+    int64_t last = MAX((int64_t) ceil(e) - 1, first);
+    axis->first[i] = first;
+    axis->count[i] = MIN(last - first + 1, axis->max_count);
+    for (int32_t k = 0; k < axis->count[i]; k++) {
+      double coverage = MIN(e, first + k + 1) - MAX(s, first + k);
+      axis->weights[i * axis->max_count + k] = MAX(coverage, 0) / scale;
+    }
+  }
+}
+
+static void axis_destroy(struct axis *axis) {
+  g_free(axis->first);
+  g_free(axis->count);
+  g_free(axis->weights);
+}
+
+// one past the last source pixel used
+static int64_t axis_get_extent(const struct axis *axis, int64_t n) {
+  return axis->first[n - 1] + axis->count[n - 1];
+}
+
+// reduce a source row to n destination pixels of four float channels,
+// in the order of the bytes of a native-endian pixel
+static void reduce_row(float *dst, const uint32_t *src,
+                       const struct axis *axis, int64_t n) {
+  for (int64_t i = 0; i < n; i++) {
+    const uint32_t *p = src + axis->first[i];
+    const float *weights = axis->weights + i * axis->max_count;
+    int32_t count = axis->count[i];
+#if defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+    __m128 sum = _mm_setzero_ps();
+    for (int32_t k = 0; k < count; k++) {
+      __m128i px = _mm_cvtsi32_si128((int) p[k]);
+      px = _mm_unpacklo_epi16(_mm_unpacklo_epi8(px, zero), zero);
+      sum = _mm_add_ps(sum, _mm_mul_ps(_mm_cvtepi32_ps(px),
+                                       _mm_set1_ps(weights[k])));
+    }
+    _mm_storeu_ps(dst + i * 4, sum);
+#else
+    float sum[4] = {0, 0, 0, 0};
+    for (int32_t k = 0; k < count; k++) {
+      for (int c = 0; c < 4; c++) {
+        sum[c] += weights[k] * ((p[k] >> (c * 8)) & 0xff);
+      }
+    }
+    memcpy(dst + i * 4, sum, sizeof(sum));
+#endif
+  }
+}
+
+// dst += weight * src, for n floats
+static void accumulate_row(float *dst, const float *src, float weight,
+                           int64_t n) {
+  int64_t i = 0;
+#if defined(__SSE2__)
+  __m128 w = _mm_set1_ps(weight);
+  for (; i + 4 <= n; i += 4) {
+    __m128 d = _mm_loadu_ps(dst + i);
+    d = _mm_add_ps(d, _mm_mul_ps(_mm_loadu_ps(src + i), w));
+    _mm_storeu_ps(dst + i, d);
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] += weight * src[i];
+  }
+}
+
+static inline uint32_t round_channel(float v, uint32_t max) {
+  if (v <= 0) {
+    return 0;
+  }
+  uint32_t c = v + 0.5f;
+  return MIN(c, max);
+}
+
+static void store_row(uint32_t *dst, const float *src, int64_t n) {
+  for (int64_t i = 0; i < n; i++) {
+    const float *p = src + i * 4;
+    // keep the pixel premultiplied despite rounding
+    uint32_t a = round_channel(p[3], 255);
+    dst[i] = a << 24 |
+             round_channel(p[2], a) << 16 |
+             round_channel(p[1], a) << 8 |
+             round_channel(p[0], a);
+  }
+}
+
+// reads rows of the source, w pixels wide, into dest
+typedef bool (*read_rows_fn)(void *arg, uint32_t *dest,
+                             int64_t row, int64_t rows, int64_t w,
+                             GError **err);
+
+// scale the source rectangle [x, x + w) x [y, y + h), in source pixels,
+// to dest_w x dest_h.  the source is read band_h rows at a time starting
+// from floor(y), and columns start from floor(x).
+static bool resample(uint32_t *dest, int64_t dest_w, int64_t dest_h,
+                     double x, double y, double w, double h,
+                     int64_t band_h, read_rows_fn read_rows, void *arg,
+                     GError **err) {
+  struct axis ax;
+  struct axis ay;
+  axis_init(&ax, x - floor(x), w / dest_w, dest_w);
+  axis_init(&ay, y - floor(y), h / dest_h, dest_h);
+  int64_t src_w = axis_get_extent(&ax, dest_w);
+  int64_t src_h = axis_get_extent(&ay, dest_h);
+
+  // a source row contributes to at most this many destination rows
+  int64_t acc_rows = MIN((int64_t) ceil(dest_h / h) + 2, dest_h);
+  band_h = MIN(band_h, src_h);
+  uint32_t *band = g_new(uint32_t, src_w * band_h);
+  float *reduced = g_new(float, dest_w * 4);
+  float *acc = g_new(float, acc_rows * dest_w * 4);
+
+  bool success = true;
+  int64_t band_start = 0;
+  int64_t band_end = 0;
+  int64_t started = 0;  // destination rows with accumulators
+  int64_t finished = 0;  // destination rows written
+  for (int64_t row = 0; row < src_h; row++) {
+    if (row >= band_end) {
+      int64_t rows = MIN(band_h, src_h - row);
+      memset(band, 0, src_w * rows * 4);
+      if (!read_rows(arg, band, row, rows, src_w, err)) {
+        success = false;
+        break;
+      }
+      band_start = row;
+      band_end = row + rows;
+    }
+    reduce_row(reduced, band + (row - band_start) * src_w, &ax, dest_w);
+
+    // add to the destination rows covering this one
+    for (int64_t i = finished; i < dest_h && ay.first[i] <= row; i++) {
+      float *acc_row = acc + (i % acc_rows) * dest_w * 4;
+      if (i >= started) {
+        memset(acc_row, 0, dest_w * 4 * sizeof(float));
+        started = i + 1;
+      }
+      float weight = ay.weights[i * ay.max_count + (row - ay.first[i])];
+      accumulate_row(acc_row, reduced, weight, dest_w * 4);
+    }
+
+    // write out those that are complete
+    while (finished < dest_h &&
+           ay.first[finished] + ay.count[finished] <= row + 1) {
+      store_row(dest + finished * dest_w,
+                acc + (finished % acc_rows) * dest_w * 4, dest_w);
+      finished++;
+    }
+  }
+
+  g_free(acc);
+  g_free(reduced);
+  g_free(band);
+  axis_destroy(&ay);
+  axis_destroy(&ax);
+  return success;
+}
+
+struct level_source {
+  openslide_t *osr;
+  struct _openslide_level *level;
+  int64_t x;  // level plane
+  int64_t y;
+};
+
+static bool read_level_rows(void *arg, uint32_t *dest,
+                            int64_t row, int64_t rows, int64_t w,
+                            GError **err) {
+  struct level_source *src = arg;
+  return _openslide_read_level_plane_region(src->osr, dest,
+                                            OPENSLIDE_PIXEL_FORMAT_ARGB32_PREMULTIPLIED,
+                                            w * 4, src->x, src->y + row,
+                                            src->level, w, rows, err);
+}
+
+bool _openslide_read_level_region_scaled(openslide_t *osr,
+                                         uint32_t *dest,
+                                         int64_t x, int64_t y,
+                                         struct _openslide_level *l,
+                                         int64_t w, int64_t h,
+                                         int64_t dest_w, int64_t dest_h,
+                                         GError **err) {
+  // source rectangle in the level plane, starting at a whole pixel
+  double ds = l->downsample;
+  double lx = x / ds;
+  double ly = y / ds;
+  struct level_source src = {
+    .osr = osr,
+    .level = l,
+    .x = floor(lx),
+    .y = floor(ly),
+  };
+  int64_t band_h = l->tile_h > 0 ? l->tile_h : DEFAULT_BAND_HEIGHT;
+  return resample(dest, dest_w, dest_h, lx, ly, w / ds, h / ds,
+                  band_h, read_level_rows, &src, err);
+}
+
+struct image_source {
+  const uint32_t *data;
+  int64_t w;
+  int64_t h;
+};
+
+static bool read_image_rows(void *arg, uint32_t *dest,
+                            int64_t row, int64_t rows, int64_t w,
+                            GError **err G_GNUC_UNUSED) {
+  struct image_source *src = arg;
+  // rows or columns past the edge of the image stay clear
+  int64_t copy_w = MIN(w, src->w);
+  for (int64_t i = 0; i < rows && row + i < src->h; i++) {
+    memcpy(dest + i * w, src->data + (row + i) * src->w, copy_w * 4);
+  }
+  return true;
+}
+
+void _openslide_resample_image(uint32_t *dest,
+                               int64_t dest_w, int64_t dest_h,
+                               const uint32_t *src,
+                               int64_t src_w, int64_t src_h) {
+  struct image_source source = {
+    .data = src,
+    .w = src_w,
+    .h = src_h,
+  };
+  resample(dest, dest_w, dest_h, 0, 0, src_w, src_h,
+           DEFAULT_BAND_HEIGHT, read_image_rows, &source, NULL);
+}
@@ -0,0 +1,515 @@
+/*
+ *  OpenSlide, a library for reading whole slide image files
+ *
+ *  Copyright (c) 2026 OpenSlide contributors
+ *  All rights reserved.
+ *
+ *  OpenSlide is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, version 2.1.
+ *
+ *  OpenSlide is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with OpenSlide. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Shared-memory decoded-tile cache.
+ *
+ * A named POSIX shared memory segment holds a header, an index, and a
+ * log of tile records.  Records are appended at the head of the log,
+ * which wraps around, overwriting the oldest records; so eviction is
+ * FIFO, and needs no bookkeeping.  The index is a hash table of slots,
+ * each naming the log position of a record, probed a few slots deep.
+ *
+ * A process-shared robust mutex protects the index and the head, but is
+ * not held while pixels are copied.  A writer reserves space by
+ * advancing the head, copies its record in, and then publishes it in
+ * the index.  A reader copies a record out and then checks that the head
+ * has not since advanced far enough to overwrite it.  Records carry
+ * their key and a checksum, so a slot left stale by a process that died
+ * holding the mutex is detected when it is read.
+ *
+ * The first process to open a segment creates and sizes it; later ones
+ * use it as it is, if its magic matches.  Segments outlive the processes
+ * using them until they are removed.  The magic versions the layout and
+ * the key scheme, including the numbering of planes, so it must change
+ * when either does.
+ */
+
+#include <config.h>
+
+#include "openslide-private.h"
+
+#include <string.h>
+#include <errno.h>
+#include <glib.h>
+
+#if defined(HAVE_SHM_OPEN) && defined(HAVE_PTHREAD_MUTEXATTR_SETROBUST) && defined(HAVE_MMAP)
+#define USE_SHM 1
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define SHM_MAGIC "OSSHM002"
+#define SHM_ALIGN 64
+
+// one index slot per this many bytes of log
+#define SHM_BYTES_PER_SLOT (32 * 1024)
+#define SHM_MIN_SLOTS 1024
+// slots probed for a key
+#define SHM_PROBES 8
+// records longer than this fraction of the log are not stored
+#define SHM_MAX_RECORD_FRACTION 4
+// how long to wait for another process to initialize a new segment
+#define SHM_INIT_TIMEOUT_USEC (5 * G_USEC_PER_SEC)
+#define SHM_INIT_POLL_USEC 1000
+
+#ifdef USE_SHM
+
+struct shm_key {
+  uint64_t slide;  // hash of the slide_id
+  int64_t x;
+  int64_t y;
+  int32_t plane;
+  int32_t reserved;
+};
+
+struct shm_slot {
+  struct shm_key key;
+  int64_t pos;  // logical position of the record in the log
+  int32_t size;  // of the pixels, or 0 if the slot is empty
+  int32_t reserved;
+};
+
+// followed by the pixels, from the next SHM_ALIGN boundary
+struct shm_record {
+  struct shm_key key;
+  int32_t size;
+  uint32_t reserved;
+  uint64_t checksum;
+};
+G_STATIC_ASSERT(sizeof(struct shm_record) <= SHM_ALIGN);
+
+struct shm_header {
+  char magic[8];
+  volatile gint ready;  // set once the creator is done
+  int32_t reserved;
+  int64_t size;  // of the segment
+  int64_t slot_count;
+  int64_t log_offset;
+  int64_t log_size;
+
+  pthread_mutex_t mutex;
+  // protected by mutex
+  int64_t head;  // logical position of the next record
+};
+
+struct _openslide_shmcache {
+  struct shm_header *header;
+  struct shm_slot *slots;
+  uint8_t *log;
+};
+
+static int64_t align(int64_t n) {
+  return (n + SHM_ALIGN - 1) / SHM_ALIGN * SHM_ALIGN;
+}
+
+// FNV-1a
+static uint64_t hash_slide_id(const char *slide_id) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (const char *p = slide_id; *p; p++) {
+    hash ^= (uint8_t) *p;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static void make_key(struct shm_key *key, const char *slide_id,
+                     int32_t plane, int64_t x, int64_t y) {
+  memset(key, 0, sizeof(*key));
+  key->slide = hash_slide_id(slide_id);
+  key->plane = plane;
+  key->x = x;
+  key->y = y;
+}
+
+static bool key_equal(const struct shm_key *a, const struct shm_key *b) {
+  return a->slide == b->slide && a->plane == b->plane &&
+         a->x == b->x && a->y == b->y;
+}
+
+static uint64_t key_hash(const struct shm_key *key) {
+  uint64_t hash = key->slide ^ ((uint64_t) key->plane << 56);
+  hash ^= (uint64_t) key->x * 0x9e3779b97f4a7c15ULL;
+  hash ^= (uint64_t) key->y * 0xc2b2ae3d27d4eb4fULL;
+  return hash ^ (hash >> 29);
+}
+
+// cheap enough to run on every read
+static uint64_t checksum(const void *data, int size) {
+  const uint32_t *p = data;
+  uint64_t a = 1;
+  uint64_t b = 0;
+  for (int i = 0; i < size / 4; i++) {
+    a += p[i];
+    b += a;
+  }
+  return (b << 32) ^ a;
+}
+
+// returns false, without the lock, if it can't be taken; callers then
+// skip the shared tier
+static bool shm_lock(struct shm_header *header) {
+  int ret = pthread_mutex_lock(&header->mutex);
+  if (ret == EOWNERDEAD) {
+    // a process died holding the lock.  slots are checked against their
+    // records when read, so there is nothing to repair.
+    if (pthread_mutex_consistent(&header->mutex)) {
+      pthread_mutex_unlock(&header->mutex);
+      return false;
+    }
+    return true;
+  }
+  return ret == 0;
+}
+
+static void shm_unlock(struct shm_header *header) {
+  pthread_mutex_unlock(&header->mutex);
+}
+
+// whether the record at pos has not been overwritten.  mutex must be held.
+static bool is_intact(struct shm_header *header, int64_t pos) {
+  return header->head <= pos + header->log_size;
+}
+
+// mutex must be held
+static struct shm_slot *find_slot(struct _openslide_shmcache *sc,
+                                  const struct shm_key *key) {
+  uint64_t hash = key_hash(key);
+  for (int i = 0; i < SHM_PROBES; i++) {
+    struct shm_slot *slot =
+      &sc->slots[(hash + i) % (uint64_t) sc->header->slot_count];
+    if (slot->size && key_equal(&slot->key, key) &&
+        is_intact(sc->header, slot->pos)) {
+      return slot;
+    }
+  }
+  return NULL;
+}
+
+// the slot to publish a record in: an empty or stale one if possible,
+// else the one naming the oldest record.  mutex must be held.
+static struct shm_slot *choose_slot(struct _openslide_shmcache *sc,
+                                    const struct shm_key *key) {
+  uint64_t hash = key_hash(key);
+  struct shm_slot *oldest = NULL;
+  for (int i = 0; i < SHM_PROBES; i++) {
+    struct shm_slot *slot =
+      &sc->slots[(hash + i) % (uint64_t) sc->header->slot_count];
+    if (slot->size == 0 || key_equal(&slot->key, key) ||
+        !is_intact(sc->header, slot->pos)) {
+      return slot;
+    }
+    if (oldest == NULL || slot->pos < oldest->pos) {
+      oldest = slot;
+    }
+  }
+  return oldest;
+}
+
+static bool init_mutex(pthread_mutex_t *mutex) {
+  pthread_mutexattr_t attr;
+  if (pthread_mutexattr_init(&attr)) {
+    return false;
+  }
+  bool ok = !pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) &&
+            !pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST) &&
+            !pthread_mutex_init(mutex, &attr);
+  pthread_mutexattr_destroy(&attr);
+  return ok;
+}
+
+// wait for the creator of a segment to size it
+static int64_t wait_for_size(int fd) {
+  for (int64_t waited = 0; waited < SHM_INIT_TIMEOUT_USEC;
+       waited += SHM_INIT_POLL_USEC) {
+    struct stat st;
+    if (fstat(fd, &st)) {
+      return -1;
+    }
+    if (st.st_size >= (off_t) sizeof(struct shm_header)) {
+      return st.st_size;
+    }
+    g_usleep(SHM_INIT_POLL_USEC);
+  }
+  return -1;
+}
+
+// and to fill in the header
+static bool wait_for_ready(struct shm_header *header) {
+  for (int64_t waited = 0; waited < SHM_INIT_TIMEOUT_USEC;
+       waited += SHM_INIT_POLL_USEC) {
+    if (g_atomic_int_get(&header->ready)) {
+      return true;
+    }
+    g_usleep(SHM_INIT_POLL_USEC);
+  }
+  return false;
+}
+
+struct _openslide_shmcache *_openslide_shmcache_create(const char *name,
+                                                       int64_t capacity,
+                                                       GError **err) {
+  int64_t slot_count = MAX(capacity / SHM_BYTES_PER_SLOT, SHM_MIN_SLOTS);
+  int64_t log_offset = align(sizeof(struct shm_header)) +
+                       align(slot_count * sizeof(struct shm_slot));
+  int64_t log_size = capacity / SHM_ALIGN * SHM_ALIGN;
+  int64_t size = log_offset + log_size;
+  if (log_size <= 0) {
+    g_set_error(err, OPENSLIDE_ERROR, OPENSLIDE_ERROR_FAILED,
+                "Shared memory cache capacity too small");
+    return NULL;
+  }
+
+  bool created = true;
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd == -1 && errno == EEXIST) {
+    created = false;
+    fd = shm_open(name, O_RDWR, 0600);
+  }
+  if (fd == -1) {
+    _openslide_io_error(err, "Couldn't open shared memory segment %s", name);
+    return NULL;
+  }
+
+  if (created) {
+    if (ftruncate(fd, size)) {
+      _openslide_io_error(err, "Couldn't size shared memory segment %s",
+                          name);
+      goto FAIL_UNLINK;
+    }
+  } else {
+    size = wait_for_size(fd);
+    if (size == -1) {
+      g_set_error(err, OPENSLIDE_ERROR, OPENSLIDE_ERROR_FAILED,
+                  "Shared memory segment %s was never initialized", name);
+      goto FAIL;
+    }
+  }
+
+  struct shm_header *header = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                   MAP_SHARED, fd, 0);
+  if (header == MAP_FAILED) {
+    _openslide_io_error(err, "Couldn't map shared memory segment %s", name);
+    if (created) {
+      goto FAIL_UNLINK;
+    }
+    goto FAIL;
+  }
+  close(fd);
+
+  if (created) {
+    memcpy(header->magic, SHM_MAGIC, sizeof(header->magic));
+    header->size = size;
+    header->slot_count = slot_count;
+    header->log_offset = log_offset;
+    header->log_size = log_size;
+    header->head = 0;
+    if (!init_mutex(&header->mutex)) {
+      g_set_error(err, OPENSLIDE_ERROR, OPENSLIDE_ERROR_FAILED,
+                  "Couldn't create lock for shared memory segment %s",
+                  name);
+      munmap(header, size);
+      shm_unlink(name);
+      return NULL;
+    }
+    // publish
+    g_atomic_int_set(&header->ready, 1);
+  } else if (!wait_for_ready(header) ||
+             memcmp(header->magic, SHM_MAGIC, sizeof(header->magic)) ||
+             header->size != size) {
+    g_set_error(err, OPENSLIDE_ERROR, OPENSLIDE_ERROR_FAILED,
+                "Shared memory segment %s is not a compatible cache", name);
+    munmap(header, size);
+    return NULL;
+  }
+
+  struct _openslide_shmcache *sc = g_slice_new0(struct _openslide_shmcache);
+  sc->header = header;
+  sc->slots = (struct shm_slot *) ((uint8_t *) header +
+                                   align(sizeof(struct shm_header)));
+  sc->log = (uint8_t *) header + header->log_offset;
+  return sc;
+
+FAIL_UNLINK:
+  shm_unlink(name);
+FAIL:
+  close(fd);
+  return NULL;
+}
+
+void _openslide_shmcache_destroy(struct _openslide_shmcache *sc) {
+  munmap(sc->header, sc->header->size);
+  g_slice_free(struct _openslide_shmcache, sc);
+}
+
+void *_openslide_shmcache_get(struct _openslide_shmcache *sc,
+                              const char *slide_id,
+                              int32_t plane,
+                              int64_t x, int64_t y,
+                              int size_in_bytes) {
+  struct shm_header *header = sc->header;
+  struct shm_key key;
+  make_key(&key, slide_id, plane, x, y);
+
+  if (!shm_lock(header)) {
+    return NULL;
+  }
+  struct shm_slot *slot = find_slot(sc, &key);
+  if (slot && slot->size != size_in_bytes) {
+    // not the tile we expected; forget it
+    slot->size = 0;
+    slot = NULL;
+  }
+  int64_t pos = slot ? slot->pos : 0;
+  int32_t size = size_in_bytes;
+  shm_unlock(header);
+  if (slot == NULL) {
+    return NULL;
+  }
+
+  // copy without the lock, then make sure nothing overwrote it meanwhile
+  const uint8_t *p = sc->log + pos % header->log_size;
+  struct shm_record record;
+  memcpy(&record, p, sizeof(record));
+  void *data = _openslide_slab_alloc(size);
+  memcpy(data, p + SHM_ALIGN, size);
+
+  bool intact = false;
+  if (shm_lock(header)) {
+    intact = is_intact(header, pos);
+    shm_unlock(header);
+  }
+  if (!intact || !key_equal(&record.key, &key) || record.size != size ||
+      checksum(data, size) != record.checksum) {
+    _openslide_slab_free(size, data);
+    return NULL;
+  }
+
+  return data;
+}
+
+void _openslide_shmcache_put(struct _openslide_shmcache *sc,
+                             const char *slide_id,
+                             int32_t plane,
+                             int64_t x, int64_t y,
+                             const void *data, int size_in_bytes) {
+  struct shm_header *header = sc->header;
+  int64_t len = SHM_ALIGN + align(size_in_bytes);
+  if (size_in_bytes <= 0 ||
+      len > header->log_size / SHM_MAX_RECORD_FRACTION) {
+    return;
+  }
+  struct shm_key key;
+  make_key(&key, slide_id, plane, x, y);
+
+  // reserve space, unless another process got here first
+  if (!shm_lock(header)) {
+    return;
+  }
+  if (find_slot(sc, &key)) {
+    shm_unlock(header);
+    return;
+  }
+  int64_t pos = header->head;
+  int64_t offset = pos % header->log_size;
+  if (offset + len > header->log_size) {
+    // records don't wrap
+    pos += header->log_size - offset;
+  }
+  header->head = pos + len;
+  shm_unlock(header);
+
+  // write the record
+  struct shm_record record = {
+    .key = key,
+    .size = size_in_bytes,
+    .checksum = checksum(data, size_in_bytes),
+  };
+  uint8_t *p = sc->log + pos % header->log_size;
+  memcpy(p, &record, sizeof(record));
+  memcpy(p + SHM_ALIGN, data, size_in_bytes);
+
+  // publish it, if it hasn't been overwritten already
+  if (!shm_lock(header)) {
+    return;
+  }
+  if (is_intact(header, pos)) {
+    struct shm_slot *slot = choose_slot(sc, &key);
+    slot->key = key;
+    slot->pos = pos;
+    slot->size = size_in_bytes;
+  }
+  shm_unlock(header);
+}
+
+bool _openslide_shmcache_remove(const char *name, GError **err) {
+  if (shm_unlink(name)) {
+    _openslide_io_error(err, "Couldn't remove shared memory segment %s",
+                        name);
+    return false;
+  }
+  return true;
+}
+
+#else
+
+struct _openslide_shmcache *_openslide_shmcache_create(const char *name G_GNUC_UNUSED,
+                                                       int64_t capacity G_GNUC_UNUSED,
+                                                       GError **err) {
+  g_set_error(err, OPENSLIDE_ERROR, OPENSLIDE_ERROR_FAILED,
+              "Shared memory caching is not supported on this platform");
+  return NULL;
+}
+
+void _openslide_shmcache_destroy(struct _openslide_shmcache *sc G_GNUC_UNUSED) {
+  g_assert_not_reached();
+}
+
+void *_openslide_shmcache_get(struct _openslide_shmcache *sc G_GNUC_UNUSED,
+                              const char *slide_id G_GNUC_UNUSED,
+                              int32_t plane G_GNUC_UNUSED,
+                              int64_t x G_GNUC_UNUSED,
+                              int64_t y G_GNUC_UNUSED,
+                              int size_in_bytes G_GNUC_UNUSED) {
+  g_assert_not_reached();
+}
+
+void _openslide_shmcache_put(struct _openslide_shmcache *sc G_GNUC_UNUSED,
+                             const char *slide_id G_GNUC_UNUSED,
+                             int32_t plane G_GNUC_UNUSED,
+                             int64_t x G_GNUC_UNUSED,
+                             int64_t y G_GNUC_UNUSED,
+                             const void *data G_GNUC_UNUSED,
+                             int size_in_bytes G_GNUC_UNUSED) {
+  g_assert_not_reached();
+}
+
+bool _openslide_shmcache_remove(const char *name G_GNUC_UNUSED,
+                                GError **err) {
+  g_set_error(err, OPENSLIDE_ERROR, OPENSLIDE_ERROR_FAILED,
+              "Shared memory caching is not supported on this platform");
+  return false;
+}
+
+#endif
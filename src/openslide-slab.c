@@ -0,0 +1,281 @@
+/*
+ *  OpenSlide, a library for reading whole slide image files
+ *
+ *  Copyright (c) 2026 OpenSlide contributors
+ *  All rights reserved.
+ *
+ *  OpenSlide is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, version 2.1.
+ *
+ *  OpenSlide is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with OpenSlide. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Tile buffer allocator.
+ *
+ * Decoded tiles come in a handful of sizes, and are allocated and freed
+ * at the rate the cache turns over.  Instead of sending each buffer
+ * through malloc, carve equal-sized slots out of arenas, one set of
+ * arenas per buffer size, and recycle freed slots.  Arenas hold only a
+ * few slots, so that a live slot doesn't pin much more memory than it
+ * uses.  Where the platform allows, arenas of a huge page or more are
+ * aligned to and advised for transparent huge pages, which cuts TLB
+ * misses when painting from a large cache.
+ *
+ * Each size keeps one empty arena in reserve, so that a buffer allocated
+ * and freed in turn doesn't map and unmap an arena each time.  Other
+ * arenas are returned to the system as soon as their last slot is freed.
+ * If an arena can't be mapped, buffers come from malloc instead.
+ */
+
+#include <config.h>
+
+#include "openslide-private.h"
+
+#include <glib.h>
+
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
+#define SLOTS_PER_ARENA 8
+#define PAGE_SIZE_ROUNDING 4096
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// buffers larger than this are allocated individually
+#define MAX_SLOT_SIZE (2 * 1024 * 1024)
+
+// precedes each slot; keeps buffers 16-byte aligned
+struct slot_header {
+  struct arena *arena;  // NULL if the buffer came from malloc
+  void *next_free;  // next free slot in the arena, while free
+};
+#define SLOT_HEADER_SIZE 16
+
+struct arena {
+  struct size_class *cls;
+  void *mem;
+  size_t mem_size;
+
+  char *slots;  // start of first slot
+  int slot_count;
+  int carved;  // slots handed out at least once; the rest are untouched
+  int used;
+  struct slot_header *free_slots;
+
+  GList *link;  // in the class's partial list, if it has free slots
+};
+
+struct size_class {
+  int size;
+  size_t stride;
+  size_t arena_size;
+  GQueue *partial;  // arenas with free slots
+  struct arena *spare;  // an empty arena, not in partial
+};
+
+static GMutex *slab_mutex;
+static GHashTable *size_classes;  // size -> struct size_class
+static volatile gint arena_bytes_kb;  // in arenas, in KiB
+
+static gpointer slab_init(gpointer data G_GNUC_UNUSED) {
+  slab_mutex = g_mutex_new();
+  size_classes = g_hash_table_new(g_direct_hash, g_direct_equal);
+  return NULL;
+}
+
+static void *map_arena(size_t size) {
+#ifdef HAVE_MMAP
+  if (size < HUGE_PAGE_SIZE) {
+    char *mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+      return NULL;
+    }
+    return mem;
+  }
+
+  // over-allocate so the arena can be aligned to a huge page
+  size_t map_size = size + HUGE_PAGE_SIZE;
+  char *mem = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    return NULL;
+  }
+  size_t head = (HUGE_PAGE_SIZE - (GPOINTER_TO_SIZE(mem) % HUGE_PAGE_SIZE)) %
+                HUGE_PAGE_SIZE;
+  if (head) {
+    munmap(mem, head);
+  }
+  munmap(mem + head + size, HUGE_PAGE_SIZE - head);
+  mem += head;
+#if defined(HAVE_MADVISE) && defined(MADV_HUGEPAGE)
+  // advisory; ignore failure
+  madvise(mem, size, MADV_HUGEPAGE);
+#endif
+  return mem;
+#else
+  return g_try_malloc(size);
+#endif
+}
+
+static void unmap_arena(void *mem, size_t size) {
+#ifdef HAVE_MMAP
+  munmap(mem, size);
+#else
+  (void) size;
+  g_free(mem);
+#endif
+}
+
+// slab mutex must be held
+static struct size_class *get_size_class(int size) {
+  struct size_class *cls = g_hash_table_lookup(size_classes,
+                                               GINT_TO_POINTER(size));
+  if (cls == NULL) {
+    cls = g_slice_new0(struct size_class);
+    cls->size = size;
+    cls->stride = SLOT_HEADER_SIZE + ((size + 15) & ~15);
+    // whole huge pages once the arena is that large, else whole pages
+    size_t rounding = cls->stride * SLOTS_PER_ARENA >= HUGE_PAGE_SIZE ?
+                      HUGE_PAGE_SIZE : PAGE_SIZE_ROUNDING;
+    cls->arena_size = (cls->stride * SLOTS_PER_ARENA + rounding - 1) /
+                      rounding * rounding;
+    cls->partial = g_queue_new();
+    g_hash_table_insert(size_classes, GINT_TO_POINTER(size), cls);
+  }
+  return cls;
+}
+
+// slab mutex must be held.  returns NULL if the arena can't be mapped.
+static struct arena *arena_create(struct size_class *cls) {
+  void *mem = map_arena(cls->arena_size);
+  if (mem == NULL) {
+    return NULL;
+  }
+  struct arena *arena = g_slice_new0(struct arena);
+  arena->cls = cls;
+  arena->mem_size = cls->arena_size;
+  arena->mem = mem;
+  g_atomic_int_add(&arena_bytes_kb, arena->mem_size / 1024);
+  arena->slots = arena->mem;
+  arena->slot_count = arena->mem_size / cls->stride;
+  return arena;
+}
+
+static void arena_destroy(struct arena *arena) {
+  g_atomic_int_add(&arena_bytes_kb, -(gint) (arena->mem_size / 1024));
+  unmap_arena(arena->mem, arena->mem_size);
+  g_slice_free(struct arena, arena);
+}
+
+void *_openslide_slab_alloc(int size) {
+  static GOnce once = G_ONCE_INIT;
+  g_once(&once, slab_init, NULL);
+
+  g_assert(size > 0);
+  if (size > MAX_SLOT_SIZE) {
+    return g_malloc(size);
+  }
+
+  g_mutex_lock(slab_mutex);
+  struct size_class *cls = get_size_class(size);
+  struct arena *arena = g_queue_peek_head(cls->partial);
+  if (arena == NULL) {
+    arena = cls->spare;
+    cls->spare = NULL;
+    if (arena == NULL) {
+      arena = arena_create(cls);
+    }
+    if (arena == NULL) {
+      g_mutex_unlock(slab_mutex);
+      struct slot_header *slot = g_malloc(SLOT_HEADER_SIZE + size);
+      slot->arena = NULL;
+      return (char *) slot + SLOT_HEADER_SIZE;
+    }
+    g_queue_push_head(cls->partial, arena);
+    arena->link = g_queue_peek_head_link(cls->partial);
+  }
+
+  struct slot_header *slot;
+  if (arena->free_slots) {
+    slot = arena->free_slots;
+    arena->free_slots = slot->next_free;
+  } else {
+    g_assert(arena->carved < arena->slot_count);
+    slot = (struct slot_header *) (arena->slots +
+                                   arena->carved * cls->stride);
+    slot->arena = arena;
+    arena->carved++;
+  }
+  slot->next_free = NULL;
+
+  if (++arena->used == arena->slot_count) {
+    // full
+    g_queue_delete_link(cls->partial, arena->link);
+    arena->link = NULL;
+  }
+  g_mutex_unlock(slab_mutex);
+
+  return (char *) slot + SLOT_HEADER_SIZE;
+}
+
+void _openslide_slab_free(int size, void *buf) {
+  if (buf == NULL) {
+    return;
+  }
+  if (size > MAX_SLOT_SIZE) {
+    g_free(buf);
+    return;
+  }
+
+  struct slot_header *slot =
+    (struct slot_header *) ((char *) buf - SLOT_HEADER_SIZE);
+  struct arena *arena = slot->arena;
+  if (arena == NULL) {
+    g_free(slot);
+    return;
+  }
+  struct size_class *cls = arena->cls;
+  g_assert(cls->size == size);
+
+  g_mutex_lock(slab_mutex);
+  slot->next_free = arena->free_slots;
+  arena->free_slots = slot;
+
+  if (arena->link == NULL) {
+    // was full
+    g_queue_push_head(cls->partial, arena);
+    arena->link = g_queue_peek_head_link(cls->partial);
+  }
+
+  struct arena *unused = NULL;
+  if (--arena->used == 0) {
+    // empty; keep one in reserve
+    g_queue_delete_link(cls->partial, arena->link);
+    arena->link = NULL;
+    if (cls->spare == NULL) {
+      cls->spare = arena;
+    } else {
+      unused = arena;
+    }
+  }
+  g_mutex_unlock(slab_mutex);
+
+  if (unused) {
+    arena_destroy(unused);
+  }
+}
+
+int64_t _openslide_slab_get_arena_bytes(void) {
+  return (int64_t) g_atomic_int_get(&arena_bytes_kb) * 1024;
+}
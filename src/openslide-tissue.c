@@ -0,0 +1,422 @@
+/*
+ *  OpenSlide, a library for reading whole slide image files
+ *
+ *  Copyright (c) 2026 OpenSlide contributors
+ *  All rights reserved.
+ *
+ *  OpenSlide is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, version 2.1.
+ *
+ *  OpenSlide is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with OpenSlide. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Tissue masks.
+ *
+ * A mask is computed from the smallest level of a z-level, scaled down
+ * if necessary: stained tissue is saturated and glass is not, so pixels
+ * whose saturation exceeds an Otsu threshold are tissue.  A read that
+ * skips background gets the mask of the first z-level before it starts,
+ * and enters it on its thread and on the workers decoding for it.  Grids
+ * then consult the mask before painting each tile of a level, and paint
+ * the background color in place of tiles with no tissue nearby.  The
+ * smallest level of each z-level, which is cheap to read, is never
+ * skipped, nor is anything a vendor reads to produce a tile, since the
+ * tile will be cached.  A mask is computed outside the handle's lock, so
+ * that computing it never waits on itself, and with none of the reading
+ * thread's skipping, deadline, cancellation, or batch in effect, so that
+ * it is never built from a partial read.
+ */
+
+#include <config.h>
+
+#include "openslide-private.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+#include <cairo.h>
+
+// longest side of a mask
+#define MASK_MAX_DIM 1024
+// pixels less saturated than this are never tissue, however the
+// histogram falls
+#define MIN_THRESHOLD 12
+// tiles are skipped only if this many cells around them are also clear
+#define DILATION 1
+
+struct _openslide_tissue_mask {
+  uint8_t *cells;  // 255 for tissue, 0 for background
+  int64_t w;
+  int64_t h;
+  double cell_w;  // level 0 plane
+  double cell_h;
+  // summed-area table of tissue cells, (w + 1) x (h + 1)
+  int64_t *sums;
+};
+
+struct _openslide_tissue {
+  GMutex *mutex;
+  GHashTable *masks;  // zlevel -> struct _openslide_tissue_mask
+  uint64_t skipped;  // tiles painted as background; under mutex
+};
+
+// the mask the current thread's read is skipping background by, if any
+static GStaticPrivate thread_skip = G_STATIC_PRIVATE_INIT;
+// nesting of the current thread's tile reads, as a GINT_TO_POINTER
+static GStaticPrivate thread_reading = G_STATIC_PRIVATE_INIT;
+
+static void tissue_mask_free(gpointer data) {
+  struct _openslide_tissue_mask *mask = data;
+  g_free(mask->cells);
+  g_free(mask->sums);
+  g_slice_free(struct _openslide_tissue_mask, mask);
+}
+
+struct _openslide_tissue *_openslide_tissue_create(void) {
+  struct _openslide_tissue *tissue = g_slice_new0(struct _openslide_tissue);
+  tissue->mutex = g_mutex_new();
+  tissue->masks = g_hash_table_new_full(g_int_hash, g_int_equal,
+                                        g_free, tissue_mask_free);
+  return tissue;
+}
+
+void _openslide_tissue_destroy(struct _openslide_tissue *tissue) {
+  g_hash_table_destroy(tissue->masks);
+  g_mutex_free(tissue->mutex);
+  g_slice_free(struct _openslide_tissue, tissue);
+}
+
+// the levels of a z-level, smallest last
+static bool get_zlevel_levels(openslide_t *osr, int32_t zlevel,
+                              struct _openslide_level ***levels,
+                              int32_t *level_count) {
+  if (osr->zlevel_count > 0) {
+    if (zlevel < 0 || zlevel >= osr->zlevel_count) {
+      return false;
+    }
+    *levels = osr->zlevels[zlevel]->levels;
+    *level_count = osr->zlevels[zlevel]->level_count;
+    return true;
+  }
+  if (zlevel != 0) {
+    return false;
+  }
+  *levels = osr->levels;
+  *level_count = osr->level_count;
+  return true;
+}
+
+// saturation of a premultiplied pixel, 0-255; transparent pixels have none
+static uint8_t get_saturation(uint32_t p) {
+  uint32_t r = (p >> 16) & 0xff;
+  uint32_t g = (p >> 8) & 0xff;
+  uint32_t b = p & 0xff;
+  // premultiplication scales all channels alike, so it cancels out
+  uint32_t max = MAX(r, MAX(g, b));
+  uint32_t min = MIN(r, MIN(g, b));
+  if (max == 0) {
+    return 0;
+  }
+  return (max - min) * 255 / max;
+}
+
+// Otsu's method: the threshold maximizing between-class variance
+static int otsu_threshold(const int64_t histogram[256]) {
+  int64_t total = 0;
+  double sum = 0;
+  for (int i = 0; i < 256; i++) {
+    total += histogram[i];
+    sum += (double) i * histogram[i];
+  }
+
+  int64_t weight_bg = 0;
+  double sum_bg = 0;
+  double best_variance = -1;
+  int best = 0;
+  for (int t = 0; t < 256; t++) {
+    weight_bg += histogram[t];
+    if (weight_bg == 0) {
+      continue;
+    }
+    int64_t weight_fg = total - weight_bg;
+    if (weight_fg == 0) {
+      break;
+    }
+    sum_bg += (double) t * histogram[t];
+    double mean_bg = sum_bg / weight_bg;
+    double mean_fg = (sum - sum_bg) / weight_fg;
+    double variance = (double) weight_bg * weight_fg *
+                      (mean_bg - mean_fg) * (mean_bg - mean_fg);
+    if (variance > best_variance) {
+      best_variance = variance;
+      best = t;
+    }
+  }
+  return best;
+}
+
+static struct _openslide_tissue_mask *compute_mask(openslide_t *osr,
+                                                   int32_t zlevel,
+                                                   GError **err) {
+  struct _openslide_level **levels;
+  int32_t level_count;
+  if (!get_zlevel_levels(osr, zlevel, &levels, &level_count)) {
+    g_set_error(err, OPENSLIDE_ERROR, OPENSLIDE_ERROR_FAILED,
+                "No such z-level: %d", zlevel);
+    return NULL;
+  }
+
+  // scale the smallest level down to the mask size
+  struct _openslide_level *l = levels[level_count - 1];
+  int64_t w0 = levels[0]->w;
+  int64_t h0 = levels[0]->h;
+  int64_t w = l->w;
+  int64_t h = l->h;
+  if (MAX(w, h) > MASK_MAX_DIM) {
+    double scale = (double) MASK_MAX_DIM / MAX(w, h);
+    w = MAX((int64_t) (w * scale), 1);
+    h = MAX((int64_t) (h * scale), 1);
+  }
+  if (w == 0 || h == 0) {
+    g_set_error(err, OPENSLIDE_ERROR, OPENSLIDE_ERROR_FAILED,
+                "Level has no pixels");
+    return NULL;
+  }
+  uint32_t *pixels = g_new0(uint32_t, w * h);
+  if (!_openslide_read_level_region_scaled(osr, pixels, 0, 0, l, w0, h0,
+                                           w, h, err)) {
+    g_free(pixels);
+    return NULL;
+  }
+
+  // threshold saturation
+  uint8_t *saturation = g_new(uint8_t, w * h);
+  int64_t histogram[256] = {0};
+  for (int64_t i = 0; i < w * h; i++) {
+    saturation[i] = get_saturation(pixels[i]);
+    histogram[saturation[i]]++;
+  }
+  g_free(pixels);
+  int threshold = MAX(otsu_threshold(histogram), MIN_THRESHOLD);
+
+  struct _openslide_tissue_mask *mask = g_slice_new0(struct _openslide_tissue_mask);
+  mask->w = w;
+  mask->h = h;
+  mask->cell_w = (double) w0 / w;
+  mask->cell_h = (double) h0 / h;
+  mask->cells = g_new(uint8_t, w * h);
+  mask->sums = g_new0(int64_t, (w + 1) * (h + 1));
+  for (int64_t y = 0; y < h; y++) {
+    int64_t row_sum = 0;
+    for (int64_t x = 0; x < w; x++) {
+      bool tissue = saturation[y * w + x] > threshold;
+      mask->cells[y * w + x] = tissue ? 255 : 0;
+      row_sum += tissue;
+      mask->sums[(y + 1) * (w + 1) + x + 1] =
+        mask->sums[y * (w + 1) + x + 1] + row_sum;
+    }
+  }
+  g_free(saturation);
+  return mask;
+}
+
+// computed on first use; NULL on error
+static struct _openslide_tissue_mask *get_mask(openslide_t *osr,
+                                               int32_t zlevel,
+                                               GError **err) {
+  struct _openslide_tissue *tissue = osr->tissue;
+  g_mutex_lock(tissue->mutex);
+  struct _openslide_tissue_mask *mask =
+    g_hash_table_lookup(tissue->masks, &zlevel);
+  g_mutex_unlock(tissue->mutex);
+  if (mask) {
+    return mask;
+  }
+
+  // the mask must see every tile in full, whatever the read that wanted
+  // it is doing, since it is kept for the life of the handle.  threads
+  // racing to compute it may each do so, and the first to finish wins.
+  struct _openslide_tissue_mask *skip = g_static_private_get(&thread_skip);
+  volatile gint *cancelled = _openslide_cancel_get_current();
+  struct _openslide_cache_batch *batch = _openslide_cache_batch_get_current();
+  void *deadline = _openslide_deadline_suspend();
+  g_static_private_set(&thread_skip, NULL, NULL);
+  _openslide_cancel_leave();
+  _openslide_cache_batch_leave();
+  struct _openslide_tissue_mask *new_mask = compute_mask(osr, zlevel, err);
+  _openslide_cache_batch_enter(batch);
+  _openslide_cancel_enter(cancelled);
+  g_static_private_set(&thread_skip, skip, NULL);
+  _openslide_deadline_resume(deadline);
+  if (new_mask == NULL) {
+    return NULL;
+  }
+
+  g_mutex_lock(tissue->mutex);
+  mask = g_hash_table_lookup(tissue->masks, &zlevel);
+  if (mask == NULL) {
+    mask = new_mask;
+    new_mask = NULL;
+    int *key = g_new(int, 1);
+    *key = zlevel;
+    g_hash_table_insert(tissue->masks, key, mask);
+  }
+  g_mutex_unlock(tissue->mutex);
+  if (new_mask) {
+    tissue_mask_free(new_mask);
+  }
+  return mask;
+}
+
+const uint8_t *_openslide_tissue_get_mask(openslide_t *osr, int32_t zlevel,
+                                          int64_t *w, int64_t *h,
+                                          GError **err) {
+  struct _openslide_tissue_mask *mask = get_mask(osr, zlevel, err);
+  if (mask == NULL) {
+    return NULL;
+  }
+  *w = mask->w;
+  *h = mask->h;
+  return mask->cells;
+}
+
+struct _openslide_tissue_mask *_openslide_tissue_get_skip_mask(openslide_t *osr) {
+  // if the mask can't be computed, read everything
+  return get_mask(osr, 0, NULL);
+}
+
+void _openslide_tissue_skip_enter(struct _openslide_tissue_mask *mask) {
+  g_static_private_set(&thread_skip, mask, NULL);
+}
+
+void _openslide_tissue_skip_leave(void) {
+  g_static_private_set(&thread_skip, NULL, NULL);
+}
+
+struct _openslide_tissue_mask *_openslide_tissue_skip_get_current(void) {
+  return g_static_private_get(&thread_skip);
+}
+
+// whether any tissue is near a rectangle in the level 0 plane
+static bool has_tissue(struct _openslide_tissue_mask *mask,
+                       double x, double y, double w, double h) {
+  int64_t x0 = CLAMP((int64_t) floor(x / mask->cell_w) - DILATION,
+                     0, mask->w);
+  int64_t y0 = CLAMP((int64_t) floor(y / mask->cell_h) - DILATION,
+                     0, mask->h);
+  int64_t x1 = CLAMP((int64_t) ceil((x + w) / mask->cell_w) + DILATION,
+                     0, mask->w);
+  int64_t y1 = CLAMP((int64_t) ceil((y + h) / mask->cell_h) + DILATION,
+                     0, mask->h);
+  if (x0 >= x1 || y0 >= y1) {
+    // outside the slide
+    return false;
+  }
+  int64_t stride = mask->w + 1;
+  int64_t count = mask->sums[y1 * stride + x1] - mask->sums[y0 * stride + x1] -
+                  mask->sums[y1 * stride + x0] + mask->sums[y0 * stride + x0];
+  return count > 0;
+}
+
+static bool is_last_level(struct _openslide_level **levels,
+                          int32_t level_count,
+                          struct _openslide_level *level) {
+  return level_count > 0 && levels[level_count - 1] == level;
+}
+
+static bool has_level(struct _openslide_level **levels, int32_t level_count,
+                      struct _openslide_level *level) {
+  for (int32_t i = 0; i < level_count; i++) {
+    if (levels[i] == level) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// only tiles of the slide's own levels are skipped, and never those of
+// the smallest level of any z-level
+static bool is_skippable_level(openslide_t *osr,
+                               struct _openslide_level *level) {
+  if (is_last_level(osr->levels, osr->level_count, level)) {
+    return false;
+  }
+  bool found = has_level(osr->levels, osr->level_count, level);
+  for (int32_t i = 0; i < osr->zlevel_count; i++) {
+    struct _openslide_zlevel *z = osr->zlevels[i];
+    if (is_last_level(z->levels, z->level_count, level)) {
+      return false;
+    }
+    found = found || has_level(z->levels, z->level_count, level);
+  }
+  return found;
+}
+
+static void paint_background(openslide_t *osr, cairo_t *cr,
+                             double w, double h) {
+  // white unless the slide says otherwise
+  uint32_t color = 0xffffff;
+  const char *bgcolor =
+    g_hash_table_lookup(osr->properties,
+                        OPENSLIDE_PROPERTY_NAME_BACKGROUND_COLOR);
+  if (bgcolor) {
+    color = strtoul(bgcolor, NULL, 16);
+  }
+
+  cairo_save(cr);
+  cairo_set_source_rgb(cr,
+                       ((color >> 16) & 0xff) / 255.0,
+                       ((color >> 8) & 0xff) / 255.0,
+                       (color & 0xff) / 255.0);
+  cairo_rectangle(cr, 0, 0, w, h);
+  cairo_fill(cr);
+  cairo_restore(cr);
+}
+
+bool _openslide_tissue_skip_tile(openslide_t *osr, cairo_t *cr,
+                                 struct _openslide_level *level,
+                                 double x, double y, double w, double h) {
+  int reading = GPOINTER_TO_INT(g_static_private_get(&thread_reading));
+  struct _openslide_tissue_mask *mask = g_static_private_get(&thread_skip);
+
+  // whatever a vendor reads to produce a tile, such as the lower level
+  // Aperio renders a missing tile from, goes into the cached tile, so it
+  // is never skipped
+  if (reading == 0 && mask != NULL && is_skippable_level(osr, level)) {
+    double ds = level->downsample;
+    if (!has_tissue(mask, x * ds, y * ds, w * ds, h * ds)) {
+      paint_background(osr, cr, w, h);
+      g_mutex_lock(osr->tissue->mutex);
+      osr->tissue->skipped++;
+      g_mutex_unlock(osr->tissue->mutex);
+      return true;
+    }
+  }
+
+  g_static_private_set(&thread_reading, GINT_TO_POINTER(reading + 1), NULL);
+  return false;
+}
+
+uint64_t _openslide_tissue_get_skipped(struct _openslide_tissue *tissue) {
+  g_mutex_lock(tissue->mutex);
+  uint64_t skipped = tissue->skipped;
+  g_mutex_unlock(tissue->mutex);
+  return skipped;
+}
+
+void _openslide_tissue_tile_done(void) {
+  int reading = GPOINTER_TO_INT(g_static_private_get(&thread_reading));
+  g_assert(reading > 0);
+  g_static_private_set(&thread_reading, GINT_TO_POINTER(reading - 1), NULL);
+}
@@ -46,6 +46,7 @@ static const struct debug_option {
   enum _openslide_debug_flag flag;
   const char *desc;
 } debug_options[] = {
+  {"cache", OPENSLIDE_DEBUG_CACHE, "log tile cache statistics"},
   {"detection", OPENSLIDE_DEBUG_DETECTION, "log format detection errors"},
   {"jpeg-markers", OPENSLIDE_DEBUG_JPEG_MARKERS,
    "verify Hamamatsu restart markers"},
@@ -355,6 +356,31 @@ bool _openslide_clip_tile(uint32_t *tiledata,
   return success;
 }
 
+// the cancellation flag of the read the current thread is doing, if any
+static GStaticPrivate thread_cancel = G_STATIC_PRIVATE_INIT;
+
+void _openslide_cancel_enter(volatile gint *cancelled) {
+  g_static_private_set(&thread_cancel, (gpointer) cancelled, NULL);
+}
+
+void _openslide_cancel_leave(void) {
+  g_static_private_set(&thread_cancel, NULL, NULL);
+}
+
+volatile gint *_openslide_cancel_get_current(void) {
+  return g_static_private_get(&thread_cancel);
+}
+
+bool _openslide_check_cancel(GError **err) {
+  volatile gint *cancelled = g_static_private_get(&thread_cancel);
+  if (cancelled && g_atomic_int_get(cancelled)) {
+    g_set_error(err, OPENSLIDE_ERROR, OPENSLIDE_ERROR_CANCELLED,
+                "Read cancelled");
+    return false;
+  }
+  return true;
+}
+
 // note: g_getenv() is not reentrant
 void _openslide_debug_init(void) {
   const char *debug_str = g_getenv(DEBUG_ENV_VAR);
@@ -80,13 +80,14 @@ static bool read_tile(openslide_t *osr,
   struct _openslide_cache_entry *cache_entry;
   uint32_t *tiledata = _openslide_cache_get(osr->cache,
                                             level, tile_col, tile_row,
+                                            tw * th * 4,
                                             &cache_entry);
   if (!tiledata) {
-    tiledata = g_slice_alloc(tw * th * 4);
-    if (!_openslide_tiff_read_tile(tiffl, tiff,
+    tiledata = _openslide_slab_alloc(tw * th * 4);
+    if (!_openslide_tiff_read_tile(tiffl, tiff, osr->cache, level,
                                    tiledata, tile_col, tile_row,
                                    err)) {
-      g_slice_free1(tw * th * 4, tiledata);
+      _openslide_slab_free(tw * th * 4, tiledata);
       return false;
     }
 
@@ -94,7 +95,7 @@ static bool read_tile(openslide_t *osr,
     if (!_openslide_tiff_clip_tile(tiffl, tiledata,
                                    tile_col, tile_row,
                                    err)) {
-      g_slice_free1(tw * th * 4, tiledata);
+      _openslide_slab_free(tw * th * 4, tiledata);
       return false;
     }
 
@@ -109,9 +110,9 @@ static bool read_tile(openslide_t *osr,
                                                                  CAIRO_FORMAT_ARGB32,
                                                                  tw, th,
                                                                  tw * 4);
-  cairo_set_source_surface(cr, surface, 0, 0);
+  _openslide_cairo_mark_solid(surface, cache_entry);
+  _openslide_cairo_paint_surface(cr, surface);
   cairo_surface_destroy(surface);
-  cairo_paint(cr);
 
   // done with the cache entry, release it
   _openslide_cache_entry_unref(cache_entry);
@@ -142,8 +143,52 @@ static bool paint_region(openslide_t *osr, cairo_t *cr,
   return success;
 }
 
+static bool get_tile(openslide_t *osr,
+                     struct _openslide_level *level,
+                     int64_t col, int64_t row,
+                     struct _openslide_tile **tile,
+                     GError **err) {
+  struct generic_tiff_ops_data *data = osr->data;
+  struct level *l = (struct level *) level;
+
+  TIFF *tiff = _openslide_tiffcache_get(data->tc, err);
+  if (tiff == NULL) {
+    return false;
+  }
+
+  bool success = _openslide_grid_get_tile(l->grid, tiff, level,
+                                          col, row, tile, err);
+  _openslide_tiffcache_put(data->tc, tiff);
+
+  return success;
+}
+
+static bool read_raw_tile(openslide_t *osr,
+                          struct _openslide_level *level,
+                          int64_t col, int64_t row,
+                          void **buf, int32_t *len,
+                          GError **err) {
+  struct generic_tiff_ops_data *data = osr->data;
+  struct level *l = (struct level *) level;
+
+  TIFF *tiff = _openslide_tiffcache_get(data->tc, err);
+  if (tiff == NULL) {
+    return false;
+  }
+
+  bool success = _openslide_tiff_read_raw_tile(&l->tiffl, tiff,
+                                               osr->cache, level,
+                                               buf, len, col, row,
+                                               err);
+  _openslide_tiffcache_put(data->tc, tiff);
+
+  return success;
+}
+
 static const struct _openslide_ops generic_tiff_ops = {
   .paint_region = paint_region,
+  .get_tile = get_tile,
+  .read_raw_tile = read_raw_tile,
   .destroy = destroy,
 };
 
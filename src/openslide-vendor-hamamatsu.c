@@ -686,16 +686,17 @@ static bool read_jpeg_tile(openslide_t *osr,
   struct _openslide_cache_entry *cache_entry;
   uint32_t *tiledata = _openslide_cache_get(osr->cache,
                                             level, tile_col, tile_row,
+                                            tw * th * 4,
                                             &cache_entry);
 
   if (!tiledata) {
-    tiledata = g_slice_alloc(tw * th * 4);
+    tiledata = _openslide_slab_alloc(tw * th * 4);
     if (!read_from_jpeg(osr,
                         jp, tileno,
                         l->scale_denom,
                         tiledata, tw, th,
                         err)) {
-      g_slice_free1(tw * th * 4, tiledata);
+      _openslide_slab_free(tw * th * 4, tiledata);
       return false;
     }
 
@@ -711,10 +712,10 @@ static bool read_jpeg_tile(openslide_t *osr,
 								 CAIRO_FORMAT_RGB24,
 								 tw, th,
 								 tw * 4);
+  _openslide_cairo_mark_solid(surface, cache_entry);
 
-  cairo_set_source_surface(cr, surface, 0, 0);
+  _openslide_cairo_paint_surface(cr, surface);
   cairo_surface_destroy(surface);
-  cairo_paint(cr);
 
   // done with the cache entry, release it
   _openslide_cache_entry_unref(cache_entry);
@@ -1602,7 +1603,7 @@ static bool ngr_read_tile(openslide_t *osr,
   struct _openslide_cache_entry *cache_entry;
   // look up tile in cache
   uint32_t *tiledata = _openslide_cache_get(osr->cache, level, tile_x, tile_y,
-                                            &cache_entry);
+                                            tilesize, &cache_entry);
 
   if (!tiledata) {
     // read the tile data
@@ -1636,7 +1637,7 @@ static bool ngr_read_tile(openslide_t *osr,
     fclose(f);
 
     // got the data, now convert to 8-bit xRGB
-    tiledata = g_slice_alloc(tilesize);
+    tiledata = _openslide_slab_alloc(tilesize);
     for (int i = 0; i < tw * th; i++) {
       // scale down from 12 bits
       uint8_t r = GINT16_FROM_LE(buf[(i * 3)]) >> 4;
@@ -1659,9 +1660,9 @@ static bool ngr_read_tile(openslide_t *osr,
                                                                  CAIRO_FORMAT_RGB24,
                                                                  tw, th,
                                                                  tw * 4);
-  cairo_set_source_surface(cr, surface, 0, 0);
+  _openslide_cairo_mark_solid(surface, cache_entry);
+  _openslide_cairo_paint_surface(cr, surface);
   cairo_surface_destroy(surface);
-  cairo_paint(cr);
 
   // done with the cache entry, release it
   _openslide_cache_entry_unref(cache_entry);
@@ -1683,8 +1684,20 @@ static bool ngr_paint_region(openslide_t *osr G_GNUC_UNUSED, cairo_t *cr,
                                       err);
 }
 
+static bool ngr_get_tile(openslide_t *osr G_GNUC_UNUSED,
+                         struct _openslide_level *level,
+                         int64_t col, int64_t row,
+                         struct _openslide_tile **tile,
+                         GError **err) {
+  struct ngr_level *l = (struct ngr_level *) level;
+
+  return _openslide_grid_get_tile(l->grid, NULL, level,
+                                  col, row, tile, err);
+}
+
 static const struct _openslide_ops ngr_ops = {
   .paint_region = ngr_paint_region,
+  .get_tile = ngr_get_tile,
   .destroy = ngr_destroy,
 };
 
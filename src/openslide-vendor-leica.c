@@ -160,13 +160,15 @@ static bool read_tile(openslide_t *osr,
   struct _openslide_cache_entry *cache_entry;
   uint32_t *tiledata = _openslide_cache_get(osr->cache,
                                             args->area, tile_col, tile_row,
+                                            tw * th * 4,
                                             &cache_entry);
   if (!tiledata) {
-    tiledata = g_slice_alloc(tw * th * 4);
+    tiledata = _openslide_slab_alloc(tw * th * 4);
     if (!_openslide_tiff_read_tile(tiffl, args->tiff,
+                                   osr->cache, args->area,
                                    tiledata, tile_col, tile_row,
                                    err)) {
-      g_slice_free1(tw * th * 4, tiledata);
+      _openslide_slab_free(tw * th * 4, tiledata);
       return false;
     }
 
@@ -174,7 +176,7 @@ static bool read_tile(openslide_t *osr,
     if (!_openslide_tiff_clip_tile(tiffl, tiledata,
                                    tile_col, tile_row,
                                    err)) {
-      g_slice_free1(tw * th * 4, tiledata);
+      _openslide_slab_free(tw * th * 4, tiledata);
       return false;
     }
 
@@ -190,9 +192,9 @@ static bool read_tile(openslide_t *osr,
                                                                  CAIRO_FORMAT_ARGB32,
                                                                  tw, th,
                                                                  tw * 4);
-  cairo_set_source_surface(cr, surface, 0, 0);
+  _openslide_cairo_mark_solid(surface, cache_entry);
+  _openslide_cairo_paint_surface(cr, surface);
   cairo_surface_destroy(surface);
-  cairo_paint(cr);
 
   // done with the cache entry, release it
   _openslide_cache_entry_unref(cache_entry);
@@ -684,6 +686,7 @@ static bool create_levels_from_collection(openslide_t *osr,
       struct area *area = g_slice_new0(struct area);
       struct _openslide_tiff_level *tiffl = &area->tiffl;
       g_ptr_array_add(l->areas, area);
+      _openslide_cache_add_plane(osr, (struct _openslide_level *) l, area);
 
       // select and examine TIFF directory
       if (!_openslide_tiff_level_init(tiff, dimension->dir,
@@ -717,6 +720,7 @@ static bool create_levels_from_collection(openslide_t *osr,
                                                  tiffl->tile_w,
                                                  tiffl->tile_h,
                                                  read_tile);
+      _openslide_grid_simple_set_cache_plane(area->grid, area);
     }
 
     // set quickhash directory in legacy mode
@@ -747,6 +751,7 @@ static bool create_levels_from_collection(openslide_t *osr,
       struct area *area = l->areas->pdata[area_num];
       area->offset_x = area->offset_x / l->nm_per_pixel;
       area->offset_y = area->offset_y / l->nm_per_pixel;
+      _openslide_grid_set_origin(area->grid, area->offset_x, area->offset_y);
     }
   }
 
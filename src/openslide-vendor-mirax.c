@@ -225,7 +225,7 @@ static uint32_t *read_image(openslide_t *osr,
   struct mirax_ops_data *data = osr->data;
   bool result = false;
 
-  uint32_t *dest = g_slice_alloc(w * h * 4);
+  uint32_t *dest = _openslide_slab_alloc(w * h * 4);
 
   switch (format) {
   case FORMAT_JPEG:
@@ -252,7 +252,7 @@ static uint32_t *read_image(openslide_t *osr,
   }
 
   if (!result) {
-    g_slice_free1(w * h * 4, dest);
+    _openslide_slab_free(w * h * 4, dest);
     return NULL;
   }
   return dest;
@@ -281,6 +281,7 @@ static bool read_tile(openslide_t *osr,
                                             level,
                                             tile->image->imageno,
                                             0,
+                                            iw * ih * 4,
                                             &cache_entry);
 
   if (!tiledata) {
@@ -301,6 +302,7 @@ static bool read_tile(openslide_t *osr,
                                                                  CAIRO_FORMAT_RGB24,
                                                                  iw, ih,
                                                                  iw * 4);
+  _openslide_cairo_mark_solid(surface, cache_entry);
 
   // if we are drawing a subregion of the tile, we must do an additional copy,
   // because cairo lacks source clipping
@@ -324,9 +326,8 @@ static bool read_tile(openslide_t *osr,
     cairo_destroy(cr2);
   }
 
-  cairo_set_source_surface(cr, surface, 0, 0);
+  _openslide_cairo_paint_surface(cr, surface);
   cairo_surface_destroy(surface);
-  cairo_paint(cr);
 
   // done with the cache entry, release it
   _openslide_cache_entry_unref(cache_entry);
@@ -348,6 +349,17 @@ static bool paint_region(openslide_t *osr G_GNUC_UNUSED, cairo_t *cr,
                                       err);
 }
 
+static bool get_tile(openslide_t *osr G_GNUC_UNUSED,
+                     struct _openslide_level *level,
+                     int64_t col, int64_t row,
+                     struct _openslide_tile **tile,
+                     GError **err) {
+  struct level *l = (struct level *) level;
+
+  return _openslide_grid_get_tile(l->grid, NULL, level,
+                                  col, row, tile, err);
+}
+
 static void destroy(openslide_t *osr) {
   struct mirax_ops_data *data = osr->data;
 
@@ -368,6 +380,7 @@ static void destroy(openslide_t *osr) {
 
 static const struct _openslide_ops mirax_ops = {
   .paint_region = paint_region,
+  .get_tile = get_tile,
   .destroy = destroy,
 };
 
@@ -136,6 +136,7 @@ static bool render_missing_tile(struct level *l,
 
 static bool decode_tile(struct level *l,
                         TIFF *tiff,
+                        struct _openslide_cache_binding *cb,
                         uint32_t *dest,
                         int64_t tile_col, int64_t tile_row,
                         GError **err) {
@@ -160,7 +161,7 @@ static bool decode_tile(struct level *l,
     break;
   default:
     // not for us? fallback
-    return _openslide_tiff_read_tile(tiffl, tiff, dest,
+    return _openslide_tiff_read_tile(tiffl, tiff, cb, l, dest,
                                      tile_col, tile_row,
                                      err);
   }
@@ -168,7 +169,7 @@ static bool decode_tile(struct level *l,
   // read raw tile
   void *buf;
   int32_t buflen;
-  if (!_openslide_tiff_read_tile_data(tiffl, tiff,
+  if (!_openslide_tiff_read_tile_data(tiffl, tiff, cb, l,
                                       &buf, &buflen,
                                       tile_col, tile_row,
                                       err)) {
@@ -206,11 +207,12 @@ static bool read_tile(openslide_t *osr,
   struct _openslide_cache_entry *cache_entry;
   uint32_t *tiledata = _openslide_cache_get(osr->cache,
                                             level, tile_col, tile_row,
+                                            tw * th * 4,
                                             &cache_entry);
   if (!tiledata) {
-    tiledata = g_slice_alloc(tw * th * 4);
-    if (!decode_tile(l, tiff, tiledata, tile_col, tile_row, err)) {
-      g_slice_free1(tw * th * 4, tiledata);
+    tiledata = _openslide_slab_alloc(tw * th * 4);
+    if (!decode_tile(l, tiff, osr->cache, tiledata, tile_col, tile_row, err)) {
+      _openslide_slab_free(tw * th * 4, tiledata);
       return false;
     }
 
@@ -218,7 +220,7 @@ static bool read_tile(openslide_t *osr,
     if (!_openslide_tiff_clip_tile(tiffl, tiledata,
                                    tile_col, tile_row,
                                    err)) {
-      g_slice_free1(tw * th * 4, tiledata);
+      _openslide_slab_free(tw * th * 4, tiledata);
       return false;
     }
 
@@ -233,9 +235,9 @@ static bool read_tile(openslide_t *osr,
 								 CAIRO_FORMAT_ARGB32,
 								 tw, th,
 								 tw * 4);
-  cairo_set_source_surface(cr, surface, 0, 0);
+  _openslide_cairo_mark_solid(surface, cache_entry);
+  _openslide_cairo_paint_surface(cr, surface);
   cairo_surface_destroy(surface);
-  cairo_paint(cr);
 
   // done with the cache entry, release it
   _openslide_cache_entry_unref(cache_entry);
@@ -266,8 +268,52 @@ static bool paint_region(openslide_t *osr, cairo_t *cr,
   return success;
 }
 
+static bool get_tile(openslide_t *osr,
+                     struct _openslide_level *level,
+                     int64_t col, int64_t row,
+                     struct _openslide_tile **tile,
+                     GError **err) {
+  struct aperio_ops_data *data = osr->data;
+  struct level *l = (struct level *) level;
+
+  TIFF *tiff = _openslide_tiffcache_get(data->tc, err);
+  if (tiff == NULL) {
+    return false;
+  }
+
+  bool success = _openslide_grid_get_tile(l->grid, tiff, level,
+                                          col, row, tile, err);
+  _openslide_tiffcache_put(data->tc, tiff);
+
+  return success;
+}
+
+static bool read_raw_tile(openslide_t *osr,
+                          struct _openslide_level *level,
+                          int64_t col, int64_t row,
+                          void **buf, int32_t *len,
+                          GError **err) {
+  struct aperio_ops_data *data = osr->data;
+  struct level *l = (struct level *) level;
+
+  TIFF *tiff = _openslide_tiffcache_get(data->tc, err);
+  if (tiff == NULL) {
+    return false;
+  }
+
+  bool success = _openslide_tiff_read_raw_tile(&l->tiffl, tiff,
+                                               osr->cache, level,
+                                               buf, len, col, row,
+                                               err);
+  _openslide_tiffcache_put(data->tc, tiff);
+
+  return success;
+}
+
 static const struct _openslide_ops aperio_ops = {
   .paint_region = paint_region,
+  .get_tile = get_tile,
+  .read_raw_tile = read_raw_tile,
   .destroy = destroy,
 };
 
@@ -424,7 +470,7 @@ static bool test_tile_decoding(struct level *l,
   int64_t th = l->tiffl.tile_h;
 
   uint32_t *dest = g_slice_alloc(tw * th * 4);
-  bool ok = decode_tile(l, tiff, dest, 0, 0, err);
+  bool ok = decode_tile(l, tiff, NULL, dest, 0, 0, err);
   g_slice_free1(tw * th * 4, dest);
   return ok;
 }
@@ -375,9 +375,10 @@ static bool read_tile(openslide_t *osr,
   struct _openslide_cache_entry *cache_entry;
   uint32_t *tiledata = _openslide_cache_get(osr->cache,
                                             level, tile_col, tile_row,
+                                            tile_size * tile_size * 4,
                                             &cache_entry);
   if (!tiledata) {
-    tiledata = g_slice_alloc(tile_size * tile_size * 4);
+    tiledata = _openslide_slab_alloc(tile_size * tile_size * 4);
 
     // read tile
     if (!read_image(tiledata, tile_col, tile_row, l->base.downsample,
@@ -389,7 +390,7 @@ static bool read_tile(openslide_t *osr,
         return true;
       } else {
         g_propagate_error(err, tmp_err);
-        g_slice_free1(tile_size * tile_size * 4, tiledata);
+        _openslide_slab_free(tile_size * tile_size * 4, tiledata);
         return false;
       }
     }
@@ -400,7 +401,7 @@ static bool read_tile(openslide_t *osr,
                               l->base.w - tile_col * tile_size,
                               l->base.h - tile_row * tile_size,
                               err)) {
-      g_slice_free1(tile_size * tile_size * 4, tiledata);
+      _openslide_slab_free(tile_size * tile_size * 4, tiledata);
       return false;
     }
 
@@ -416,9 +417,9 @@ static bool read_tile(openslide_t *osr,
                                                                  CAIRO_FORMAT_ARGB32,
                                                                  tile_size, tile_size,
                                                                  tile_size * 4);
-  cairo_set_source_surface(cr, surface, 0, 0);
+  _openslide_cairo_mark_solid(surface, cache_entry);
+  _openslide_cairo_paint_surface(cr, surface);
   cairo_surface_destroy(surface);
-  cairo_paint(cr);
 
   // done with the cache entry, release it
   _openslide_cache_entry_unref(cache_entry);
@@ -454,8 +455,34 @@ FAIL:
   return success;
 }
 
+static bool get_tile(openslide_t *osr,
+                     struct _openslide_level *level,
+                     int64_t col, int64_t row,
+                     struct _openslide_tile **tile,
+                     GError **err) {
+  struct sakura_ops_data *data = osr->data;
+  struct level *l = (struct level *) level;
+  sqlite3_stmt *stmt = NULL;
+  bool success = false;
+
+  sqlite3 *db = _openslide_sqlite_open(data->filename, err);
+  if (!db) {
+    return false;
+  }
+  PREPARE_OR_FAIL(stmt, db, data->data_sql);
+
+  success = _openslide_grid_get_tile(l->grid, stmt, level,
+                                     col, row, tile, err);
+
+FAIL:
+  sqlite3_finalize(stmt);
+  _openslide_sqlite_close(db);
+  return success;
+}
+
 static const struct _openslide_ops sakura_ops = {
   .paint_region = paint_region,
+  .get_tile = get_tile,
   .destroy = destroy,
 };
 
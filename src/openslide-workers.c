@@ -0,0 +1,646 @@
+/*
+ *  OpenSlide, a library for reading whole slide image files
+ *
+ *  Copyright (c) 2026 OpenSlide contributors
+ *  All rights reserved.
+ *
+ *  OpenSlide is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, version 2.1.
+ *
+ *  OpenSlide is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with OpenSlide. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Parallel tile decoding.
+ *
+ * Grids decode and paint the tiles of a region one at a time on the
+ * calling thread.  Rather than teach every vendor to decode
+ * concurrently, split a large region into tile-sized pieces and have
+ * worker threads paint each piece into an empty surface.  The tiles end
+ * up decoded, and retained by a cache batch, so the caller's ordinary
+ * paint finds every tile ready and composites them in the usual order.
+ * Workers go through the vendor's paint_region, so each one takes its
+ * own TIFF handle, database connection, etc.; tiles shared between
+ * pieces are decoded once, by whichever worker claims them first.  A
+ * region is decoded and painted in bands of whole tile rows, so that
+ * the batch only ever holds a band or two of tiles.
+ *
+ * The pool, sized by openslide_set_thread_count(), is shared by all
+ * slides and also runs batched reads.  A pool thread never waits on the
+ * pool: work it starts runs serially on that thread.
+ *
+ * Prefetch hints are decoded the same way, into the slide's cache, by
+ * background jobs on the pool, one piece at a time and one job per slide
+ * at a time.  Background jobs wait for queued foreground work, and a
+ * slide's prefetcher stops while any region of the slide is being
+ * painted.  The newest hint is decoded first, and only a bounded number
+ * of pieces are kept pending; older pieces are dropped beyond that.
+ */
+
+#include <config.h>
+
+#include "openslide-private.h"
+
+#include <math.h>
+#include <glib.h>
+#include <cairo.h>
+
+// piece size for levels without tile geometry
+#define DEFAULT_PIECE_SIZE 256
+
+// decoded bytes of the tiles in a band, at most, unless a single row of
+// tiles is larger
+#define BAND_TILE_BYTES (16 * 1024 * 1024)
+
+// pieces of prefetch hints pending per slide, at most
+#define PREFETCH_MAX_PIECES 256
+
+static GMutex *workers_mutex;
+static GThreadPool *workers;  // NULL until first needed
+static int32_t worker_count = 1;
+static uint64_t next_job_seq;
+
+// a job on the shared pool
+struct job {
+  void (*run)(void *data);
+  void *data;
+  bool background;
+  uint64_t seq;  // jobs of equal priority run in order
+};
+
+// set on the pool's threads
+static GStaticPrivate thread_is_worker = G_STATIC_PRIVATE_INIT;
+
+// jobs run by a thread together with the caller
+struct run_group {
+  void (*run)(void *data);
+  void *data;
+
+  GMutex *mutex;
+  GCond *cond;
+  int32_t pending;
+};
+
+// pieces of one region
+struct decode_group {
+  openslide_t *osr;
+  struct _openslide_level *level;
+  struct _openslide_cache_batch *batch;
+  volatile gint *cancelled;  // the caller's, or NULL
+  struct _openslide_deadline *deadline;  // the caller's, or NULL
+  struct _openslide_tissue_mask *skip_mask;  // the caller's, or NULL
+
+  GMutex *mutex;
+  GCond *cond;
+  int64_t pending;
+};
+
+struct decode_piece {
+  struct decode_group *group;
+  int64_t x;  // level 0 plane
+  int64_t y;
+  int32_t w;  // level plane
+  int32_t h;
+};
+
+// per-slide prefetcher
+struct _openslide_prefetch {
+  GMutex *mutex;
+  GCond *idle_cond;  // signalled when the prefetcher's job finishes
+  GQueue *pieces;  // struct prefetch_piece, newest hint first
+  GHashTable *hints;  // id -> struct prefetch_hint, until finished
+  int next_id;
+  int foreground;  // regions being painted
+  bool scheduled;  // a job is queued or running on the pool
+  bool destroying;
+};
+
+struct prefetch_hint {
+  int id;
+  int64_t pending;  // pieces not yet decoded or dropped
+  volatile gint cancelled;
+};
+
+struct prefetch_piece {
+  openslide_t *osr;
+  struct prefetch_hint *hint;
+  struct _openslide_level *level;
+  int64_t x;  // level 0 plane
+  int64_t y;
+  int32_t w;  // level plane
+  int32_t h;
+};
+
+// pieces of a region, aligned to the tile grid in the level plane
+struct piece_grid {
+  struct _openslide_level *level;
+  int64_t x;
+  int64_t y;
+  int64_t w;
+  int64_t h;
+
+  int64_t piece_w;
+  int64_t piece_h;
+  int64_t start_col;
+  int64_t start_row;
+  int64_t end_col;
+  int64_t end_row;
+};
+
+static void piece_grid_init(struct piece_grid *pg,
+                            struct _openslide_level *level,
+                            int64_t x, int64_t y, int64_t w, int64_t h) {
+  pg->level = level;
+  pg->x = x;
+  pg->y = y;
+  pg->w = w;
+  pg->h = h;
+  pg->piece_w = level->tile_w > 0 ? level->tile_w : DEFAULT_PIECE_SIZE;
+  pg->piece_h = level->tile_h > 0 ? level->tile_h : DEFAULT_PIECE_SIZE;
+  int64_t lx = x / level->downsample;
+  int64_t ly = y / level->downsample;
+  pg->start_col = lx / pg->piece_w;
+  pg->start_row = ly / pg->piece_h;
+  pg->end_col = (lx + w + pg->piece_w - 1) / pg->piece_w;
+  pg->end_row = (ly + h + pg->piece_h - 1) / pg->piece_h;
+}
+
+static int64_t piece_grid_count(const struct piece_grid *pg) {
+  return (pg->end_col - pg->start_col) * (pg->end_row - pg->start_row);
+}
+
+// compute the piece at col, row, clipped to the region.  round interior
+// edges up, so a piece doesn't reach back into the previous tile.
+static void piece_grid_get(const struct piece_grid *pg,
+                           int64_t col, int64_t row,
+                           int64_t *x, int64_t *y, int32_t *w, int32_t *h) {
+  double ds = pg->level->downsample;
+  int64_t lx = pg->x / ds;
+  int64_t ly = pg->y / ds;
+  int64_t px = MAX(col * pg->piece_w, lx);
+  int64_t py = MAX(row * pg->piece_h, ly);
+  *x = px == lx ? pg->x : ceil(px * ds);
+  *y = py == ly ? pg->y : ceil(py * ds);
+  *w = MIN((col + 1) * pg->piece_w, lx + pg->w) - px;
+  *h = MIN((row + 1) * pg->piece_h, ly + pg->h) - py;
+}
+
+// paint into nothing; we only want the tiles decoded.  errors will
+// recur, and be reported, when the tiles are read.
+static void decode_only(openslide_t *osr, struct _openslide_level *level,
+                        int64_t x, int64_t y, int32_t w, int32_t h) {
+  cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                                        0, 0);
+  cairo_t *cr = cairo_create(surface);
+  cairo_surface_destroy(surface);
+  cairo_set_operator(cr, CAIRO_OPERATOR_SATURATE);
+  osr->ops->paint_region(osr, cr, x, y, level, w, h, NULL);
+  cairo_destroy(cr);
+}
+
+static gpointer workers_init(gpointer data G_GNUC_UNUSED) {
+  workers_mutex = g_mutex_new();
+  return NULL;
+}
+
+static GMutex *get_workers_mutex(void) {
+  static GOnce once = G_ONCE_INIT;
+  g_once(&once, workers_init, NULL);
+  return workers_mutex;
+}
+
+static void decode_piece(void *data) {
+  struct decode_piece *piece = data;
+  struct decode_group *group = piece->group;
+
+  _openslide_cache_batch_enter(group->batch);
+  _openslide_cancel_enter(group->cancelled);
+  _openslide_deadline_enter(group->deadline, false);
+  _openslide_tissue_skip_enter(group->skip_mask);
+  decode_only(group->osr, group->level, piece->x, piece->y,
+              piece->w, piece->h);
+  _openslide_tissue_skip_leave();
+  _openslide_deadline_leave();
+  _openslide_cancel_leave();
+  _openslide_cache_batch_leave();
+  g_slice_free(struct decode_piece, piece);
+
+  g_mutex_lock(group->mutex);
+  if (--group->pending == 0) {
+    g_cond_signal(group->cond);
+  }
+  g_mutex_unlock(group->mutex);
+}
+
+static void run_job(gpointer data, gpointer user_data G_GNUC_UNUSED) {
+  struct job *job = data;
+  g_static_private_set(&thread_is_worker, GINT_TO_POINTER(1), NULL);
+  job->run(job->data);
+  g_slice_free(struct job, job);
+}
+
+// foreground jobs first, then in order of submission
+static gint compare_jobs(gconstpointer a, gconstpointer b,
+                         gpointer user_data G_GNUC_UNUSED) {
+  const struct job *ja = a;
+  const struct job *jb = b;
+  if (ja->background != jb->background) {
+    return ja->background ? 1 : -1;
+  }
+  if (ja->seq != jb->seq) {
+    return ja->seq < jb->seq ? -1 : 1;
+  }
+  return 0;
+}
+
+void _openslide_workers_set_count(int32_t count) {
+  GMutex *mutex = get_workers_mutex();
+  g_mutex_lock(mutex);
+  worker_count = MAX(count, 1);
+  if (workers) {
+    g_thread_pool_set_max_threads(workers, worker_count, NULL);
+  }
+  g_mutex_unlock(mutex);
+}
+
+int32_t _openslide_workers_get_count(void) {
+  GMutex *mutex = get_workers_mutex();
+  g_mutex_lock(mutex);
+  int32_t count = worker_count;
+  g_mutex_unlock(mutex);
+  return count;
+}
+
+bool _openslide_workers_is_worker(void) {
+  return g_static_private_get(&thread_is_worker) != NULL;
+}
+
+void _openslide_workers_submit(void (*run)(void *data), void *data,
+                               bool background) {
+  struct job *job = g_slice_new(struct job);
+  job->run = run;
+  job->data = data;
+  job->background = background;
+
+  GMutex *mutex = get_workers_mutex();
+  g_mutex_lock(mutex);
+  if (workers == NULL) {
+    workers = g_thread_pool_new(run_job, NULL, worker_count, false, NULL);
+    g_thread_pool_set_sort_function(workers, compare_jobs, NULL);
+  }
+  job->seq = next_job_seq++;
+  g_thread_pool_push(workers, job, NULL);
+  g_mutex_unlock(mutex);
+}
+
+static void run_group_job(void *data) {
+  struct run_group *group = data;
+  group->run(group->data);
+
+  g_mutex_lock(group->mutex);
+  if (--group->pending == 0) {
+    g_cond_signal(group->cond);
+  }
+  g_mutex_unlock(group->mutex);
+}
+
+void _openslide_workers_run(void (*run)(void *data), void *data,
+                            int32_t count) {
+  // a worker waiting on other jobs could wait forever
+  int32_t helpers = 0;
+  if (!_openslide_workers_is_worker()) {
+    helpers = CLAMP(count - 1, 0, _openslide_workers_get_count());
+  }
+
+  struct run_group group = {
+    .run = run,
+    .data = data,
+    .mutex = g_mutex_new(),
+    .cond = g_cond_new(),
+    .pending = helpers,
+  };
+  for (int32_t i = 0; i < helpers; i++) {
+    _openslide_workers_submit(run_group_job, &group, false);
+  }
+  run(data);
+
+  g_mutex_lock(group.mutex);
+  while (group.pending) {
+    g_cond_wait(group.cond, group.mutex);
+  }
+  g_mutex_unlock(group.mutex);
+  g_cond_free(group.cond);
+  g_mutex_free(group.mutex);
+}
+
+// whether a region should be decoded in parallel
+static bool use_workers(void) {
+  return _openslide_workers_get_count() > 1 &&
+         !_openslide_workers_is_worker();
+}
+
+static void prefetch_schedule(struct _openslide_prefetch *pf);
+
+static void prefetch_pause(openslide_t *osr) {
+  struct _openslide_prefetch *pf = osr->prefetch;
+  g_mutex_lock(pf->mutex);
+  pf->foreground++;
+  g_mutex_unlock(pf->mutex);
+}
+
+static void prefetch_resume(openslide_t *osr) {
+  struct _openslide_prefetch *pf = osr->prefetch;
+  g_mutex_lock(pf->mutex);
+  if (--pf->foreground == 0) {
+    prefetch_schedule(pf);
+  }
+  g_mutex_unlock(pf->mutex);
+}
+
+// decode the tiles of a region on the pool, into batch
+static void decode_region(openslide_t *osr,
+                          struct _openslide_cache_batch *batch,
+                          struct _openslide_level *level,
+                          int64_t x, int64_t y, int64_t w, int64_t h) {
+  struct piece_grid pg;
+  piece_grid_init(&pg, level, x, y, w, h);
+
+  struct decode_group group = {
+    .osr = osr,
+    .level = level,
+    .batch = batch,
+    .cancelled = _openslide_cancel_get_current(),
+    .deadline = _openslide_deadline_get_current(),
+    .skip_mask = _openslide_tissue_skip_get_current(),
+    .mutex = g_mutex_new(),
+    .cond = g_cond_new(),
+    .pending = piece_grid_count(&pg),
+  };
+  for (int64_t row = pg.start_row; row < pg.end_row; row++) {
+    for (int64_t col = pg.start_col; col < pg.end_col; col++) {
+      struct decode_piece *piece = g_slice_new(struct decode_piece);
+      piece->group = &group;
+      piece_grid_get(&pg, col, row,
+                     &piece->x, &piece->y, &piece->w, &piece->h);
+      _openslide_workers_submit(decode_piece, piece, false);
+    }
+  }
+
+  g_mutex_lock(group.mutex);
+  while (group.pending) {
+    g_cond_wait(group.cond, group.mutex);
+  }
+  g_mutex_unlock(group.mutex);
+  g_cond_free(group.cond);
+  g_mutex_free(group.mutex);
+}
+
+static bool paint_bands(openslide_t *osr,
+                        const struct piece_grid *pg, cairo_t *cr,
+                        GError **err) {
+  // if we're already reading for a batch, the tiles go there.  otherwise
+  // they must survive until we paint them, however small the cache.
+  struct _openslide_cache_batch *own_batch = NULL;
+  struct _openslide_cache_batch *batch = _openslide_cache_batch_get_current();
+  if (batch == NULL) {
+    batch = own_batch = _openslide_cache_batch_create();
+    _openslide_cache_batch_enter(own_batch);
+  }
+
+  // whole rows of tiles
+  int64_t row_bytes = (pg->end_col - pg->start_col) *
+                      pg->piece_w * pg->piece_h * 4;
+  int64_t band_h = MAX(BAND_TILE_BYTES / row_bytes, 1) * pg->piece_h;
+
+  bool success = true;
+  double ds = pg->level->downsample;
+  for (int64_t by = 0; success && by < pg->h; by += band_h) {
+    int64_t bh = MIN(band_h, pg->h - by);  // level plane
+    int64_t y = pg->y + by * ds;  // level 0 plane
+    decode_region(osr, batch, pg->level, pg->x, y, pg->w, bh);
+
+    if (bh == pg->h) {
+      success = osr->ops->paint_region(osr, cr, pg->x, y, pg->level,
+                                       pg->w, bh, err);
+    } else {
+      // y was rounded down, so offset by the exact difference to keep
+      // tiles where a single paint would put them
+      double offset = (y - pg->y) / ds;
+      cairo_save(cr);
+      cairo_rectangle(cr, 0, by, pg->w, bh);
+      cairo_clip(cr);
+      cairo_translate(cr, 0, offset);
+      success = osr->ops->paint_region(osr, cr, pg->x, y, pg->level,
+                                       pg->w, ceil(by + bh - offset), err);
+      cairo_restore(cr);
+    }
+
+    // keep only tiles the next band might share
+    if (own_batch) {
+      _openslide_cache_batch_age(own_batch);
+    }
+  }
+
+  if (own_batch) {
+    _openslide_cache_batch_leave();
+    _openslide_cache_batch_destroy(own_batch);
+  }
+  return success;
+}
+
+bool _openslide_workers_paint_region(openslide_t *osr,
+                                     cairo_t *cr,
+                                     int64_t x, int64_t y,
+                                     struct _openslide_level *level,
+                                     int64_t w, int64_t h,
+                                     GError **err) {
+  prefetch_pause(osr);
+
+  struct piece_grid pg;
+  piece_grid_init(&pg, level, x, y, w, h);
+  bool success;
+  if (piece_grid_count(&pg) >= 2 && use_workers()) {
+    success = paint_bands(osr, &pg, cr, err);
+  } else {
+    success = osr->ops->paint_region(osr, cr, x, y, level, w, h, err);
+  }
+
+  prefetch_resume(osr);
+  return success;
+}
+
+// prefetch mutex must be held
+static void prefetch_piece_done(struct _openslide_prefetch *pf,
+                                struct prefetch_piece *piece) {
+  struct prefetch_hint *hint = piece->hint;
+  if (--hint->pending == 0) {
+    g_hash_table_remove(pf->hints, &hint->id);
+    g_slice_free(struct prefetch_hint, hint);
+  }
+  g_slice_free(struct prefetch_piece, piece);
+}
+
+static void prefetch_run(void *data) {
+  struct _openslide_prefetch *pf = data;
+
+  g_mutex_lock(pf->mutex);
+  struct prefetch_piece *piece = NULL;
+  if (!pf->foreground && !pf->destroying) {
+    piece = g_queue_pop_head(pf->pieces);
+  }
+  g_mutex_unlock(pf->mutex);
+
+  if (piece) {
+    struct prefetch_hint *hint = piece->hint;
+    _openslide_cancel_enter(&hint->cancelled);
+    decode_only(piece->osr, piece->level, piece->x, piece->y,
+                piece->w, piece->h);
+    _openslide_cancel_leave();
+  }
+
+  // requeue, behind any foreground work queued meanwhile
+  g_mutex_lock(pf->mutex);
+  if (piece) {
+    prefetch_piece_done(pf, piece);
+  }
+  pf->scheduled = false;
+  prefetch_schedule(pf);
+  if (!pf->scheduled) {
+    g_cond_broadcast(pf->idle_cond);
+  }
+  g_mutex_unlock(pf->mutex);
+}
+
+// prefetch mutex must be held
+static void prefetch_schedule(struct _openslide_prefetch *pf) {
+  if (!pf->scheduled && !pf->foreground && !pf->destroying &&
+      !g_queue_is_empty(pf->pieces)) {
+    pf->scheduled = true;
+    _openslide_workers_submit(prefetch_run, pf, true);
+  }
+}
+
+struct _openslide_prefetch *_openslide_prefetch_create(void) {
+  struct _openslide_prefetch *pf = g_slice_new0(struct _openslide_prefetch);
+  pf->mutex = g_mutex_new();
+  pf->idle_cond = g_cond_new();
+  pf->pieces = g_queue_new();
+  pf->hints = g_hash_table_new(g_int_hash, g_int_equal);
+  pf->next_id = 1;
+  return pf;
+}
+
+int _openslide_prefetch_add(openslide_t *osr,
+                            struct _openslide_level *level,
+                            int64_t x, int64_t y,
+                            int64_t w, int64_t h) {
+  struct _openslide_prefetch *pf = osr->prefetch;
+  struct piece_grid pg;
+  piece_grid_init(&pg, level, x, y, w, h);
+
+  g_mutex_lock(pf->mutex);
+  int id = pf->next_id++;
+  int64_t count = MIN(piece_grid_count(&pg), PREFETCH_MAX_PIECES);
+  if (w > 0 && h > 0 && count > 0) {
+    struct prefetch_hint *hint = g_slice_new0(struct prefetch_hint);
+    hint->id = id;
+    hint->pending = count;
+    g_hash_table_insert(pf->hints, &hint->id, hint);
+
+    // ahead of older hints, in raster order
+    GList *pieces = NULL;
+    int64_t queued = 0;
+    for (int64_t row = pg.start_row; row < pg.end_row && queued < count;
+         row++) {
+      for (int64_t col = pg.start_col; col < pg.end_col && queued < count;
+           col++, queued++) {
+        struct prefetch_piece *piece = g_slice_new(struct prefetch_piece);
+        piece->osr = osr;
+        piece->hint = hint;
+        piece->level = level;
+        piece_grid_get(&pg, col, row,
+                       &piece->x, &piece->y, &piece->w, &piece->h);
+        pieces = g_list_prepend(pieces, piece);
+      }
+    }
+    for (GList *cur = pieces; cur; cur = cur->next) {
+      g_queue_push_head(pf->pieces, cur->data);
+    }
+    g_list_free(pieces);
+
+    // drop the stalest pieces
+    while (g_queue_get_length(pf->pieces) > PREFETCH_MAX_PIECES) {
+      prefetch_piece_done(pf, g_queue_pop_tail(pf->pieces));
+    }
+    prefetch_schedule(pf);
+  }
+  g_mutex_unlock(pf->mutex);
+  return id;
+}
+
+// prefetch mutex must be held
+static void drop_hint_pieces(struct _openslide_prefetch *pf,
+                             struct prefetch_hint *hint) {
+  g_atomic_int_set(&hint->cancelled, 1);
+  GList *cur = pf->pieces->head;
+  while (cur) {
+    GList *next = cur->next;
+    struct prefetch_piece *piece = cur->data;
+    if (piece->hint == hint) {
+      g_queue_delete_link(pf->pieces, cur);
+      prefetch_piece_done(pf, piece);
+    }
+    cur = next;
+  }
+}
+
+static void cancel_hint(gpointer key G_GNUC_UNUSED, gpointer value,
+                        gpointer user_data G_GNUC_UNUSED) {
+  struct prefetch_hint *hint = value;
+  g_atomic_int_set(&hint->cancelled, 1);
+}
+
+void _openslide_prefetch_cancel(openslide_t *osr, int id) {
+  struct _openslide_prefetch *pf = osr->prefetch;
+  g_mutex_lock(pf->mutex);
+  struct prefetch_hint *hint = g_hash_table_lookup(pf->hints, &id);
+  if (hint) {
+    drop_hint_pieces(pf, hint);
+  }
+  g_mutex_unlock(pf->mutex);
+}
+
+void _openslide_prefetch_destroy(struct _openslide_prefetch *pf) {
+  // abandon queued work, then wait for the piece being decoded
+  g_mutex_lock(pf->mutex);
+  pf->destroying = true;
+  g_hash_table_foreach(pf->hints, cancel_hint, NULL);
+  while (!g_queue_is_empty(pf->pieces)) {
+    prefetch_piece_done(pf, g_queue_pop_head(pf->pieces));
+  }
+  while (pf->scheduled) {
+    g_cond_wait(pf->idle_cond, pf->mutex);
+  }
+  g_mutex_unlock(pf->mutex);
+
+  g_queue_free(pf->pieces);
+  g_hash_table_destroy(pf->hints);
+  g_cond_free(pf->idle_cond);
+  g_mutex_free(pf->mutex);
+  g_slice_free(struct _openslide_prefetch, pf);
+}
+
+// public API
+
+void openslide_set_thread_count(int32_t count) {
+  _openslide_workers_set_count(count);
+}
@@ -42,68 +42,6 @@ static bool ensure_nonnegative_dimensions(openslide_t *osr, int64_t w, int64_t h
   return true;
 }
 
-static bool read_region(openslide_t *osr,
-			cairo_t *cr,
-			int64_t x, int64_t y,
-			int32_t zlevel, int32_t level,
-			int64_t w, int64_t h,
-			GError **err) {
-  bool success = true;
-
-  // save the old pattern, it's the only thing push/pop won't restore
-  cairo_pattern_t *old_source = cairo_get_source(cr);
-  cairo_pattern_reference(old_source);
-
-  // push, so that saturate works with all sorts of backends
-  cairo_push_group(cr);
-
-  // clear to set the bounds of the group (seems to be a recent cairo bug)
-  cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
-  cairo_rectangle(cr, 0, 0, w, h);
-  cairo_fill(cr);
-
-  // saturate those seams away!
-  cairo_set_operator(cr, CAIRO_OPERATOR_SATURATE);
-
-  if (valid_level(osr, zlevel, level)) {
-    struct _openslide_level *l = osr->zlevels[zlevel]->levels[level];
-
-    // offset if given negative coordinates
-    double ds = l->downsample;
-    int64_t tx = 0;
-    int64_t ty = 0;
-    if (x < 0) {
-      tx = (-x) / ds;
-      x = 0;
-      w -= tx;
-    }
-    if (y < 0) {
-      ty = (-y) / ds;
-      y = 0;
-      h -= ty;
-    }
-    cairo_translate(cr, tx, ty);
-
-    // paint
-    if (w > 0 && h > 0) {
-      success = osr->ops->paint_region(osr, cr, x, y, l, w, h, err);
-    }
-  }
-
-  cairo_pop_group_to_source(cr);
-
-  if (success) {
-    // commit, nothing went wrong
-    cairo_paint(cr);
-  }
-
-  // restore old source
-  cairo_set_source(cr, old_source);
-  cairo_pattern_destroy(old_source);
-
-  return success;
-}
-
 ///////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////
@@ -183,78 +121,38 @@ int32_t osz_get_best_level_for_downsample(openslide_t *osr, int32_t zlevel, doub
 }
 
 void osz_read_region(openslide_t *osr, uint32_t *dest, int32_t zlevel, int64_t x, int64_t y, int32_t level, int64_t w, int64_t h) {
+  osz_read_region_format(osr, dest, OPENSLIDE_PIXEL_FORMAT_ARGB32_PREMULTIPLIED, 0, zlevel, x, y, level, w, h);
+}
+
+void osz_read_region_format(openslide_t *osr, void *dest, enum openslide_pixel_format format, int64_t stride, int32_t zlevel, int64_t x, int64_t y, int32_t level, int64_t w, int64_t h) {
   TIFFSetWarningHandler(NULL);
   GError *tmp_err = NULL;
 
   if (!ensure_nonnegative_dimensions(osr, w, h)) {
     return;
   }
+  if (!_openslide_pixel_format_check_stride(format, w, &stride, &tmp_err)) {
+    _openslide_propagate_error(osr, tmp_err);
+    return;
+  }
 
   // clear the dest
-  if (dest) {
-    memset(dest, 0, w * h * 4);
-  }
+  _openslide_clear_pixels(dest, format, stride, w, h);
 
   // now that it's cleared, return if an error occurred
   if (openslide_get_error(osr)) {
     return;
   }
 
-  // Break the work into smaller pieces if the region is large, because:
-  // 1. Cairo will not allow surfaces larger than 32767 pixels on a side.
-  // 2. cairo_push_group() creates an intermediate surface backed by a
-  //    pixman_image_t, and Pixman requires that every byte of that image
-  //    be addressable in 31 bits.
-  // 3. We would like to constrain the intermediate surface to a reasonable
-  //    amount of RAM.
-  const int64_t d = 4096;
-  double ds = osz_get_level_downsample(osr, zlevel, level);
-  for (int64_t row = 0; row < (h + d - 1) / d; row++) {
-    for (int64_t col = 0; col < (w + d - 1) / d; col++) {
-      // calculate surface coordinates and size
-      int64_t sx = x + col * d * ds;     // level 0 plane
-      int64_t sy = y + row * d * ds;     // level 0 plane
-      int64_t sw = MIN(w - col * d, d);  // level plane
-      int64_t sh = MIN(h - row * d, d);  // level plane
-
-      // create the cairo surface for the dest
-      cairo_surface_t *surface;
-      if (dest) {
-        surface = cairo_image_surface_create_for_data(
-                (unsigned char *) (dest + w * row * d + col * d),
-                CAIRO_FORMAT_ARGB32, sw, sh, w * 4);
-      } else {
-        // nil surface
-        surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 0, 0);
-      }
-
-      // create the cairo context
-      cairo_t *cr = cairo_create(surface);
-      cairo_surface_destroy(surface);
-
-      // paint
-      if (!read_region(osr, cr, sx, sy, zlevel, level, sw, sh, &tmp_err)) {
-        cairo_destroy(cr);
-        goto OUT;
-      }
-
-      // done
-      if (!_openslide_check_cairo_status(cr, &tmp_err)) {
-        cairo_destroy(cr);
-        goto OUT;
-      }
-
-      cairo_destroy(cr);
-    }
+  struct _openslide_level *l = NULL;
+  if (valid_level(osr, zlevel, level)) {
+    l = osr->zlevels[zlevel]->levels[level];
   }
-
-OUT:
-  if (tmp_err) {
+  if (!_openslide_read_level_region(osr, dest, format, stride, x, y, l, w, h,
+                                    &tmp_err)) {
     _openslide_propagate_error(osr, tmp_err);
-    if (dest) {
-      // ensure we don't return a partial result
-      memset(dest, 0, w * h * 4);
-    }
+    // ensure we don't return a partial result
+    _openslide_clear_pixels(dest, format, stride, w, h);
   }
 }
 
@@ -113,6 +113,27 @@ int32_t osz_get_best_level_for_downsample(openslide_t *osr, int32_t zlevel, doub
 OPENSLIDE_PUBLIC()
 void osz_read_region(openslide_t *osr, uint32_t *dest, int32_t zlevel, int64_t x, int64_t y, int32_t level, int64_t w, int64_t h);
 
+/**
+ * Copy a region of a whole slide image in a chosen pixel format.
+ *
+ * Like osz_read_region(), but the pixels are written in @p format with
+ * rows @p stride bytes apart; see openslide_read_region_format().
+ *
+ * @param osr The OpenSlide object.
+ * @param dest The destination buffer.
+ * @param format The pixel format to write.
+ * @param stride The distance between rows of @p dest in bytes, or 0 for
+ *               rows packed without padding.
+ * @param zlevel The desired zlevel
+ * @param x The top left x-coordinate, in the level 0 reference frame.
+ * @param y The top left y-coordinate, in the level 0 reference frame.
+ * @param level The desired level.
+ * @param w The width of the region. Must be non-negative.
+ * @param h The height of the region. Must be non-negative.
+ */
+OPENSLIDE_PUBLIC()
+void osz_read_region_format(openslide_t *osr, void *dest, enum openslide_pixel_format format, int64_t stride, int32_t zlevel, int64_t x, int64_t y, int32_t level, int64_t w, int64_t h);
+
 /**
  * Gets the region.  This is similar to read_region except for the fact that
  * it allocates the memory.
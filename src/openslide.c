@@ -26,6 +26,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 #include <glib.h>
 #include <glib-object.h>
@@ -91,6 +92,19 @@ static bool level_in_range(openslide_t *osr, int32_t level) {
   return true;
 }
 
+static gpointer create_default_cache(gpointer data G_GNUC_UNUSED) {
+  return _openslide_cache_create(_OPENSLIDE_USEFUL_CACHE_SIZE,
+                                 OPENSLIDE_CACHE_POLICY_LRU);
+}
+
+// process-wide cache used by handles until openslide_set_cache() is called;
+// never freed
+static struct _openslide_cache *get_default_cache(void) {
+  static GOnce once = G_ONCE_INIT;
+  g_once(&once, create_default_cache, NULL);
+  return once.retval;
+}
+
 static openslide_t *create_osr(void) {
   openslide_t *osr = g_slice_new0(openslide_t);
   osr->zlevel_count = -1;
@@ -99,6 +113,9 @@ static openslide_t *create_osr(void) {
   osr->associated_images = g_hash_table_new_full(g_str_hash, g_str_equal,
                                                  g_free,
                                                  destroy_associated_image);
+  osr->prefetch = _openslide_prefetch_create();
+  osr->thumbnail_mutex = g_mutex_new();
+  osr->tissue = _openslide_tissue_create();
   return osr;
 }
 
@@ -346,16 +363,21 @@ openslide_t *openslide_open(const char *filename) {
   osr->associated_image_names = strv_from_hashtable_keys(osr->associated_images);
   osr->property_names = strv_from_hashtable_keys(osr->properties);
 
-  // start cache
-  //osr->cache = _openslide_cache_create(_OPENSLIDE_USEFUL_CACHE_SIZE);
-  //osr->cache = _openslide_cache_create(512 * 512 * 2);
-  osr->cache = _openslide_cache_create(0);
+  // bind to the shared default cache, keyed by content so that other
+  // handles on the same slide hit the same tiles
+  const char *slide_id = g_hash_table_lookup(osr->properties,
+                                             OPENSLIDE_PROPERTY_NAME_QUICKHASH1);
+  osr->cache = _openslide_cache_binding_create(osr, slide_id,
+                                               get_default_cache());
 
   return osr;
 }
 
 
 void openslide_close(openslide_t *osr) {
+  // stop background decoding before the backend goes away
+  _openslide_prefetch_destroy(osr->prefetch);
+
   if (osr->ops) {
     (osr->ops->destroy)(osr);
   }
@@ -367,9 +389,17 @@ void openslide_close(openslide_t *osr) {
   g_free(osr->property_names);
 
   if (osr->cache) {
-    _openslide_cache_destroy(osr->cache);
+    _openslide_cache_binding_destroy(osr->cache);
+  }
+  if (osr->cache_planes) {
+    g_ptr_array_free(osr->cache_planes, true);
+    g_ptr_array_free(osr->cache_plane_levels, true);
   }
 
+  g_free(osr->thumbnail);
+  g_mutex_free(osr->thumbnail_mutex);
+  _openslide_tissue_destroy(osr->tissue);
+
   g_free(g_atomic_pointer_get(&osr->error));
 
   g_slice_free(openslide_t, osr);
@@ -427,26 +457,32 @@ int32_t openslide_get_layer_count(openslide_t *osr) {
 }
 
 
-int32_t openslide_get_best_level_for_downsample(openslide_t *osr,
-						double downsample) {
-  if (openslide_get_error(osr)) {
-    return -1;
-  }
-
+static int32_t get_best_level(struct _openslide_level **levels,
+                              int32_t level_count,
+                              double downsample) {
   // too small, return first
-  if (downsample < osr->levels[0]->downsample) {
+  if (downsample < levels[0]->downsample) {
     return 0;
   }
 
   // find where we are in the middle
-  for (int32_t i = 1; i < osr->level_count; i++) {
-    if (downsample < osr->levels[i]->downsample) {
+  for (int32_t i = 1; i < level_count; i++) {
+    if (downsample < levels[i]->downsample) {
       return i - 1;
     }
   }
 
   // too big, return last
-  return osr->level_count - 1;
+  return level_count - 1;
+}
+
+int32_t openslide_get_best_level_for_downsample(openslide_t *osr,
+						double downsample) {
+  if (openslide_get_error(osr)) {
+    return -1;
+  }
+
+  return get_best_level(osr->levels, osr->level_count, downsample);
 }
 
 int32_t openslide_get_best_layer_for_downsample(openslide_t *osr,
@@ -468,19 +504,40 @@ double openslide_get_layer_downsample(openslide_t *osr, int32_t level) {
 }
 
 
-int openslide_give_prefetch_hint(openslide_t *osr G_GNUC_UNUSED,
-				 int64_t x G_GNUC_UNUSED,
-				 int64_t y G_GNUC_UNUSED,
-				 int32_t level G_GNUC_UNUSED,
-				 int64_t w G_GNUC_UNUSED,
-				 int64_t h G_GNUC_UNUSED) {
-  g_warning("openslide_give_prefetch_hint has never been implemented and should not be called");
-  return 0;
-}
+// paint onto a clear surface with the SATURATE operator.  l may be
+// NULL for a nonexistent level, which paints nothing.
+static bool paint_level_region(openslide_t *osr,
+                               cairo_t *cr,
+                               int64_t x, int64_t y,
+                               struct _openslide_level *l,
+                               int64_t w, int64_t h,
+                               GError **err) {
+  bool success = true;
 
-void openslide_cancel_prefetch_hint(openslide_t *osr G_GNUC_UNUSED,
-				    int prefetch_id G_GNUC_UNUSED) {
-  g_warning("openslide_cancel_prefetch_hint has never been implemented and should not be called");
+  if (l) {
+    // offset if given negative coordinates
+    double ds = l->downsample;
+    int64_t tx = 0;
+    int64_t ty = 0;
+    if (x < 0) {
+      tx = (-x) / ds;
+      x = 0;
+      w -= tx;
+    }
+    if (y < 0) {
+      ty = (-y) / ds;
+      y = 0;
+      h -= ty;
+    }
+    cairo_translate(cr, tx, ty);
+
+    // paint, decoding the tiles in parallel
+    if (w > 0 && h > 0) {
+      success = _openslide_workers_paint_region(osr, cr, x, y, l, w, h, err);
+    }
+  }
+
+  return success;
 }
 
 static bool read_region(openslide_t *osr,
@@ -489,8 +546,6 @@ static bool read_region(openslide_t *osr,
 			int32_t level,
 			int64_t w, int64_t h,
 			GError **err) {
-  bool success = true;
-
   // save the old pattern, it's the only thing push/pop won't restore
   cairo_pattern_t *old_source = cairo_get_source(cr);
   cairo_pattern_reference(old_source);
@@ -506,30 +561,9 @@ static bool read_region(openslide_t *osr,
   // saturate those seams away!
   cairo_set_operator(cr, CAIRO_OPERATOR_SATURATE);
 
-  if (level_in_range(osr, level)) {
-    struct _openslide_level *l = osr->levels[level];
-
-    // offset if given negative coordinates
-    double ds = l->downsample;
-    int64_t tx = 0;
-    int64_t ty = 0;
-    if (x < 0) {
-      tx = (-x) / ds;
-      x = 0;
-      w -= tx;
-    }
-    if (y < 0) {
-      ty = (-y) / ds;
-      y = 0;
-      h -= ty;
-    }
-    cairo_translate(cr, tx, ty);
-
-    // paint
-    if (w > 0 && h > 0) {
-      success = osr->ops->paint_region(osr, cr, x, y, l, w, h, err);
-    }
-  }
+  struct _openslide_level *l =
+    level_in_range(osr, level) ? osr->levels[level] : NULL;
+  bool success = paint_level_region(osr, cr, x, y, l, w, h, err);
 
   cairo_pop_group_to_source(cr);
 
@@ -557,83 +591,546 @@ static bool ensure_nonnegative_dimensions(openslide_t *osr, int64_t w, int64_t h
   return true;
 }
 
+// read a region whose origin is at level 0 coordinates (x, y), which
+// may be fractional.  each piece is painted from whole level 0
+// coordinates, offset by the exact difference in the level plane, so
+// pieces line up however the downsample rounds.
+static bool read_level_region(openslide_t *osr,
+                              void *dest,
+                              enum openslide_pixel_format format,
+                              int64_t stride,
+                              double x, double y,
+                              struct _openslide_level *l,
+                              int64_t w, int64_t h,
+                              GError **err) {
+  // Break the work into smaller pieces if the region is large, because:
+  // 1. Cairo will not allow surfaces larger than 32767 pixels on a side.
+  // 2. Pixman requires that every byte of an image be addressable in 31
+  //    bits, and each piece is an image spanning the full dest stride.
+  // Pieces are the same whatever the format, so that a tile spanning
+  // pieces is fetched no more often than for ARGB.  Four-byte formats
+  // are painted into the dest and converted in place; others are painted
+  // into a scratch surface and converted into the dest.
+  const int64_t d = 4096;
+  int32_t bytes = _openslide_pixel_format_get_bytes(format);
+  bool direct = bytes == 4 && stride % 4 == 0;
+  uint32_t *scratch = NULL;
+  if (dest && !direct) {
+    scratch = g_new(uint32_t, MIN(w, d) * MIN(h, d));
+  }
+  bool success = true;
+  double ds = l ? l->downsample : 1;
+  for (int64_t row = 0; success && row < (h + d - 1) / d; row++) {
+    for (int64_t col = 0; success && col < (w + d - 1) / d; col++) {
+      // calculate surface coordinates and size
+      int64_t sx = floor(x + col * d * ds);  // level 0 plane
+      int64_t sy = floor(y + row * d * ds);  // level 0 plane
+      int64_t sw = MIN(w - col * d, d);      // level plane
+      int64_t sh = MIN(h - row * d, d);      // level plane
+      double offset_x = (sx - x) / ds - col * d;  // level plane, <= 0
+      double offset_y = (sy - y) / ds - row * d;
+      uint8_t *piece_dest = NULL;
+      if (dest) {
+        piece_dest = (uint8_t *) dest + row * d * stride + col * d * bytes;
+      }
+
+      // create the cairo surface for the dest
+      cairo_surface_t *surface;
+      if (direct && dest) {
+        surface = cairo_image_surface_create_for_data(
+                piece_dest, CAIRO_FORMAT_ARGB32, sw, sh, stride);
+      } else if (dest) {
+        memset(scratch, 0, sw * sh * 4);
+        surface = cairo_image_surface_create_for_data(
+                (unsigned char *) scratch, CAIRO_FORMAT_ARGB32,
+                sw, sh, sw * 4);
+      } else {
+        // nil surface
+        surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 0, 0);
+      }
+
+      // create the cairo context
+      cairo_t *cr = cairo_create(surface);
+      cairo_surface_destroy(surface);
+
+      // paint straight into the dest, which is already clear.  tiles
+      // painted at integer offsets are composited without cairo.
+      cairo_set_operator(cr, CAIRO_OPERATOR_SATURATE);
+      cairo_translate(cr, offset_x, offset_y);
+      success = paint_level_region(osr, cr, sx, sy, l,
+                                   ceil(sw - offset_x), ceil(sh - offset_y),
+                                   err) &&
+                _openslide_check_cairo_status(cr, err);
+      cairo_destroy(cr);
+
+      // convert the piece
+      if (success && dest &&
+          format != OPENSLIDE_PIXEL_FORMAT_ARGB32_PREMULTIPLIED) {
+        if (scratch) {
+          _openslide_convert_pixels(piece_dest, stride, format,
+                                    scratch, sw * 4, sw, sh);
+        } else {
+          _openslide_convert_pixels(piece_dest, stride, format,
+                                    (const uint32_t *) piece_dest, stride,
+                                    sw, sh);
+        }
+      }
+    }
+  }
+  g_free(scratch);
+  return success;
+}
+
+bool _openslide_read_level_region(openslide_t *osr,
+                                  void *dest,
+                                  enum openslide_pixel_format format,
+                                  int64_t stride,
+                                  int64_t x, int64_t y,
+                                  struct _openslide_level *l,
+                                  int64_t w, int64_t h,
+                                  GError **err) {
+  return read_level_region(osr, dest, format, stride, x, y, l, w, h, err);
+}
+
+bool _openslide_read_level_plane_region(openslide_t *osr,
+                                        void *dest,
+                                        enum openslide_pixel_format format,
+                                        int64_t stride,
+                                        int64_t x, int64_t y,
+                                        struct _openslide_level *l,
+                                        int64_t w, int64_t h,
+                                        GError **err) {
+  double ds = l ? l->downsample : 1;
+  return read_level_region(osr, dest, format, stride, x * ds, y * ds, l,
+                           w, h, err);
+}
+
 void openslide_read_region(openslide_t *osr,
 			   uint32_t *dest,
 			   int64_t x, int64_t y,
 			   int32_t level,
 			   int64_t w, int64_t h) {
+  openslide_read_region_format(osr, dest,
+                               OPENSLIDE_PIXEL_FORMAT_ARGB32_PREMULTIPLIED, 0,
+                               x, y, level, w, h);
+}
+
+// the mask to skip background by, if the flags ask for it
+static struct _openslide_tissue_mask *get_skip_mask(openslide_t *osr,
+                                                    uint32_t flags) {
+  if (!(flags & OPENSLIDE_READ_SKIP_BACKGROUND) ||
+      openslide_get_error(osr)) {
+    return NULL;
+  }
+  return _openslide_tissue_get_skip_mask(osr);
+}
+
+void openslide_read_region_flags(openslide_t *osr,
+                                 uint32_t *dest,
+                                 int64_t x, int64_t y,
+                                 int32_t level,
+                                 int64_t w, int64_t h,
+                                 uint32_t flags) {
+  _openslide_tissue_skip_enter(get_skip_mask(osr, flags));
+  openslide_read_region(osr, dest, x, y, level, w, h);
+  _openslide_tissue_skip_leave();
+}
+
+void openslide_read_region_format(openslide_t *osr,
+                                  void *dest,
+                                  enum openslide_pixel_format format,
+                                  int64_t stride,
+                                  int64_t x, int64_t y,
+                                  int32_t level,
+                                  int64_t w, int64_t h) {
   GError *tmp_err = NULL;
 
   if (!ensure_nonnegative_dimensions(osr, w, h)) {
     return;
   }
+  if (!_openslide_pixel_format_check_stride(format, w, &stride, &tmp_err)) {
+    _openslide_propagate_error(osr, tmp_err);
+    return;
+  }
+
+  // clear the dest
+  _openslide_clear_pixels(dest, format, stride, w, h);
+
+  // now that it's cleared, return if an error occurred
+  if (openslide_get_error(osr)) {
+    return;
+  }
+
+  struct _openslide_level *l =
+    level_in_range(osr, level) ? osr->levels[level] : NULL;
+  if (!_openslide_read_level_region(osr, dest, format, stride, x, y, l, w, h,
+                                    &tmp_err)) {
+    _openslide_propagate_error(osr, tmp_err);
+    // ensure we don't return a partial result
+    _openslide_clear_pixels(dest, format, stride, w, h);
+  }
+}
+
+void openslide_read_region_scaled(openslide_t *osr,
+                                  uint32_t *dest,
+                                  int32_t zlevel,
+                                  int64_t x, int64_t y,
+                                  int64_t w, int64_t h,
+                                  int64_t dest_w, int64_t dest_h) {
+  GError *tmp_err = NULL;
+
+  if (!ensure_nonnegative_dimensions(osr, w, h) ||
+      !ensure_nonnegative_dimensions(osr, dest_w, dest_h)) {
+    return;
+  }
 
   // clear the dest
   if (dest) {
-    memset(dest, 0, w * h * 4);
+    memset(dest, 0, dest_w * dest_h * 4);
   }
 
   // now that it's cleared, return if an error occurred
   if (openslide_get_error(osr)) {
     return;
   }
+  if (dest == NULL || w == 0 || h == 0 || dest_w == 0 || dest_h == 0) {
+    return;
+  }
 
-  // Break the work into smaller pieces if the region is large, because:
-  // 1. Cairo will not allow surfaces larger than 32767 pixels on a side.
-  // 2. cairo_push_group() creates an intermediate surface backed by a
-  //    pixman_image_t, and Pixman requires that every byte of that image
-  //    be addressable in 31 bits.
-  // 3. We would like to constrain the intermediate surface to a reasonable
-  //    amount of RAM.
-  const int64_t d = 4096;
-  double ds = openslide_get_level_downsample(osr, level);
-  for (int64_t row = 0; row < (h + d - 1) / d; row++) {
-    for (int64_t col = 0; col < (w + d - 1) / d; col++) {
-      // calculate surface coordinates and size
-      int64_t sx = x + col * d * ds;     // level 0 plane
-      int64_t sy = y + row * d * ds;     // level 0 plane
-      int64_t sw = MIN(w - col * d, d);  // level plane
-      int64_t sh = MIN(h - row * d, d);  // level plane
+  // read from the level nearest to, but no smaller than, the output
+  struct _openslide_level **levels = osr->levels;
+  int32_t level_count = osr->level_count;
+  if (osr->zlevel_count > 0) {
+    if (zlevel < 0 || zlevel >= osr->zlevel_count) {
+      return;
+    }
+    levels = osr->zlevels[zlevel]->levels;
+    level_count = osr->zlevels[zlevel]->level_count;
+  } else if (zlevel != 0) {
+    return;
+  }
+  double downsample = MIN((double) w / dest_w, (double) h / dest_h);
+  struct _openslide_level *l =
+    levels[get_best_level(levels, level_count, downsample)];
 
-      // create the cairo surface for the dest
-      cairo_surface_t *surface;
-      if (dest) {
-        surface = cairo_image_surface_create_for_data(
-                (unsigned char *) (dest + w * row * d + col * d),
-                CAIRO_FORMAT_ARGB32, sw, sh, w * 4);
-      } else {
-        // nil surface
-        surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 0, 0);
-      }
+  if (!_openslide_read_level_region_scaled(osr, dest, x, y, l, w, h,
+                                           dest_w, dest_h, &tmp_err)) {
+    _openslide_propagate_error(osr, tmp_err);
+    // ensure we don't return a partial result
+    memset(dest, 0, dest_w * dest_h * 4);
+  }
+}
 
-      // create the cairo context
-      cairo_t *cr = cairo_create(surface);
-      cairo_surface_destroy(surface);
+// after each request, if the batch has grown past this, it drops the
+// tiles not used since it last did so
+#define READ_REGIONS_RETAIN (256 * 1024 * 1024)
+
+struct read_regions_state {
+  openslide_t *osr;
+  struct _openslide_cache_batch *batch;
+  const struct openslide_region_req **order;
+  size_t count;
+  GMutex *mutex;
+  size_t next;  // next request to hand out; under mutex
+};
 
-      // paint
-      if (!read_region(osr, cr, sx, sy, level, sw, sh, &tmp_err)) {
-        cairo_destroy(cr);
-        goto OUT;
-      }
+// each thread takes the next request in order until there are none left
+static void read_regions_worker(void *data) {
+  struct read_regions_state *state = data;
 
-      // done
-      if (!_openslide_check_cairo_status(cr, &tmp_err)) {
-        cairo_destroy(cr);
-        goto OUT;
-      }
+  while (true) {
+    g_mutex_lock(state->mutex);
+    size_t i = state->next++;
+    g_mutex_unlock(state->mutex);
+    if (i >= state->count) {
+      break;
+    }
 
-      cairo_destroy(cr);
+    const struct openslide_region_req *req = state->order[i];
+    _openslide_cache_batch_enter(state->batch);
+    openslide_read_region(state->osr, req->dest, req->x, req->y,
+                          req->level, req->w, req->h);
+    _openslide_cache_batch_leave();
+
+    if (_openslide_cache_batch_get_size(state->batch) > READ_REGIONS_RETAIN) {
+      _openslide_cache_batch_age(state->batch);
     }
   }
+}
 
-OUT:
-  if (tmp_err) {
+// tiles are generally stored by level, then in raster order
+static int read_regions_compare(const void *a, const void *b) {
+  const struct openslide_region_req *ra =
+    *(const struct openslide_region_req * const *) a;
+  const struct openslide_region_req *rb =
+    *(const struct openslide_region_req * const *) b;
+
+  if (ra->level != rb->level) {
+    return ra->level < rb->level ? -1 : 1;
+  }
+  if (ra->y != rb->y) {
+    return ra->y < rb->y ? -1 : 1;
+  }
+  if (ra->x != rb->x) {
+    return ra->x < rb->x ? -1 : 1;
+  }
+  return 0;
+}
+
+void openslide_read_regions(openslide_t *osr,
+                            const struct openslide_region_req *reqs,
+                            size_t n) {
+  if (n == 0) {
+    return;
+  }
+
+  const struct openslide_region_req **order =
+    g_new(const struct openslide_region_req *, n);
+  for (size_t i = 0; i < n; i++) {
+    order[i] = &reqs[i];
+  }
+  qsort(order, n, sizeof(*order), read_regions_compare);
+
+  struct read_regions_state state = {
+    .osr = osr,
+    .batch = _openslide_cache_batch_create(),
+    .order = order,
+    .count = n,
+    .mutex = g_mutex_new(),
+  };
+  size_t threads = _openslide_workers_get_count();
+  _openslide_workers_run(read_regions_worker, &state, MIN(threads, n));
+
+  _openslide_cache_batch_destroy(state.batch);
+  g_mutex_free(state.mutex);
+  g_free(order);
+}
+
+struct async_read {
+  int64_t id;
+  openslide_t *osr;
+  uint32_t *dest;
+  int64_t x;
+  int64_t y;
+  int32_t level;
+  int64_t w;
+  int64_t h;
+  openslide_read_callback_fn callback;
+  void *user_data;
+
+  volatile gint cancelled;
+};
+
+static GMutex *async_mutex;
+static GHashTable *async_reads;  // id -> struct async_read, until finished
+static int64_t async_next_id = 1;
+
+static void async_read_run(void *data) {
+  struct async_read *req = data;
+  enum openslide_read_status status;
+  GError *tmp_err = NULL;
+
+  if (g_atomic_int_get(&req->cancelled)) {
+    status = OPENSLIDE_READ_CANCELLED;
+  } else if (openslide_get_error(req->osr)) {
+    status = OPENSLIDE_READ_FAILED;
+  } else {
+    _openslide_cancel_enter(&req->cancelled);
+    openslide_t *osr = req->osr;
+    struct _openslide_level *l =
+      level_in_range(osr, req->level) ? osr->levels[req->level] : NULL;
+    bool success =
+      _openslide_read_level_region(osr, req->dest,
+                                   OPENSLIDE_PIXEL_FORMAT_ARGB32_PREMULTIPLIED,
+                                   req->w * 4, req->x, req->y, l,
+                                   req->w, req->h, &tmp_err);
+    _openslide_cancel_leave();
+    if (success) {
+      status = OPENSLIDE_READ_COMPLETED;
+    } else if (g_error_matches(tmp_err, OPENSLIDE_ERROR,
+                               OPENSLIDE_ERROR_CANCELLED)) {
+      // not an error in the slide
+      g_clear_error(&tmp_err);
+      status = OPENSLIDE_READ_CANCELLED;
+    } else {
+      _openslide_propagate_error(req->osr, tmp_err);
+      status = OPENSLIDE_READ_FAILED;
+    }
+  }
+  if (status != OPENSLIDE_READ_COMPLETED && req->dest) {
+    memset(req->dest, 0, req->w * req->h * 4);
+  }
+
+  // forget the id before reporting
+  g_mutex_lock(async_mutex);
+  g_hash_table_remove(async_reads, &req->id);
+  g_mutex_unlock(async_mutex);
+
+  req->callback(req->id, status, req->user_data);
+  g_slice_free(struct async_read, req);
+}
+
+static gpointer async_init(gpointer data G_GNUC_UNUSED) {
+  async_mutex = g_mutex_new();
+  async_reads = g_hash_table_new(g_int64_hash, g_int64_equal);
+  return NULL;
+}
+
+int64_t openslide_read_region_async(openslide_t *osr,
+                                    uint32_t *dest,
+                                    int64_t x, int64_t y,
+                                    int32_t level,
+                                    int64_t w, int64_t h,
+                                    openslide_read_callback_fn callback,
+                                    void *user_data) {
+  static GOnce once = G_ONCE_INIT;
+  g_once(&once, async_init, NULL);
+
+  if (!ensure_nonnegative_dimensions(osr, w, h)) {
+    return -1;
+  }
+  if (openslide_get_error(osr)) {
+    if (dest) {
+      memset(dest, 0, w * h * 4);
+    }
+    return -1;
+  }
+
+  // clear the dest now, so the caller sees the same thing as on failure
+  // until the read completes
+  if (dest) {
+    memset(dest, 0, w * h * 4);
+  }
+
+  struct async_read *req = g_slice_new0(struct async_read);
+  req->osr = osr;
+  req->dest = dest;
+  req->x = x;
+  req->y = y;
+  req->level = level;
+  req->w = w;
+  req->h = h;
+  req->callback = callback;
+  req->user_data = user_data;
+
+  g_mutex_lock(async_mutex);
+  int64_t id = req->id = async_next_id++;
+  g_hash_table_insert(async_reads, &req->id, req);
+  g_mutex_unlock(async_mutex);
+
+  _openslide_workers_submit(async_read_run, req, false);
+  return id;
+}
+
+bool openslide_cancel(int64_t id) {
+  static GOnce once = G_ONCE_INIT;
+  g_once(&once, async_init, NULL);
+
+  g_mutex_lock(async_mutex);
+  struct async_read *req = g_hash_table_lookup(async_reads, &id);
+  if (req) {
+    g_atomic_int_set(&req->cancelled, 1);
+  }
+  g_mutex_unlock(async_mutex);
+  return req != NULL;
+}
+
+bool openslide_read_region_deadline(openslide_t *osr,
+                                    uint32_t *dest,
+                                    uint8_t *provisional,
+                                    int64_t x, int64_t y,
+                                    int32_t level,
+                                    int64_t w, int64_t h,
+                                    int64_t time_limit_ms) {
+  GError *tmp_err = NULL;
+
+  if (!ensure_nonnegative_dimensions(osr, w, h)) {
+    return false;
+  }
+
+  // clear the dest, and mark it all provisional until it is painted
+  if (dest) {
+    memset(dest, 0, w * h * 4);
+  }
+  if (provisional) {
+    memset(provisional, 255, w * h);
+  }
+
+  // now that it's cleared, return if an error occurred
+  if (openslide_get_error(osr)) {
+    return false;
+  }
+
+  if (!level_in_range(osr, level)) {
+    // nothing to paint, which is final
+    if (provisional) {
+      memset(provisional, 0, w * h);
+    }
+    return true;
+  }
+  struct _openslide_level *l = osr->levels[level];
+
+  struct _openslide_deadline *deadline =
+    _openslide_deadline_create(time_limit_ms);
+  _openslide_deadline_enter(deadline, true);
+  bool success =
+    _openslide_read_level_region(osr, dest,
+                                 OPENSLIDE_PIXEL_FORMAT_ARGB32_PREMULTIPLIED,
+                                 w * 4, x, y, l, w, h, &tmp_err);
+  _openslide_deadline_leave();
+
+  bool complete = false;
+  if (success) {
+    // the level plane coordinates of the dest origin, as offset by
+    // paint_level_region() for negative coordinates
+    double ds = l->downsample;
+    double origin_x = x < 0 ? -(int64_t) ((-x) / ds) : x / ds;
+    double origin_y = y < 0 ? -(int64_t) ((-y) / ds) : y / ds;
+    if (provisional) {
+      memset(provisional, 0, w * h);
+    }
+    complete = !_openslide_deadline_mark_provisional(deadline, provisional,
+                                                     origin_x, origin_y,
+                                                     w, h);
+  } else {
     _openslide_propagate_error(osr, tmp_err);
+    // ensure we don't return a partial result
     if (dest) {
-      // ensure we don't return a partial result
       memset(dest, 0, w * h * 4);
     }
   }
+  _openslide_deadline_destroy(deadline);
+  return complete;
+}
+
+
+int openslide_give_prefetch_hint(openslide_t *osr,
+				 int64_t x, int64_t y,
+				 int32_t level,
+				 int64_t w, int64_t h) {
+  if (!ensure_nonnegative_dimensions(osr, w, h)) {
+    return -1;
+  }
+  if (openslide_get_error(osr) || !level_in_range(osr, level)) {
+    return -1;
+  }
+
+  // clip negative coordinates, as for reads
+  struct _openslide_level *l = osr->levels[level];
+  if (x < 0) {
+    w -= (int64_t) ((-x) / l->downsample);
+    x = 0;
+  }
+  if (y < 0) {
+    h -= (int64_t) ((-y) / l->downsample);
+    y = 0;
+  }
+
+  return _openslide_prefetch_add(osr, l, x, y, MAX(w, 0), MAX(h, 0));
+}
+
+void openslide_cancel_prefetch_hint(openslide_t *osr, int prefetch_id) {
+  _openslide_prefetch_cancel(osr, prefetch_id);
 }
 
 
@@ -662,6 +1159,376 @@ void openslide_cairo_read_region(openslide_t *osr,
 }
 
 
+// the level of a focal plane, or NULL if out of range
+static struct _openslide_level *get_tile_level(openslide_t *osr,
+                                               int32_t zlevel,
+                                               int32_t level) {
+  if (osr->zlevel_count > 0) {
+    if (zlevel < 0 || zlevel >= osr->zlevel_count ||
+        level < 0 || level >= osr->zlevels[zlevel]->level_count) {
+      return NULL;
+    }
+    return osr->zlevels[zlevel]->levels[level];
+  }
+  if (zlevel != 0 || !level_in_range(osr, level)) {
+    return NULL;
+  }
+  return osr->levels[level];
+}
+
+openslide_tile_t *openslide_get_tile(openslide_t *osr,
+                                     int32_t zlevel, int32_t level,
+                                     int64_t col, int64_t row) {
+  GError *tmp_err = NULL;
+
+  if (openslide_get_error(osr) || osr->ops->get_tile == NULL) {
+    return NULL;
+  }
+
+  struct _openslide_level *l = get_tile_level(osr, zlevel, level);
+  if (l == NULL) {
+    return NULL;
+  }
+
+  struct _openslide_tile *tile;
+  if (!osr->ops->get_tile(osr, l, col, row, &tile, &tmp_err)) {
+    _openslide_propagate_error(osr, tmp_err);
+    return NULL;
+  }
+  return tile;
+}
+
+const uint32_t *openslide_tile_get_data(openslide_tile_t *tile) {
+  return (const uint32_t *) cairo_image_surface_get_data(tile->surface);
+}
+
+int32_t openslide_tile_get_width(openslide_tile_t *tile) {
+  return cairo_image_surface_get_width(tile->surface);
+}
+
+int32_t openslide_tile_get_height(openslide_tile_t *tile) {
+  return cairo_image_surface_get_height(tile->surface);
+}
+
+int32_t openslide_tile_get_stride(openslide_tile_t *tile) {
+  return cairo_image_surface_get_stride(tile->surface);
+}
+
+void openslide_tile_release(openslide_tile_t *tile) {
+  if (tile == NULL) {
+    return;
+  }
+  // the surface may reference the entry's data
+  cairo_surface_destroy(tile->surface);
+  if (tile->entry) {
+    _openslide_cache_entry_unref(tile->entry);
+  }
+  g_slice_free(struct _openslide_tile, tile);
+}
+
+void *openslide_read_raw_tile(openslide_t *osr,
+                              int32_t zlevel, int32_t level,
+                              int64_t col, int64_t row,
+                              int64_t *size) {
+  GError *tmp_err = NULL;
+
+  *size = 0;
+  if (openslide_get_error(osr) || osr->ops->read_raw_tile == NULL) {
+    return NULL;
+  }
+  struct _openslide_level *l = get_tile_level(osr, zlevel, level);
+  if (l == NULL) {
+    return NULL;
+  }
+
+  void *buf;
+  int32_t len;
+  if (!osr->ops->read_raw_tile(osr, l, col, row, &buf, &len, &tmp_err)) {
+    _openslide_propagate_error(osr, tmp_err);
+    return NULL;
+  }
+  if (buf) {
+    *size = len;
+  }
+  return buf;
+}
+
+void openslide_raw_tile_free(void *data) {
+  g_free(data);
+}
+
+// band height for levels without tile geometry
+#define DEFAULT_BAND_HEIGHT 256
+
+struct _openslide_band_iter {
+  openslide_t *osr;
+  struct _openslide_level *level;
+  int64_t band_h;
+  int64_t y;  // level plane
+  // tiles of the last band, in case they straddle into the next
+  struct _openslide_cache_batch *batch;
+};
+
+openslide_band_iter_t *openslide_band_iter_new(openslide_t *osr,
+                                               int32_t zlevel,
+                                               int32_t level,
+                                               int64_t band_height) {
+  if (!ensure_nonnegative_dimensions(osr, 0, band_height)) {
+    return NULL;
+  }
+  if (openslide_get_error(osr)) {
+    return NULL;
+  }
+
+  struct _openslide_level *l = get_tile_level(osr, zlevel, level);
+  if (l == NULL) {
+    return NULL;
+  }
+
+  struct _openslide_band_iter *iter = g_slice_new0(struct _openslide_band_iter);
+  iter->osr = osr;
+  iter->level = l;
+  iter->band_h = band_height;
+  if (iter->band_h == 0) {
+    iter->band_h = l->tile_h > 0 ? l->tile_h : DEFAULT_BAND_HEIGHT;
+  }
+  iter->batch = _openslide_cache_batch_create();
+  return iter;
+}
+
+int64_t openslide_band_iter_get_band_height(openslide_band_iter_t *iter) {
+  return iter->band_h;
+}
+
+int64_t openslide_band_iter_next(openslide_band_iter_t *iter,
+                                 uint32_t *dest) {
+  GError *tmp_err = NULL;
+  openslide_t *osr = iter->osr;
+  struct _openslide_level *l = iter->level;
+
+  if (openslide_get_error(osr)) {
+    return -1;
+  }
+  if (iter->y >= l->h) {
+    return 0;
+  }
+
+  // clear the band
+  int64_t rows = MIN(iter->band_h, l->h - iter->y);
+  if (dest) {
+    memset(dest, 0, l->w * rows * 4);
+  }
+
+  _openslide_cache_batch_enter(iter->batch);
+  bool success =
+    _openslide_read_level_plane_region(osr, dest,
+                                       OPENSLIDE_PIXEL_FORMAT_ARGB32_PREMULTIPLIED,
+                                       l->w * 4, 0, iter->y, l,
+                                       l->w, rows, &tmp_err);
+  _openslide_cache_batch_leave();
+  // keep this band's tiles for the next, and drop the rest
+  _openslide_cache_batch_age(iter->batch);
+
+  if (!success) {
+    _openslide_propagate_error(osr, tmp_err);
+    if (dest) {
+      // ensure we don't return a partial result
+      memset(dest, 0, l->w * rows * 4);
+    }
+    return -1;
+  }
+  iter->y += rows;
+  return rows;
+}
+
+void openslide_band_iter_free(openslide_band_iter_t *iter) {
+  if (iter == NULL) {
+    return;
+  }
+  _openslide_cache_batch_destroy(iter->batch);
+  g_slice_free(struct _openslide_band_iter, iter);
+}
+
+// tile size for openslide_foreach_tile() on levels without tile geometry
+#define FOREACH_TILE_DEFAULT_SIZE 256
+
+struct foreach_tile_state {
+  openslide_t *osr;
+  struct _openslide_level *level;
+  int64_t tile_w;
+  int64_t tile_h;
+  int64_t tiles_across;
+  int64_t tile_count;
+  openslide_tile_callback_fn callback;
+  void *user_data;
+  struct _openslide_tissue_mask *skip_mask;
+
+  GMutex *mutex;
+  int64_t next;  // next tile to hand out, in raster order
+  bool stopped;
+  GError *err;  // first error
+};
+
+// each worker takes the next tile in raster order, which is the order in
+// which most formats store them, until there are none left
+static void foreach_tile_worker(void *data) {
+  struct foreach_tile_state *state = data;
+  struct _openslide_level *l = state->level;
+  uint32_t *buf = g_new(uint32_t, state->tile_w * state->tile_h);
+
+  while (true) {
+    g_mutex_lock(state->mutex);
+    int64_t i = state->next++;
+    bool done = state->stopped || i >= state->tile_count;
+    g_mutex_unlock(state->mutex);
+    if (done) {
+      break;
+    }
+
+    // clip to the level
+    int64_t col = i % state->tiles_across;
+    int64_t row = i / state->tiles_across;
+    int64_t x = col * state->tile_w;
+    int64_t y = row * state->tile_h;
+    int64_t w = MIN(state->tile_w, l->w - x);
+    int64_t h = MIN(state->tile_h, l->h - y);
+
+    GError *tmp_err = NULL;
+    memset(buf, 0, w * h * 4);
+    _openslide_tissue_skip_enter(state->skip_mask);
+    bool success =
+      _openslide_read_level_plane_region(state->osr, buf,
+                                         OPENSLIDE_PIXEL_FORMAT_ARGB32_PREMULTIPLIED,
+                                         w * 4, x, y, l, w, h,
+                                         &tmp_err);
+    _openslide_tissue_skip_leave();
+    bool keep_going;
+    if (success) {
+      keep_going = state->callback(col, row, x, y, w, h, buf,
+                                   state->user_data);
+    } else {
+      keep_going = false;
+    }
+
+    if (!keep_going) {
+      g_mutex_lock(state->mutex);
+      state->stopped = true;
+      if (tmp_err && state->err == NULL) {
+        state->err = tmp_err;
+        tmp_err = NULL;
+      }
+      g_mutex_unlock(state->mutex);
+      g_clear_error(&tmp_err);
+    }
+  }
+
+  g_free(buf);
+}
+
+bool openslide_foreach_tile(openslide_t *osr,
+                            int32_t zlevel, int32_t level,
+                            int64_t tile_w, int64_t tile_h,
+                            openslide_tile_callback_fn callback,
+                            void *user_data,
+                            int32_t nthreads,
+                            uint32_t flags) {
+  if (!ensure_nonnegative_dimensions(osr, tile_w, tile_h)) {
+    return false;
+  }
+  if (openslide_get_error(osr)) {
+    return false;
+  }
+  struct _openslide_level *l = get_tile_level(osr, zlevel, level);
+  if (l == NULL) {
+    return false;
+  }
+
+  // default to the level's own tiles
+  if (tile_w == 0) {
+    tile_w = l->tile_w > 0 ? l->tile_w : FOREACH_TILE_DEFAULT_SIZE;
+  }
+  if (tile_h == 0) {
+    tile_h = l->tile_h > 0 ? l->tile_h : FOREACH_TILE_DEFAULT_SIZE;
+  }
+
+  int64_t tiles_across = (l->w + tile_w - 1) / tile_w;
+  int64_t tiles_down = (l->h + tile_h - 1) / tile_h;
+  struct foreach_tile_state state = {
+    .osr = osr,
+    .level = l,
+    .tile_w = tile_w,
+    .tile_h = tile_h,
+    .tiles_across = tiles_across,
+    .tile_count = tiles_across * tiles_down,
+    .callback = callback,
+    .user_data = user_data,
+    .skip_mask = get_skip_mask(osr, flags),
+    .mutex = g_mutex_new(),
+  };
+
+  _openslide_workers_run(foreach_tile_worker, &state, nthreads);
+  g_mutex_free(state.mutex);
+
+  if (state.err) {
+    _openslide_propagate_error(osr, state.err);
+    return false;
+  }
+  return !state.stopped;
+}
+
+const uint8_t *openslide_get_tissue_mask(openslide_t *osr, int32_t zlevel,
+                                         int64_t *w, int64_t *h) {
+  GError *tmp_err = NULL;
+
+  *w = -1;
+  *h = -1;
+  if (openslide_get_error(osr)) {
+    return NULL;
+  }
+  if (get_tile_level(osr, zlevel, 0) == NULL) {
+    return NULL;
+  }
+
+  const uint8_t *mask = _openslide_tissue_get_mask(osr, zlevel, w, h,
+                                                   &tmp_err);
+  if (mask == NULL) {
+    _openslide_propagate_error(osr, tmp_err);
+  }
+  return mask;
+}
+
+
+void openslide_set_cache(openslide_t *osr, openslide_cache_t *cache) {
+  if (openslide_get_error(osr)) {
+    return;
+  }
+
+  _openslide_cache_binding_set(osr->cache, cache);
+}
+
+void openslide_get_cache_stats(openslide_t *osr,
+                               openslide_cache_stats_t *stats) {
+  if (openslide_get_error(osr)) {
+    memset(stats, 0, sizeof(*stats));
+    return;
+  }
+
+  _openslide_cache_binding_get_stats(osr->cache, stats);
+  stats->skipped = _openslide_tissue_get_skipped(osr->tissue);
+}
+
+void openslide_get_level_cache_stats(openslide_t *osr,
+                                     int32_t level,
+                                     openslide_cache_stats_t *stats) {
+  if (openslide_get_error(osr) || level < 0 || level >= osr->level_count) {
+    memset(stats, 0, sizeof(*stats));
+    return;
+  }
+
+  _openslide_cache_binding_get_level_stats(osr->cache, level, stats);
+}
+
+
 const char * const *openslide_get_property_names(openslide_t *osr) {
   if (openslide_get_error(osr)) {
     return EMPTY_STRING_ARRAY;
@@ -732,6 +1599,139 @@ void openslide_read_associated_image(openslide_t *osr,
   }
 }
 
+// an associated thumbnail is used only if it shows the whole slide,
+// judging by its aspect ratio
+#define THUMBNAIL_ASPECT_TOLERANCE 0.01
+// larger thumbnails aren't remembered, since the handle would hold them
+// for its lifetime
+#define THUMBNAIL_MEMO_MAX_BYTES (4 * 1024 * 1024)
+
+static bool check_thumbnail_max_dim(openslide_t *osr, int64_t max_dim) {
+  if (max_dim < 0) {
+    GError *tmp_err = g_error_new(OPENSLIDE_ERROR, OPENSLIDE_ERROR_FAILED,
+                                  "negative thumbnail size (%"PRId64") "
+                                  "not allowed", max_dim);
+    _openslide_propagate_error(osr, tmp_err);
+    return false;
+  }
+  return true;
+}
+
+static void get_thumbnail_dimensions(openslide_t *osr, int64_t max_dim,
+                                     int64_t *w, int64_t *h) {
+  int64_t w0 = osr->levels[0]->w;
+  int64_t h0 = osr->levels[0]->h;
+  int64_t longest = MAX(w0, h0);
+  if (max_dim == 0 || longest == 0) {
+    *w = 0;
+    *h = 0;
+  } else if (max_dim >= longest) {
+    *w = w0;
+    *h = h0;
+  } else {
+    double scale = (double) max_dim / longest;
+    *w = MAX((int64_t) (w0 * scale + 0.5), 1);
+    *h = MAX((int64_t) (h0 * scale + 0.5), 1);
+  }
+}
+
+// read from whichever source needs the fewest pixels decoded
+static bool read_thumbnail(openslide_t *osr, uint32_t *dest,
+                           int64_t w, int64_t h, GError **err) {
+  if (w == 0 || h == 0) {
+    return true;
+  }
+
+  // the smallest level with enough resolution.  this includes levels
+  // which backends decode with JPEG DCT scaling.
+  int64_t w0 = osr->levels[0]->w;
+  int64_t h0 = osr->levels[0]->h;
+  double downsample = MIN((double) w0 / w, (double) h0 / h);
+  struct _openslide_level *l =
+    osr->levels[get_best_level(osr->levels, osr->level_count, downsample)];
+
+  // or the associated thumbnail, if smaller
+  struct _openslide_associated_image *img =
+    g_hash_table_lookup(osr->associated_images, "thumbnail");
+  if (img && img->w >= w && img->h >= h &&
+      img->w * img->h < l->w * l->h &&
+      fabs((double) img->w / img->h - (double) w0 / h0) <=
+      THUMBNAIL_ASPECT_TOLERANCE * w0 / h0) {
+    GError *tmp_err = NULL;
+    uint32_t *buf = g_new(uint32_t, img->w * img->h);
+    if (img->ops->get_argb_data(img, buf, &tmp_err)) {
+      _openslide_resample_image(dest, w, h, buf, img->w, img->h);
+      g_free(buf);
+      return true;
+    }
+    // fall back to the level
+    g_clear_error(&tmp_err);
+    g_free(buf);
+  }
+
+  return _openslide_read_level_region_scaled(osr, dest, 0, 0, l, w0, h0,
+                                             w, h, err);
+}
+
+void openslide_get_thumbnail_dimensions(openslide_t *osr, int64_t max_dim,
+                                        int64_t *w, int64_t *h) {
+  *w = -1;
+  *h = -1;
+
+  if (!check_thumbnail_max_dim(osr, max_dim) || openslide_get_error(osr)) {
+    return;
+  }
+
+  get_thumbnail_dimensions(osr, max_dim, w, h);
+}
+
+void openslide_get_thumbnail(openslide_t *osr, int64_t max_dim,
+                             uint32_t *dest) {
+  GError *tmp_err = NULL;
+
+  // a handle in error may have no levels to size the thumbnail by
+  if (!check_thumbnail_max_dim(osr, max_dim) || openslide_get_error(osr) ||
+      dest == NULL) {
+    return;
+  }
+
+  // clear the dest
+  int64_t w;
+  int64_t h;
+  get_thumbnail_dimensions(osr, max_dim, &w, &h);
+  memset(dest, 0, w * h * 4);
+
+  // reuse the last thumbnail
+  g_mutex_lock(osr->thumbnail_mutex);
+  bool found = osr->thumbnail && osr->thumbnail_max_dim == max_dim;
+  if (found) {
+    memcpy(dest, osr->thumbnail, w * h * 4);
+  }
+  g_mutex_unlock(osr->thumbnail_mutex);
+  if (found) {
+    return;
+  }
+
+  if (!read_thumbnail(osr, dest, w, h, &tmp_err)) {
+    _openslide_propagate_error(osr, tmp_err);
+    // ensure we don't return a partial result
+    memset(dest, 0, w * h * 4);
+    return;
+  }
+
+  gsize size = (gsize) w * h * 4;
+  if (size > THUMBNAIL_MEMO_MAX_BYTES) {
+    return;
+  }
+  uint32_t *thumbnail = g_malloc(size);
+  memcpy(thumbnail, dest, size);
+  g_mutex_lock(osr->thumbnail_mutex);
+  g_free(osr->thumbnail);
+  osr->thumbnail = thumbnail;
+  osr->thumbnail_max_dim = max_dim;
+  g_mutex_unlock(osr->thumbnail_mutex);
+}
+
 const char *openslide_get_version(void) {
   return SUFFIXED_VERSION;
 }
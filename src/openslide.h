@@ -32,6 +32,7 @@
 
 #include "openslide-features.h"
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -43,6 +44,193 @@ extern "C" {
  */
 typedef struct _openslide openslide_t;
 
+/**
+ * An OpenSlide tile cache.
+ */
+typedef struct _openslide_cache openslide_cache_t;
+
+/**
+ * A decoded native tile.
+ */
+typedef struct _openslide_tile openslide_tile_t;
+
+/**
+ * An iterator over the horizontal bands of a level.
+ */
+typedef struct _openslide_band_iter openslide_band_iter_t;
+
+/**
+ * Tile cache eviction policies.
+ */
+enum openslide_cache_policy {
+  /** Discard the least recently used tile. */
+  OPENSLIDE_CACHE_POLICY_LRU,
+  /**
+   * S3-FIFO.  Newly decoded tiles are kept on probation and are only
+   * retained if they are read again, so that a single pass over a large
+   * area of a slide does not displace tiles which are read repeatedly.
+   */
+  OPENSLIDE_CACHE_POLICY_S3FIFO,
+  /**
+   * GreedyDual-Size.  Tiles which took longer to decode, per byte, are
+   * kept longer, so that slow formats such as JPEG 2000 are not evicted
+   * to make room for tiles which are cheap to decode again.
+   */
+  OPENSLIDE_CACHE_POLICY_GREEDY_DUAL_SIZE,
+};
+
+/**
+ * Pixel formats for openslide_read_region_format().  Except for
+ * #OPENSLIDE_PIXEL_FORMAT_ARGB32_PREMULTIPLIED, pixels are stored as
+ * bytes in the order given, with straight (not premultiplied) color.
+ */
+enum openslide_pixel_format {
+  /**
+   * Premultiplied ARGB in a native-endian 32-bit word, as produced by
+   * openslide_read_region().
+   */
+  OPENSLIDE_PIXEL_FORMAT_ARGB32_PREMULTIPLIED,
+  /** Red, green, blue, alpha. */
+  OPENSLIDE_PIXEL_FORMAT_RGBA,
+  /** Blue, green, red, alpha. */
+  OPENSLIDE_PIXEL_FORMAT_BGRA,
+  /** Red, green, blue; alpha is discarded. */
+  OPENSLIDE_PIXEL_FORMAT_RGB,
+  /** 8-bit luma (Rec. 601); alpha is discarded. */
+  OPENSLIDE_PIXEL_FORMAT_GRAY8,
+};
+
+/**
+ * One region to be read by openslide_read_regions().  The fields
+ * correspond to the arguments of openslide_read_region().
+ */
+struct openslide_region_req {
+  /** The destination buffer, at least (@p w * @p h * 4) bytes long. */
+  uint32_t *dest;
+  /** The top left x-coordinate, in the level 0 reference frame. */
+  int64_t x;
+  /** The top left y-coordinate, in the level 0 reference frame. */
+  int64_t y;
+  /** The desired level. */
+  int32_t level;
+  /** The width of the region. Must be non-negative. */
+  int64_t w;
+  /** The height of the region. Must be non-negative. */
+  int64_t h;
+};
+
+/** The outcome of an asynchronous read. */
+enum openslide_read_status {
+  /** The region was read into the destination buffer. */
+  OPENSLIDE_READ_COMPLETED,
+  /** The read was cancelled; the destination buffer has been cleared. */
+  OPENSLIDE_READ_CANCELLED,
+  /**
+   * An error occurred; the destination buffer has been cleared and the
+   * error is available from openslide_get_error().
+   */
+  OPENSLIDE_READ_FAILED,
+};
+
+/** Flags changing how a region is read. */
+enum openslide_read_flags {
+  /**
+   * Don't decode tiles of any level but the smallest whose area, give or
+   * take a cell, is background in the tissue mask of the first z-level;
+   * see openslide_get_tissue_mask().  The slide's background color, or
+   * white if it has none, is painted in their place.
+   */
+  OPENSLIDE_READ_SKIP_BACKGROUND = 1 << 0,
+};
+
+/**
+ * Called when an asynchronous read finishes.
+ *
+ * Runs on a thread of the internal pool, which by default has only one.
+ * It must return promptly: it must not wait for another asynchronous
+ * read or other work of the pool, and must not close the OpenSlide
+ * object, since either may wait for work which can't run until the
+ * callback returns.
+ *
+ * @param id The request identifier returned by openslide_read_region_async().
+ * @param status The outcome of the read.
+ * @param user_data The pointer passed to openslide_read_region_async().
+ */
+typedef void (*openslide_read_callback_fn)(int64_t id,
+                                           enum openslide_read_status status,
+                                           void *user_data);
+
+/**
+ * Called by openslide_foreach_tile() for each tile of a level.
+ *
+ * @param col The tile column.
+ * @param row The tile row.
+ * @param x The left edge of the tile, in the level reference frame.
+ * @param y The top edge of the tile, in the level reference frame.
+ * @param w The width of the tile, which is smaller than requested at the
+ *          right edge of the level.
+ * @param h The height of the tile, which is smaller than requested at
+ *          the bottom edge of the level.
+ * @param data Pre-multiplied ARGB data for the tile, @p w pixels per row.
+ *             Valid only until the callback returns.
+ * @param user_data The pointer passed to openslide_foreach_tile().
+ * @return True to continue, false to stop.
+ */
+typedef bool (*openslide_tile_callback_fn)(int64_t col, int64_t row,
+                                           int64_t x, int64_t y,
+                                           int64_t w, int64_t h,
+                                           const uint32_t *data,
+                                           void *user_data);
+
+/**
+ * Tile cache statistics.  Counts cover decoded tiles in memory, since the
+ * cache was created, except where noted.
+ */
+typedef struct {
+  /** Lookups which found the tile. */
+  uint64_t hits;
+  /** Lookups which did not find the tile. */
+  uint64_t misses;
+  /** Tiles added. */
+  uint64_t insertions;
+  /** Tiles discarded to make room for others. */
+  uint64_t evictions;
+  /** Tiles not added because they were larger than the cache. */
+  uint64_t rejected;
+  /**
+   * Misses which waited for another thread already decoding the tile,
+   * rather than decoding it again.
+   */
+  uint64_t deduplicated;
+  /**
+   * Size of the tiles currently cached.  Tiles of a single color share
+   * their pixels, and count for little.
+   */
+  uint64_t bytes;
+  /** Number of tiles currently cached. */
+  uint64_t entries;
+  /**
+   * Misses which found the tile in the shared-memory tier, having been
+   * decoded by another process.
+   */
+  uint64_t shared_hits;
+  /**
+   * Memory held for decoded tiles by the whole process, including room
+   * for tiles not yet allocated or already freed.  May exceed the
+   * capacity of the caches by a few tiles of each size in use.
+   */
+  uint64_t arena_bytes;
+  /** Lookups which found the compressed tile data in the compressed tier. */
+  uint64_t compressed_hits;
+  /** Size of the compressed tile data currently cached. */
+  uint64_t compressed_bytes;
+  /**
+   * Tiles painted the background color, rather than read, by reads of
+   * this handle which skip background.  Not counted per level.
+   */
+  uint64_t skipped;
+} openslide_cache_stats_t;
+
 
 /**
  * @name Basic Usage
@@ -178,6 +366,203 @@ void openslide_read_region(openslide_t *osr,
 			   int32_t level,
 			   int64_t w, int64_t h);
 
+/**
+ * Copy pre-multiplied ARGB data from a whole slide image, with flags.
+ *
+ * Like openslide_read_region(), but changed by @p flags, which affect
+ * only this read.
+ *
+ * @param osr The OpenSlide object.
+ * @param dest The destination buffer for the ARGB data.
+ * @param x The top left x-coordinate, in the level 0 reference frame.
+ * @param y The top left y-coordinate, in the level 0 reference frame.
+ * @param level The desired level.
+ * @param w The width of the region. Must be non-negative.
+ * @param h The height of the region. Must be non-negative.
+ * @param flags A bitwise OR of #openslide_read_flags values, or 0.
+ */
+OPENSLIDE_PUBLIC()
+void openslide_read_region_flags(openslide_t *osr,
+                                 uint32_t *dest,
+                                 int64_t x, int64_t y,
+                                 int32_t level,
+                                 int64_t w, int64_t h,
+                                 uint32_t flags);
+
+/**
+ * Copy a region of a whole slide image in a chosen pixel format.
+ *
+ * Like openslide_read_region(), but the pixels are written in @p format
+ * with rows @p stride bytes apart, so the region can be read directly
+ * into a larger image or an array in the caller's layout.  Conversion
+ * happens piece by piece as the region is read, with no separate copy
+ * of the whole region.  If an error occurs or has occurred, the @p w pixels of
+ * each of the @p h rows are cleared; padding between rows is never
+ * touched.  An unknown @p format or too small a @p stride is an error,
+ * and leaves @p dest untouched.
+ *
+ * @param osr The OpenSlide object.
+ * @param dest The destination buffer, at least
+ *             (@p stride * (@p h - 1) + @p w * bytes per pixel) bytes long.
+ * @param format The pixel format to write.
+ * @param stride The distance between rows of @p dest in bytes, or 0 for
+ *               rows packed without padding.
+ * @param x The top left x-coordinate, in the level 0 reference frame.
+ * @param y The top left y-coordinate, in the level 0 reference frame.
+ * @param level The desired level.
+ * @param w The width of the region. Must be non-negative.
+ * @param h The height of the region. Must be non-negative.
+ */
+OPENSLIDE_PUBLIC()
+void openslide_read_region_format(openslide_t *osr,
+                                  void *dest,
+                                  enum openslide_pixel_format format,
+                                  int64_t stride,
+                                  int64_t x, int64_t y,
+                                  int32_t level,
+                                  int64_t w, int64_t h);
+
+/**
+ * Copy pre-multiplied ARGB data from a region of a whole slide image,
+ * scaled to a given size.
+ *
+ * The region is read from the level whose downsample is closest to, but
+ * not greater than, the scale requested, and reduced with an area
+ * filter, so that each destination pixel is the average of the source
+ * pixels it covers.  Only a few rows of the source level are held in
+ * memory at once, however large the region.  @p dest must be at least
+ * (@p dest_w * @p dest_h * 4) bytes in length.  If an error occurs or
+ * has occurred, then the memory pointed to by @p dest will be cleared.
+ *
+ * @param osr The OpenSlide object.
+ * @param dest The destination buffer for the ARGB data.
+ * @param zlevel The desired z-level, or 0 for slides without z-levels.
+ * @param x The top left x-coordinate, in the level 0 reference frame.
+ * @param y The top left y-coordinate, in the level 0 reference frame.
+ * @param w The width of the region, in the level 0 reference frame.
+ *          Must be non-negative.
+ * @param h The height of the region, in the level 0 reference frame.
+ *          Must be non-negative.
+ * @param dest_w The width of the output. Must be non-negative.
+ * @param dest_h The height of the output. Must be non-negative.
+ */
+OPENSLIDE_PUBLIC()
+void openslide_read_region_scaled(openslide_t *osr,
+                                  uint32_t *dest,
+                                  int32_t zlevel,
+                                  int64_t x, int64_t y,
+                                  int64_t w, int64_t h,
+                                  int64_t dest_w, int64_t dest_h);
+
+
+/**
+ * Copy pre-multiplied ARGB data for many regions of a whole slide image.
+ *
+ * Equivalent to calling openslide_read_region() for each request, but
+ * the regions are read in roughly the order their tiles are stored, by
+ * as many threads as openslide_set_thread_count() allows, and a tile
+ * needed by several nearby regions is decoded only once regardless of
+ * the size of the tile cache.  If an error occurs or has occurred, the
+ * destination buffers of unfinished requests are cleared.
+ *
+ * @param osr The OpenSlide object.
+ * @param reqs The regions to read.
+ * @param n The number of regions.
+ */
+OPENSLIDE_PUBLIC()
+void openslide_read_regions(openslide_t *osr,
+                            const struct openslide_region_req *reqs,
+                            size_t n);
+
+/**
+ * Start reading pre-multiplied ARGB data from a whole slide image.
+ *
+ * Like openslide_read_region(), but returns immediately and reads the
+ * region on an internal thread, from the pool sized by
+ * openslide_set_thread_count().  @p dest is cleared immediately, and
+ * must remain valid until @p callback is called.  @p callback is called
+ * exactly once, on the internal thread, when the read completes, fails,
+ * or is cancelled, and must not block or close the OpenSlide object; see
+ * #openslide_read_callback_fn.  The OpenSlide object must not be closed
+ * while reads are outstanding.
+ *
+ * @param osr The OpenSlide object.
+ * @param dest The destination buffer for the ARGB data.
+ * @param x The top left x-coordinate, in the level 0 reference frame.
+ * @param y The top left y-coordinate, in the level 0 reference frame.
+ * @param level The desired level.
+ * @param w The width of the region. Must be non-negative.
+ * @param h The height of the region. Must be non-negative.
+ * @param callback The function to call when the read finishes.
+ * @param user_data An argument for @p callback.
+ * @return A positive request identifier, or -1 if an error has occurred,
+ *         in which case @p callback will not be called.
+ */
+OPENSLIDE_PUBLIC()
+int64_t openslide_read_region_async(openslide_t *osr,
+                                    uint32_t *dest,
+                                    int64_t x, int64_t y,
+                                    int32_t level,
+                                    int64_t w, int64_t h,
+                                    openslide_read_callback_fn callback,
+                                    void *user_data);
+
+/**
+ * Cancel an asynchronous read.
+ *
+ * A read which has not started is abandoned; one in progress stops
+ * before decoding further tiles.  In either case its callback reports
+ * #OPENSLIDE_READ_CANCELLED.  A read which is already finishing may
+ * still report another status.
+ *
+ * @param id A request identifier from openslide_read_region_async().
+ * @return True if the request was still outstanding.
+ */
+OPENSLIDE_PUBLIC()
+bool openslide_cancel(int64_t id);
+
+/**
+ * Copy pre-multiplied ARGB data from a whole slide image within a time
+ * limit.
+ *
+ * Like openslide_read_region(), but tiles are decoded only while there
+ * is time to do so before @p time_limit_ms milliseconds have passed,
+ * judging by how long the slowest tile of the read has taken so far.
+ * Tiles already in the tile cache are always painted at the requested
+ * level.  Each of the others is painted instead by upsampling whichever
+ * tiles of the next smaller level are in the cache, falling back to
+ * smaller levels in turn for the rest, and left transparent if none of
+ * them are cached.  Such areas are marked provisional, so that the
+ * caller can show them at once and read them again without a time limit.
+ * A read is never interrupted partway through a tile, so the time limit
+ * may be overrun by about the time one tile takes to decode.  Only
+ * formats whose tiles are laid out on a regular grid are read this way;
+ * the tiles of others are always decoded.  If an error occurs or has
+ * occurred, then the memory pointed to by @p dest will be cleared, and
+ * the whole region marked provisional.
+ *
+ * @param osr The OpenSlide object.
+ * @param dest The destination buffer for the ARGB data.
+ * @param provisional A buffer of at least (@p w * @p h) bytes, set to 255
+ *                    for each provisional pixel and 0 for each pixel
+ *                    painted at the requested level, or NULL.
+ * @param x The top left x-coordinate, in the level 0 reference frame.
+ * @param y The top left y-coordinate, in the level 0 reference frame.
+ * @param level The desired level.
+ * @param w The width of the region. Must be non-negative.
+ * @param h The height of the region. Must be non-negative.
+ * @param time_limit_ms The time to allow for decoding, in milliseconds.
+ * @return True if the whole region was painted at the requested level,
+ *         false if any of it is provisional.
+ */
+OPENSLIDE_PUBLIC()
+bool openslide_read_region_deadline(openslide_t *osr,
+                                    uint32_t *dest,
+                                    uint8_t *provisional,
+                                    int64_t x, int64_t y,
+                                    int32_t level,
+                                    int64_t w, int64_t h,
+                                    int64_t time_limit_ms);
 
 /**
  * Close an OpenSlide object.
@@ -424,12 +809,560 @@ void openslide_read_associated_image(openslide_t *osr,
 				     uint32_t *dest);
 //@}
 
+/**
+ * @name Thumbnails
+ * Reading a small image of the whole slide.
+ */
+//@{
+
+/**
+ * Get the dimensions of the thumbnail of a whole slide image.
+ *
+ * The thumbnail has the aspect ratio of level 0 and is @p max_dim pixels
+ * on its longer side, or the size of level 0 if that is smaller.
+ *
+ * @param osr The OpenSlide object.
+ * @param max_dim The maximum width and height of the thumbnail.
+ *                Must be non-negative.
+ * @param[out] w The width of the thumbnail, or -1 if an error occurred.
+ * @param[out] h The height of the thumbnail, or -1 if an error occurred.
+ */
+OPENSLIDE_PUBLIC()
+void openslide_get_thumbnail_dimensions(openslide_t *osr, int64_t max_dim,
+                                        int64_t *w, int64_t *h);
+
+/**
+ * Copy pre-multiplied ARGB data for a thumbnail of a whole slide image.
+ *
+ * The thumbnail is scaled, with an area filter, from whichever source
+ * needs the least decoding: the smallest level with enough resolution,
+ * or an associated "thumbnail" image showing the whole slide.  A
+ * thumbnail of up to 4 MiB is remembered, so asking again for the same
+ * @p max_dim is cheap.  @p dest must be a valid pointer to enough memory to hold the
+ * thumbnail, whose dimensions are given by
+ * openslide_get_thumbnail_dimensions().  If an error occurs, then the
+ * memory pointed to by @p dest will be cleared.  If an error has already
+ * occurred, the thumbnail has no dimensions, and @p dest is not touched.
+ *
+ * @param osr The OpenSlide object.
+ * @param max_dim The maximum width and height of the thumbnail.
+ *                Must be non-negative.
+ * @param dest The destination buffer for the ARGB data.
+ */
+OPENSLIDE_PUBLIC()
+void openslide_get_thumbnail(openslide_t *osr, int64_t max_dim,
+                             uint32_t *dest);
+
+//@}
+
+/**
+ * @name Band Iteration
+ * Reading a whole level a band of rows at a time.
+ */
+//@{
+
+/**
+ * Start reading a level in horizontal bands.
+ *
+ * Each band is the full width of the level.  Tiles which straddle the
+ * boundary between two bands are decoded once, regardless of the size
+ * of the tile cache, and no more than about two bands' worth of tiles
+ * are held at once.
+ *
+ * @param osr The OpenSlide object.
+ * @param zlevel The desired z-level, or 0 for slides without z-levels.
+ * @param level The desired level.
+ * @param band_height The height of each band, or 0 for the height of
+ *                    the level's tiles.  Must be non-negative.
+ * @return The iterator, which must be freed with
+ *         openslide_band_iter_free(), or NULL if an error occurred or
+ *         the level does not exist.
+ */
+OPENSLIDE_PUBLIC()
+openslide_band_iter_t *openslide_band_iter_new(openslide_t *osr,
+                                               int32_t zlevel,
+                                               int32_t level,
+                                               int64_t band_height);
+
+/**
+ * Get the height of the bands of an iterator.  The last band may be
+ * shorter.
+ *
+ * @param iter The iterator.
+ * @return The band height.
+ */
+OPENSLIDE_PUBLIC()
+int64_t openslide_band_iter_get_band_height(openslide_band_iter_t *iter);
+
+/**
+ * Copy pre-multiplied ARGB data for the next band of a level.
+ *
+ * @p dest must be at least (level width * band height * 4) bytes long.
+ * If an error occurs or has occurred, then the rows of the band will be
+ * cleared.
+ *
+ * @param iter The iterator.
+ * @param dest The destination buffer for the ARGB data.
+ * @return The number of rows in the band, 0 once the whole level has
+ *         been read, or -1 if an error occurred.
+ */
+OPENSLIDE_PUBLIC()
+int64_t openslide_band_iter_next(openslide_band_iter_t *iter,
+                                 uint32_t *dest);
+
+/**
+ * Free a band iterator.  It must be freed before its OpenSlide object is
+ * closed.
+ *
+ * @param iter The iterator, or NULL.
+ */
+OPENSLIDE_PUBLIC()
+void openslide_band_iter_free(openslide_band_iter_t *iter);
+
+//@}
+
+/**
+ * @name Tile Iteration
+ * Visiting every tile of a level.
+ */
+//@{
+
+/**
+ * Read every tile of a level and pass each to a callback.
+ *
+ * The level is divided into a grid of @p tile_w x @p tile_h tiles, which
+ * are read in parallel in roughly the order they are stored, and handed
+ * to @p callback as they are read.  Tiles are read by the calling thread
+ * and by up to @p nthreads - 1 threads of the pool sized by
+ * openslide_set_thread_count().  The callback is called from several
+ * threads at once if more than one is reading, and tiles are not
+ * necessarily visited in order.  Reading stops
+ * early if the callback returns false or an error occurs.
+ *
+ * @param osr The OpenSlide object.
+ * @param zlevel The desired z-level, or 0 for slides without z-levels.
+ * @param level The desired level.
+ * @param tile_w The width of each tile, or 0 for the width of the
+ *               level's own tiles.  Must be non-negative.
+ * @param tile_h The height of each tile, or 0 for the height of the
+ *               level's own tiles.  Must be non-negative.
+ * @param callback The function to call for each tile.
+ * @param user_data An argument for @p callback.
+ * @param nthreads The number of threads to read with, at most.
+ * @param flags A bitwise OR of #openslide_read_flags values, or 0,
+ *              applied to the reads of the tiles.
+ * @return True if every tile was visited, false if the callback stopped
+ *         the iteration, the level does not exist, or an error occurred.
+ */
+OPENSLIDE_PUBLIC()
+bool openslide_foreach_tile(openslide_t *osr,
+                            int32_t zlevel, int32_t level,
+                            int64_t tile_w, int64_t tile_h,
+                            openslide_tile_callback_fn callback,
+                            void *user_data,
+                            int32_t nthreads,
+                            uint32_t flags);
+
+//@}
+
+/**
+ * @name Tissue Detection
+ * Finding the parts of a slide worth reading.
+ */
+//@{
+
+/**
+ * Get a mask of the tissue on a slide.
+ *
+ * The mask is computed, on first use, from the smallest level of the
+ * z-level, scaled to at most 1024 pixels on its longer side.  Stained
+ * tissue is told apart from glass by its color saturation, using a
+ * threshold chosen by Otsu's method.  Each byte of the mask covers a
+ * cell of level 0 of the same proportion as the whole mask; it is 255
+ * if the cell contains tissue and 0 if it is background.
+ *
+ * @param osr The OpenSlide object.
+ * @param zlevel The desired z-level, or 0 for slides without z-levels.
+ * @param[out] w The width of the mask, or -1 if an error occurred.
+ * @param[out] h The height of the mask, or -1 if an error occurred.
+ * @return The mask, owned by the OpenSlide object, or NULL if the
+ *         z-level does not exist or an error occurred.
+ */
+OPENSLIDE_PUBLIC()
+const uint8_t *openslide_get_tissue_mask(openslide_t *osr, int32_t zlevel,
+                                         int64_t *w, int64_t *h);
+
+//@}
+
+/**
+ * @name Native Tiles
+ * Direct access to the tiles a slide is stored in.
+ *
+ * Readers whose regions coincide with the slide's own tiles can borrow
+ * the decoded tile instead of copying it out with
+ * openslide_read_region().  When the tile comes from the tile cache the
+ * handle shares the cached buffer, which stays valid until the handle is
+ * released even if the cache evicts the tile.
+ */
+//@{
+
+/**
+ * Get a decoded native tile.
+ *
+ * For most formats, tiles are addressed by column and row, and the
+ * tile size is given by the <tt>openslide.level[N].tile-width</tt> and
+ * <tt>openslide.level[N].tile-height</tt> properties.  Formats storing
+ * tiles at irregular positions number them in file order; use @p col
+ * for the tile number and 0 for @p row.
+ *
+ * @param osr The OpenSlide object.
+ * @param zlevel The desired focal plane, or 0 for slides without
+ *               focal planes.
+ * @param level The desired level.
+ * @param col The tile column.
+ * @param row The tile row.
+ * @return The tile, which must be released with openslide_tile_release(),
+ *         or NULL if there is no such tile, the format does not support
+ *         native tile access, or an error occurred.
+ */
+OPENSLIDE_PUBLIC()
+openslide_tile_t *openslide_get_tile(openslide_t *osr,
+                                     int32_t zlevel, int32_t level,
+                                     int64_t col, int64_t row);
+
+/**
+ * Get the pre-multiplied ARGB pixels of a tile.
+ *
+ * The pixels are read-only, and are arranged in rows
+ * openslide_tile_get_stride() bytes apart.
+ *
+ * @param tile The tile.
+ * @return The pixels, valid until the tile is released.
+ */
+OPENSLIDE_PUBLIC()
+const uint32_t *openslide_tile_get_data(openslide_tile_t *tile);
+
+/**
+ * Get the width of a tile.
+ *
+ * @param tile The tile.
+ * @return The width in pixels.
+ */
+OPENSLIDE_PUBLIC()
+int32_t openslide_tile_get_width(openslide_tile_t *tile);
+
+/**
+ * Get the height of a tile.
+ *
+ * @param tile The tile.
+ * @return The height in pixels.
+ */
+OPENSLIDE_PUBLIC()
+int32_t openslide_tile_get_height(openslide_tile_t *tile);
+
+/**
+ * Get the distance between rows of a tile.
+ *
+ * @param tile The tile.
+ * @return The stride in bytes.
+ */
+OPENSLIDE_PUBLIC()
+int32_t openslide_tile_get_stride(openslide_tile_t *tile);
+
+/**
+ * Release a tile.
+ *
+ * Tiles may be released after the OpenSlide object which produced them
+ * has been closed.
+ *
+ * @param tile The tile.
+ */
+OPENSLIDE_PUBLIC()
+void openslide_tile_release(openslide_tile_t *tile);
+
+/**
+ * Read a native tile without decoding it.
+ *
+ * Tiles are addressed as for openslide_get_tile().  For levels stored
+ * as TIFF tiles in JPEG format, the tile is returned as a complete JPEG
+ * stream: shared tables are merged in and the color space is stated
+ * explicitly, so that the stream can be served to clients as is.  Tiles
+ * in the last row or column are not clipped to the level dimensions.
+ *
+ * @param osr The OpenSlide object.
+ * @param zlevel The desired focal plane, or 0 for slides without
+ *               focal planes.
+ * @param level The desired level.
+ * @param col The tile column.
+ * @param row The tile row.
+ * @param[out] size The size of the stream in bytes, or 0 if NULL is
+ *                  returned.
+ * @return The stream, which must be freed with openslide_raw_tile_free(),
+ *         or NULL if there is no such tile, it cannot be returned without
+ *         decoding, or an error occurred.
+ */
+OPENSLIDE_PUBLIC()
+void *openslide_read_raw_tile(openslide_t *osr,
+                              int32_t zlevel, int32_t level,
+                              int64_t col, int64_t row,
+                              int64_t *size);
+
+/**
+ * Free a tile returned by openslide_read_raw_tile().
+ *
+ * @param data The stream, or NULL.
+ */
+OPENSLIDE_PUBLIC()
+void openslide_raw_tile_free(void *data);
+
+//@}
+
+/**
+ * @name Caching
+ * Managing the decoded tile cache.
+ *
+ * OpenSlide keeps recently decoded tiles in a cache.  By default, all
+ * OpenSlide objects in the process share a cache of 32 MiB.  Cached tiles
+ * are identified by slide content (#OPENSLIDE_PROPERTY_NAME_QUICKHASH1),
+ * so OpenSlide objects opened on the same slide reuse each other's tiles,
+ * and tiles remain cached after the OpenSlide object that decoded them
+ * is closed.
+ */
+//@{
+
+/**
+ * Create a tile cache.
+ *
+ * The cache can be attached to any number of OpenSlide objects with
+ * openslide_set_cache().  Release it with openslide_cache_release().
+ *
+ * The cache evicts the least recently used tile when full.
+ *
+ * @param capacity The capacity of the cache, in bytes.
+ * @return A new cache.
+ */
+OPENSLIDE_PUBLIC()
+openslide_cache_t *openslide_cache_create(size_t capacity);
+
+/**
+ * Create a tile cache with the specified eviction policy.
+ *
+ * Processes which mix bulk reads of whole levels with interactive
+ * viewing may prefer #OPENSLIDE_CACHE_POLICY_S3FIFO.
+ *
+ * @param capacity The capacity of the cache, in bytes.
+ * @param policy The eviction policy.
+ * @return A new cache, or NULL if the policy is not recognized.
+ */
+OPENSLIDE_PUBLIC()
+openslide_cache_t *openslide_cache_create_with_policy(size_t capacity,
+                                                      enum openslide_cache_policy policy);
+
+/**
+ * Set the capacity of a cache's compressed tier.
+ *
+ * The compressed tier keeps tile data as it is stored in the slide file,
+ * and is consulted before reading from the file when a decoded tile is
+ * not cached.  Compressed tiles are typically many times smaller than
+ * decoded ones, so a small compressed tier can avoid most I/O for a
+ * working set much larger than the decoded tier.  Currently only used
+ * for tiled TIFF formats.  The tier is disabled by default.
+ *
+ * @param cache The cache.
+ * @param capacity The capacity of the compressed tier, in bytes, or 0
+ *                 to disable it.
+ */
+OPENSLIDE_PUBLIC()
+void openslide_cache_set_compressed_capacity(openslide_cache_t *cache,
+                                             size_t capacity);
+
+/**
+ * Give a cache a persistent tier in the specified directory.
+ *
+ * Decoded tiles are written to the directory in the background, and are
+ * read back when they are not in memory, including by later processes.
+ * Tiles are only persisted for slides with a
+ * #OPENSLIDE_PROPERTY_NAME_QUICKHASH1.  The directory is indexed when
+ * this is called, which takes time proportional to the number of tiles
+ * in it.  The directory can be shared by several processes.  Each
+ * enforces the capacity against all the tiles in the directory, as of
+ * its last periodic rescan, so the directory may briefly exceed the
+ * capacity.  The persistent tier cannot be changed once set.
+ *
+ * @param cache The cache.
+ * @param dirname The directory, which will be created if necessary.
+ * @param capacity The approximate maximum size of the directory, in bytes.
+ * @return true on success, false if the directory could not be created
+ *         or the cache already has a persistent tier.
+ */
+OPENSLIDE_PUBLIC()
+bool openslide_cache_set_persistent_dir(openslide_cache_t *cache,
+                                        const char *dirname,
+                                        size_t capacity);
+
+/**
+ * Give a cache a tier in a named shared memory segment.
+ *
+ * Decoded tiles are copied to the segment, and are read back when they
+ * are not in memory, so processes sharing the segment, such as the
+ * workers of a preforking server, decode each tile once between them.
+ * Tiles are only shared for slides with a
+ * #OPENSLIDE_PROPERTY_NAME_QUICKHASH1.  The first process to use the
+ * segment creates it with the specified capacity; others use it at
+ * whatever size it has.  When full, the oldest tiles are overwritten.
+ * The segment persists after every process has exited, until it is
+ * removed with openslide_cache_remove_shared_memory().  The shared tier
+ * cannot be changed once set.  Only supported on POSIX systems.
+ *
+ * @param cache The cache.
+ * @param name The name of the segment, as for shm_open(): a slash
+ *             followed by up to 254 other characters.
+ * @param capacity The space for tiles in a new segment, in bytes.
+ * @return true on success, false if the segment could not be created or
+ *         opened, or the cache already has a shared tier.
+ */
+OPENSLIDE_PUBLIC()
+bool openslide_cache_set_shared_memory(openslide_cache_t *cache,
+                                       const char *name,
+                                       size_t capacity);
+
+/**
+ * Remove a shared memory segment created by
+ * openslide_cache_set_shared_memory().
+ *
+ * Processes already using the segment can continue to, but later ones
+ * will create a new segment.
+ *
+ * @param name The name of the segment.
+ * @return true on success, false if the segment could not be removed.
+ */
+OPENSLIDE_PUBLIC()
+bool openslide_cache_remove_shared_memory(const char *name);
+
+/**
+ * Use the specified cache for the specified OpenSlide object.
+ *
+ * Tiles cached by the object's previous cache are not carried over.
+ * This call does nothing if an error occurred.
+ *
+ * @param osr The OpenSlide object.
+ * @param cache The cache to attach.  The OpenSlide object takes its own
+ *              reference, so the caller may release the cache at any time.
+ */
+OPENSLIDE_PUBLIC()
+void openslide_set_cache(openslide_t *osr, openslide_cache_t *cache);
+
+/**
+ * Get statistics for the cache used by an OpenSlide object.
+ *
+ * The statistics cover every OpenSlide object using the cache.  If an
+ * error occurred, all fields are zero.
+ *
+ * @param osr The OpenSlide object.
+ * @param[out] stats The statistics.
+ */
+OPENSLIDE_PUBLIC()
+void openslide_get_cache_stats(openslide_t *osr,
+                               openslide_cache_stats_t *stats);
+
+/**
+ * Get cache statistics for one level of an OpenSlide object.
+ *
+ * Lookups, insertions, and rejections are those made by this OpenSlide
+ * object.  Bytes and entries count this slide's cached tiles at this
+ * level, and are expensive to compute for a large cache.  Evictions are
+ * not tracked per level, and are always zero.  If an error occurred or
+ * the level is out of range, all fields are zero.
+ *
+ * @param osr The OpenSlide object.
+ * @param level The desired level.
+ * @param[out] stats The statistics.
+ */
+OPENSLIDE_PUBLIC()
+void openslide_get_level_cache_stats(openslide_t *osr,
+                                     int32_t level,
+                                     openslide_cache_stats_t *stats);
+
+/**
+ * Release the caller's reference to a cache.
+ *
+ * The cache is freed once it has been released and every OpenSlide
+ * object using it has been closed or attached to a different cache.
+ *
+ * @param cache The cache.
+ */
+OPENSLIDE_PUBLIC()
+void openslide_cache_release(openslide_cache_t *cache);
+
+//@}
+
+/**
+ * @name Prefetching
+ * Decoding tiles ahead of reads.
+ */
+//@{
+
+/**
+ * Hint that a region of a whole slide image will be read soon.
+ *
+ * The tiles of the region are decoded into the cache in the background,
+ * at low priority on the pool sized by openslide_set_thread_count(), so
+ * that a later openslide_read_region() finds them.  Prefetching pauses
+ * while regions of the slide are being read.  The most recent hint is
+ * decoded first, and tiles of older hints may be dropped to bound the
+ * pending work.  Prefetching is also limited by the size of the cache;
+ * tiles prefetched well ahead of their use may be evicted.
+ *
+ * @param osr The OpenSlide object.
+ * @param x The top left x-coordinate, in the level 0 reference frame.
+ * @param y The top left y-coordinate, in the level 0 reference frame.
+ * @param level The desired level.
+ * @param w The width of the region. Must be non-negative.
+ * @param h The height of the region. Must be non-negative.
+ * @return An identifier for openslide_cancel_prefetch_hint(), or -1 if
+ *         an error occurred or the level is out of range.
+ */
+OPENSLIDE_PUBLIC()
+int openslide_give_prefetch_hint(openslide_t *osr,
+				 int64_t x, int64_t y,
+				 int32_t level,
+				 int64_t w, int64_t h);
+
+/**
+ * Cancel a prefetch hint.
+ *
+ * Tiles of the region not yet decoded are skipped.  Cancelling a hint
+ * which has finished, or an unknown identifier, has no effect.
+ *
+ * @param osr The OpenSlide object.
+ * @param prefetch_id An identifier from openslide_give_prefetch_hint().
+ */
+OPENSLIDE_PUBLIC()
+void openslide_cancel_prefetch_hint(openslide_t *osr, int prefetch_id);
+
+//@}
+
 /**
  * @name Miscellaneous
  * Utility functions.
  */
 //@{
 
+/**
+ * Set the number of threads used to decode the tiles of each region.
+ *
+ * Regions spanning several tiles are decoded by a shared pool of this
+ * many threads before being composited, in the usual order, by the
+ * calling thread.  The same pool runs asynchronous reads and prefetch
+ * hints, and helps openslide_read_regions() and openslide_foreach_tile().
+ * The output is unchanged.  The default is 1, which
+ * decodes on the calling thread.
+ *
+ * @param count The number of threads.
+ */
+OPENSLIDE_PUBLIC()
+void openslide_set_thread_count(int32_t count);
+
 /**
  * Get the version of the OpenSlide library.
  *
@@ -559,17 +1492,6 @@ const char *openslide_get_comment(openslide_t *osr);
 
 //@}
 
-#ifndef OPENSLIDE_SIMPLIFY_HEADERS
-// these are meant to throw compile- and link-time errors,
-// since the functions they replace were never implemented
-int _openslide_give_prefetch_hint_UNIMPLEMENTED(void);
-void _openslide_cancel_prefetch_hint_UNIMPLEMENTED(void);
-#define openslide_give_prefetch_hint(osr, x, y, level, w, h)	\
-  _openslide_give_prefetch_hint_UNIMPLEMENTED(-1);
-#define openslide_cancel_prefetch_hint(osr, prefetch_id)	\
-  _openslide_cancel_prefetch_hint_UNIMPLEMENTED(-1)
-#endif
-
 /**
  * @mainpage OpenSlide
  *
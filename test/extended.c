@@ -21,6 +21,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 #include <inttypes.h>
 
@@ -36,6 +37,8 @@
 #include "config.h"
 
 #define MAX_LEAK_FD 128
+// the region read by checks comparing against a plain read
+#define REGION_SIZE 1024
 
 static void test_image_fetch(openslide_t *osr,
 			     int64_t x, int64_t y,
@@ -53,6 +56,603 @@ static void test_image_fetch(openslide_t *osr,
   }
 }
 
+static void check_error(openslide_t *osr, const char *what) {
+  const char *err = openslide_get_error(osr);
+  if (err) {
+    common_fail("%s failed: %s", what, err);
+  }
+}
+
+// a cache shared between handles outlives the first of them, and counts
+// what it holds
+static void test_cache(openslide_t *osr, const char *path) {
+  openslide_cache_t *cache = openslide_cache_create(64 * 1024 * 1024);
+  openslide_t *osr2 = openslide_open(path);
+  openslide_set_cache(osr, cache);
+  openslide_set_cache(osr2, cache);
+  openslide_cache_release(cache);
+  uint32_t *buf = g_new(uint32_t, 256 * 256);
+  openslide_read_region(osr2, buf, 0, 0, 0, 256, 256);
+  openslide_close(osr2);
+  openslide_read_region(osr, buf, 0, 0, 0, 256, 256);
+  check_error(osr, "Read through shared cache");
+  g_free(buf);
+
+  openslide_cache_stats_t stats;
+  openslide_get_cache_stats(osr, &stats);
+  if (stats.insertions == 0 || stats.entries == 0 || stats.bytes == 0) {
+    common_fail("Cache statistics missing insertions");
+  }
+  openslide_get_level_cache_stats(osr, 0, &stats);
+  if (stats.hits + stats.misses == 0) {
+    common_fail("Level cache statistics missing lookups");
+  }
+}
+
+// a repeated native tile read shares the cached tile, and a raw tile, if
+// the level has them, is a whole JPEG stream
+static void test_tiles(openslide_t *osr) {
+  openslide_tile_t *tile = openslide_get_tile(osr, 0, 0, 0, 0);
+  if (tile) {
+    int32_t tw = openslide_tile_get_width(tile);
+    int32_t th = openslide_tile_get_height(tile);
+    int32_t stride = openslide_tile_get_stride(tile);
+    if (tw <= 0 || th <= 0 || stride < tw * 4) {
+      common_fail("Bad tile geometry %dx%d, stride %d", tw, th, stride);
+    }
+    openslide_tile_t *tile2 = openslide_get_tile(osr, 0, 0, 0, 0);
+    if (tile2 == NULL ||
+        openslide_tile_get_stride(tile2) != stride ||
+        memcmp(openslide_tile_get_data(tile),
+               openslide_tile_get_data(tile2),
+               (int64_t) stride * th)) {
+      common_fail("Repeated tile read returned different pixels");
+    }
+    openslide_tile_release(tile2);
+    openslide_tile_release(tile);
+  }
+  check_error(osr, "Tile read");
+
+  int64_t raw_size;
+  uint8_t *raw = openslide_read_raw_tile(osr, 0, 0, 0, 0, &raw_size);
+  if (raw && (raw_size < 4 || raw[0] != 0xFF || raw[1] != 0xD8 ||
+              raw[raw_size - 2] != 0xFF || raw[raw_size - 1] != 0xD9)) {
+    common_fail("Raw tile is not a JPEG stream");
+  }
+  openslide_raw_tile_free(raw);
+  check_error(osr, "Raw tile read");
+}
+
+static void test_batched_reads(openslide_t *osr) {
+  struct openslide_region_req reqs[3];
+  for (int i = 0; i < 3; i++) {
+    reqs[i].dest = g_new(uint32_t, 300 * 200);
+    reqs[i].x = (2 - i) * 100;
+    reqs[i].y = i * 50;
+    reqs[i].level = 0;
+    reqs[i].w = 300;
+    reqs[i].h = 200;
+  }
+  openslide_read_regions(osr, reqs, 3);
+  uint32_t *buf = g_new(uint32_t, 300 * 200);
+  for (int i = 0; i < 3; i++) {
+    openslide_read_region(osr, buf, reqs[i].x, reqs[i].y, 0, 300, 200);
+    if (memcmp(buf, reqs[i].dest, 300 * 200 * 4)) {
+      common_fail("Batched read of region %d returned different pixels", i);
+    }
+    g_free(reqs[i].dest);
+  }
+  g_free(buf);
+  check_error(osr, "Batched read");
+}
+
+static void test_parallel_decoding(openslide_t *osr, const uint32_t *expected) {
+  uint32_t *buf = g_new(uint32_t, REGION_SIZE * REGION_SIZE);
+  openslide_set_thread_count(4);
+  openslide_read_region(osr, buf, 0, 0, 0, REGION_SIZE, REGION_SIZE);
+  openslide_set_thread_count(1);
+  if (memcmp(expected, buf, REGION_SIZE * REGION_SIZE * 4)) {
+    common_fail("Parallel decoding returned different pixels");
+  }
+  g_free(buf);
+  check_error(osr, "Parallel read");
+}
+
+// the bytes of premultiplied ARGB pixel p in format; returns the count
+static int convert_pixel(uint32_t p, enum openslide_pixel_format format,
+                         uint8_t *out) {
+  uint32_t a = p >> 24;
+  uint32_t rgb[3] = {(p >> 16) & 0xff, (p >> 8) & 0xff, p & 0xff};
+  for (int i = 0; i < 3; i++) {
+    rgb[i] = a ? (rgb[i] * 255 + a / 2) / a : 0;
+  }
+  switch (format) {
+  case OPENSLIDE_PIXEL_FORMAT_RGBA:
+    out[0] = rgb[0];
+    out[1] = rgb[1];
+    out[2] = rgb[2];
+    out[3] = a;
+    return 4;
+  case OPENSLIDE_PIXEL_FORMAT_BGRA:
+    out[0] = rgb[2];
+    out[1] = rgb[1];
+    out[2] = rgb[0];
+    out[3] = a;
+    return 4;
+  case OPENSLIDE_PIXEL_FORMAT_RGB:
+    out[0] = rgb[0];
+    out[1] = rgb[1];
+    out[2] = rgb[2];
+    return 3;
+  case OPENSLIDE_PIXEL_FORMAT_GRAY8:
+    out[0] = (rgb[0] * 77 + rgb[1] * 150 + rgb[2] * 29 + 128) >> 8;
+    return 1;
+  default:
+    common_fail("Unexpected pixel format %d", format);
+  }
+}
+
+// every format matches a conversion of the ARGB read, and leaves row
+// padding alone
+static void test_pixel_formats(openslide_t *osr) {
+  const int64_t w = 300;
+  const int64_t h = 200;
+  const struct {
+    enum openslide_pixel_format format;
+    const char *name;
+  } formats[] = {
+    {OPENSLIDE_PIXEL_FORMAT_RGBA, "RGBA"},
+    {OPENSLIDE_PIXEL_FORMAT_BGRA, "BGRA"},
+    {OPENSLIDE_PIXEL_FORMAT_RGB, "RGB"},
+    {OPENSLIDE_PIXEL_FORMAT_GRAY8, "GRAY8"},
+  };
+  uint32_t *argb = g_new(uint32_t, w * h);
+  openslide_read_region(osr, argb, 100, 100, 0, w, h);
+
+  for (unsigned f = 0; f < G_N_ELEMENTS(formats); f++) {
+    uint8_t expected[4];
+    int bytes = convert_pixel(0, formats[f].format, expected);
+    // padded, and for four-byte formats, painted in place
+    const int64_t stride = w * bytes + 12;
+    uint8_t *buf = g_new0(uint8_t, stride * h);
+    openslide_read_region_format(osr, buf, formats[f].format, stride,
+                                 100, 100, 0, w, h);
+    for (int64_t y = 0; y < h; y++) {
+      for (int64_t x = 0; x < w; x++) {
+        convert_pixel(argb[y * w + x], formats[f].format, expected);
+        if (memcmp(buf + y * stride + x * bytes, expected, bytes)) {
+          common_fail("%s read differs at %"PRId64", %"PRId64,
+                      formats[f].name, x, y);
+        }
+      }
+      for (int64_t i = w * bytes; i < stride; i++) {
+        if (buf[y * stride + i]) {
+          common_fail("%s read wrote into row padding", formats[f].name);
+        }
+      }
+    }
+    g_free(buf);
+  }
+
+  g_free(argb);
+  check_error(osr, "Pixel format read");
+}
+
+// at unit scale, a scaled read matches a plain one
+static void test_unscaled_read(openslide_t *osr, const uint32_t *expected) {
+  uint32_t *buf = g_new(uint32_t, REGION_SIZE * REGION_SIZE);
+  openslide_read_region_scaled(osr, buf, 0, 0, 0, REGION_SIZE, REGION_SIZE,
+                               REGION_SIZE, REGION_SIZE);
+  if (memcmp(expected, buf, REGION_SIZE * REGION_SIZE * 4)) {
+    common_fail("Unscaled read returned different pixels");
+  }
+  openslide_read_region_scaled(osr, buf, 0, 0, 0, 10000, 7500, 1000, 750);
+  g_free(buf);
+  check_error(osr, "Scaled read");
+}
+
+// a repeated thumbnail comes from the remembered copy
+static void test_thumbnail(openslide_t *osr) {
+  int64_t w, h;
+  openslide_get_thumbnail_dimensions(osr, 256, &w, &h);
+  if (w < 0 || w > 256 || h < 0 || h > 256) {
+    common_fail("Bad thumbnail dimensions %"PRId64"x%"PRId64, w, h);
+  }
+  uint32_t *thumb = g_new(uint32_t, w * h);
+  uint32_t *thumb2 = g_new(uint32_t, w * h);
+  openslide_get_thumbnail(osr, 256, thumb);
+  openslide_get_thumbnail(osr, 256, thumb2);
+  if (memcmp(thumb, thumb2, w * h * 4)) {
+    common_fail("Repeated thumbnail returned different pixels");
+  }
+  g_free(thumb2);
+  g_free(thumb);
+  check_error(osr, "Thumbnail");
+}
+
+// area-average a premultiplied image by (scale_x, scale_y), treating
+// pixels past its edges as clear.  coordinates are non-negative, so casts
+// round them down.
+static void box_filter(uint32_t *dest, int64_t dest_w, int64_t dest_h,
+                       const uint32_t *src, int64_t src_w, int64_t src_h,
+                       double scale_x, double scale_y) {
+  for (int64_t i = 0; i < dest_h; i++) {
+    double y0 = i * scale_y;
+    double y1 = y0 + scale_y;
+    int64_t y_end = MIN((int64_t) y1 + (y1 > (int64_t) y1), src_h);
+    for (int64_t j = 0; j < dest_w; j++) {
+      double x0 = j * scale_x;
+      double x1 = x0 + scale_x;
+      int64_t x_end = MIN((int64_t) x1 + (x1 > (int64_t) x1), src_w);
+      double sum[4] = {0, 0, 0, 0};
+      for (int64_t y = y0; y < y_end; y++) {
+        double wy = MIN(y1, y + 1) - MAX(y0, y);
+        for (int64_t x = x0; x < x_end; x++) {
+          double weight = wy * (MIN(x1, x + 1) - MAX(x0, x));
+          uint32_t p = src[y * src_w + x];
+          for (int c = 0; c < 4; c++) {
+            sum[c] += weight * ((p >> (c * 8)) & 0xff);
+          }
+        }
+      }
+      uint32_t p = 0;
+      for (int c = 0; c < 4; c++) {
+        p |= (uint32_t) (sum[c] / (scale_x * scale_y) + 0.5) << (c * 8);
+      }
+      dest[i * dest_w + j] = p;
+    }
+  }
+}
+
+// whether two images differ by more than rounding in any channel
+static bool pixels_differ(const uint32_t *a, const uint32_t *b, int64_t n) {
+  for (int64_t i = 0; i < n; i++) {
+    for (int c = 0; c < 4; c++) {
+      int da = (a[i] >> (c * 8)) & 0xff;
+      int db = (b[i] >> (c * 8)) & 0xff;
+      if (abs(da - db) > 2) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+struct foreach_tile_check {
+  const uint32_t *expected;  // the whole level
+  int64_t level_w;
+  GMutex *mutex;
+  int64_t pixels;
+  bool mismatch;
+};
+
+static bool check_foreach_tile(int64_t col G_GNUC_UNUSED,
+                               int64_t row G_GNUC_UNUSED,
+                               int64_t x, int64_t y, int64_t w, int64_t h,
+                               const uint32_t *data, void *user_data) {
+  struct foreach_tile_check *check = user_data;
+  bool mismatch = false;
+  for (int64_t i = 0; i < h; i++) {
+    mismatch |= memcmp(data + i * w,
+                       check->expected + (y + i) * check->level_w + x,
+                       w * 4) != 0;
+  }
+
+  g_mutex_lock(check->mutex);
+  check->pixels += w * h;
+  check->mismatch |= mismatch;
+  g_mutex_unlock(check->mutex);
+  return true;
+}
+
+// bands, tiles, and a scaled read of a whole level, against a single read
+// of it.  a level with a fractional downsample puts bands at fractional
+// level 0 coordinates, so prefer the smallest such level that is one
+// piece.
+static void test_level_iteration(openslide_t *osr) {
+  int32_t level = openslide_get_level_count(osr) - 1;
+  for (int32_t i = level; i >= 0; i--) {
+    int64_t lw, lh;
+    openslide_get_level_dimensions(osr, i, &lw, &lh);
+    double ds = openslide_get_level_downsample(osr, i);
+    if (lw > 4096 || lh > 4096) {
+      break;
+    }
+    if (ds != (int64_t) ds) {
+      level = i;
+      break;
+    }
+  }
+  double ds = openslide_get_level_downsample(osr, level);
+  int64_t w0, h0, w, h;
+  openslide_get_level0_dimensions(osr, &w0, &h0);
+  openslide_get_level_dimensions(osr, level, &w, &h);
+  uint32_t *expected = g_new(uint32_t, w * h);
+  openslide_read_region(osr, expected, 0, 0, level, w, h);
+
+  // bands
+  openslide_band_iter_t *iter = openslide_band_iter_new(osr, 0, level, 100);
+  if (iter == NULL) {
+    common_fail("Couldn't create band iterator");
+  }
+  uint32_t *band = g_new(uint32_t, w * 100);
+  int64_t y = 0;
+  int64_t rows;
+  while ((rows = openslide_band_iter_next(iter, band)) > 0) {
+    if (memcmp(band, expected + y * w, w * rows * 4)) {
+      common_fail("Band at %"PRId64" of level %d (downsample %g) "
+                  "returned different pixels", y, level, ds);
+    }
+    y += rows;
+  }
+  if (rows < 0 || y != h) {
+    common_fail("Band iteration stopped at %"PRId64, y);
+  }
+  g_free(band);
+  openslide_band_iter_free(iter);
+
+  // a scaled read from the same level, if it uses that level, against
+  // area-averaging the level
+  int64_t scaled_w = MAX(w / 2, 1);
+  int64_t scaled_h = MAX(h / 2, 1);
+  if (openslide_get_best_level_for_downsample(osr,
+          MIN((double) w0 / scaled_w, (double) h0 / scaled_h)) == level) {
+    uint32_t *scaled = g_new(uint32_t, scaled_w * scaled_h);
+    uint32_t *scaled_expected = g_new(uint32_t, scaled_w * scaled_h);
+    openslide_read_region_scaled(osr, scaled, 0, 0, 0, w0, h0,
+                                 scaled_w, scaled_h);
+    box_filter(scaled_expected, scaled_w, scaled_h, expected, w, h,
+               w0 / ds / scaled_w, h0 / ds / scaled_h);
+    if (pixels_differ(scaled, scaled_expected, scaled_w * scaled_h)) {
+      common_fail("Scaled read of level %d (downsample %g) returned "
+                  "different pixels", level, ds);
+    }
+    g_free(scaled_expected);
+    g_free(scaled);
+  }
+
+  // tiles
+  struct foreach_tile_check check = {
+    .expected = expected,
+    .level_w = w,
+    .mutex = g_mutex_new(),
+  };
+  if (!openslide_foreach_tile(osr, 0, level, 0, 0,
+                              check_foreach_tile, &check, 4, 0)) {
+    common_fail("Tile iteration failed");
+  }
+  if (check.mismatch) {
+    common_fail("Tile iteration returned different pixels");
+  }
+  if (check.pixels != w * h) {
+    common_fail("Tile iteration missed pixels");
+  }
+  g_mutex_free(check.mutex);
+  g_free(expected);
+  check_error(osr, "Level iteration");
+}
+
+struct async_wait {
+  GMutex *mutex;
+  GCond *cond;
+  int pending;
+  enum openslide_read_status status;
+};
+
+static void async_read_done(int64_t id G_GNUC_UNUSED,
+                            enum openslide_read_status status,
+                            void *user_data) {
+  struct async_wait *wait = user_data;
+  g_mutex_lock(wait->mutex);
+  wait->status = status;
+  wait->pending--;
+  g_cond_signal(wait->cond);
+  g_mutex_unlock(wait->mutex);
+}
+
+static void async_wait(struct async_wait *wait) {
+  g_mutex_lock(wait->mutex);
+  while (wait->pending) {
+    g_cond_wait(wait->cond, wait->mutex);
+  }
+  g_mutex_unlock(wait->mutex);
+}
+
+static void test_async_read(openslide_t *osr, const uint32_t *expected) {
+  uint32_t *buf = g_new(uint32_t, REGION_SIZE * REGION_SIZE);
+  struct async_wait wait = {
+    .mutex = g_mutex_new(),
+    .cond = g_cond_new(),
+    .pending = 1,
+  };
+
+  int64_t id = openslide_read_region_async(osr, buf, 0, 0, 0,
+                                           REGION_SIZE, REGION_SIZE,
+                                           async_read_done, &wait);
+  if (id <= 0) {
+    common_fail("Couldn't start asynchronous read");
+  }
+  async_wait(&wait);
+  if (wait.status != OPENSLIDE_READ_COMPLETED) {
+    common_fail("Asynchronous read failed");
+  }
+  if (memcmp(buf, expected, REGION_SIZE * REGION_SIZE * 4)) {
+    common_fail("Asynchronous read returned different pixels");
+  }
+  if (openslide_cancel(id)) {
+    common_fail("Cancelled a finished read");
+  }
+
+  // a cancelled read reports cancellation, unless it already finished
+  wait.pending = 1;
+  id = openslide_read_region_async(osr, buf, 0, 0, 0,
+                                   REGION_SIZE, REGION_SIZE,
+                                   async_read_done, &wait);
+  openslide_cancel(id);
+  async_wait(&wait);
+  if (wait.status == OPENSLIDE_READ_FAILED) {
+    common_fail("Cancelled read failed: %s", openslide_get_error(osr));
+  }
+
+  g_cond_free(wait.cond);
+  g_mutex_free(wait.mutex);
+  g_free(buf);
+}
+
+// reads while the prefetcher runs are unaffected, and once it has
+// settled, a read of the hinted region misses nothing
+static void test_prefetch(openslide_t *osr, const uint32_t *expected) {
+  uint32_t *buf = g_new(uint32_t, REGION_SIZE * REGION_SIZE);
+  int id = openslide_give_prefetch_hint(osr, 0, 0, 0,
+                                        2 * REGION_SIZE, 2 * REGION_SIZE);
+  if (id < 0) {
+    common_fail("Couldn't give prefetch hint");
+  }
+  openslide_read_region(osr, buf, 0, 0, 0, REGION_SIZE, REGION_SIZE);
+  if (memcmp(expected, buf, REGION_SIZE * REGION_SIZE * 4)) {
+    common_fail("Read during prefetch returned different pixels");
+  }
+  openslide_cancel_prefetch_hint(osr, id);
+
+  openslide_cache_t *cache = openslide_cache_create(64 * 1024 * 1024);
+  openslide_set_cache(osr, cache);
+  openslide_cache_release(cache);
+  openslide_cache_stats_t stats;
+  openslide_get_cache_stats(osr, &stats);
+  openslide_give_prefetch_hint(osr, 0, 0, 0, REGION_SIZE, REGION_SIZE);
+  uint64_t prefetched = 0;
+  for (int settled = 0, i = 0; settled < 5 && i < 200; i++) {
+    g_usleep(50000);
+    openslide_get_cache_stats(osr, &stats);
+    settled = stats.insertions == prefetched && prefetched ? settled + 1 : 0;
+    prefetched = stats.insertions;
+  }
+  if (prefetched == 0) {
+    common_fail("Prefetch hint decoded nothing");
+  }
+  uint64_t misses = stats.misses;
+  openslide_read_region(osr, buf, 0, 0, 0, REGION_SIZE, REGION_SIZE);
+  openslide_get_cache_stats(osr, &stats);
+  if (stats.misses != misses) {
+    common_fail("Read of prefetched region missed %"PRIu64" tiles",
+                stats.misses - misses);
+  }
+  if (memcmp(expected, buf, REGION_SIZE * REGION_SIZE * 4)) {
+    common_fail("Read of prefetched region returned different pixels");
+  }
+  g_free(buf);
+  check_error(osr, "Prefetch");
+}
+
+// the mask is computed once, and a read skipping background paints only
+// the background color over what it skips
+static void test_tissue_mask(openslide_t *osr, const uint32_t *expected) {
+  int64_t w, h;
+  const uint8_t *mask = openslide_get_tissue_mask(osr, 0, &w, &h);
+  if (mask == NULL || w <= 0 || w > 1024 || h <= 0 || h > 1024) {
+    common_fail("Couldn't get tissue mask");
+  }
+  for (int64_t i = 0; i < w * h; i++) {
+    if (mask[i] != 0 && mask[i] != 255) {
+      common_fail("Bad tissue mask value %d", mask[i]);
+    }
+  }
+  if (openslide_get_tissue_mask(osr, 0, &w, &h) != mask) {
+    common_fail("Tissue mask was recomputed");
+  }
+
+  uint32_t bg = 0xffffffff;
+  const char *bgcolor =
+    openslide_get_property_value(osr, OPENSLIDE_PROPERTY_NAME_BACKGROUND_COLOR);
+  if (bgcolor) {
+    bg = 0xff000000 | strtoul(bgcolor, NULL, 16);
+  }
+  uint32_t *buf = g_new(uint32_t, REGION_SIZE * REGION_SIZE);
+  openslide_read_region_flags(osr, buf, 0, 0, 0, REGION_SIZE, REGION_SIZE,
+                              OPENSLIDE_READ_SKIP_BACKGROUND);
+  check_error(osr, "Read skipping background");
+  for (int64_t i = 0; i < REGION_SIZE * REGION_SIZE; i++) {
+    if (buf[i] != expected[i] && buf[i] != bg) {
+      common_fail("Read skipping background returned different pixels");
+    }
+  }
+  // the flag applies to that read only
+  openslide_read_region(osr, buf, 0, 0, 0, REGION_SIZE, REGION_SIZE);
+  if (memcmp(expected, buf, REGION_SIZE * REGION_SIZE * 4)) {
+    common_fail("Read after skipping background returned different pixels");
+  }
+  g_free(buf);
+}
+
+// cached single-color tiles, which are painted as fills, look the same as
+// the decoded pixels, both painted directly and scaled
+static void test_solid_tiles(openslide_t *osr) {
+  uint32_t *decoded = g_new(uint32_t, REGION_SIZE * REGION_SIZE);
+  uint32_t *cached = g_new(uint32_t, REGION_SIZE * REGION_SIZE);
+  openslide_cache_t *cache = openslide_cache_create(64 * 1024 * 1024);
+  openslide_set_cache(osr, cache);
+  openslide_cache_release(cache);
+  openslide_read_region(osr, decoded, 37, 53, 0, REGION_SIZE, REGION_SIZE);
+  openslide_read_region(osr, cached, 37, 53, 0, REGION_SIZE, REGION_SIZE);
+  if (memcmp(decoded, cached, REGION_SIZE * REGION_SIZE * 4)) {
+    common_fail("Cached solid tiles were painted differently");
+  }
+
+  cache = openslide_cache_create(64 * 1024 * 1024);
+  openslide_set_cache(osr, cache);
+  openslide_cache_release(cache);
+  openslide_read_region_scaled(osr, decoded, 0, 37, 53, 1500, 1500,
+                               1000, 1000);
+  openslide_read_region_scaled(osr, cached, 0, 37, 53, 1500, 1500,
+                               1000, 1000);
+  if (memcmp(decoded, cached, 1000 * 1000 * 4)) {
+    common_fail("Cached solid tiles were scaled differently");
+  }
+  g_free(cached);
+  g_free(decoded);
+  check_error(osr, "Read of cached solid tiles");
+}
+
+// with no time, only cached tiles are final; once the whole region is
+// cached, all of it is
+static void test_deadline_read(openslide_t *osr, const uint32_t *expected) {
+  openslide_cache_t *cache = openslide_cache_create(64 * 1024 * 1024);
+  openslide_set_cache(osr, cache);
+  openslide_cache_release(cache);
+  uint32_t *buf = g_new(uint32_t, REGION_SIZE * REGION_SIZE);
+  uint8_t *provisional = g_new(uint8_t, REGION_SIZE * REGION_SIZE);
+  bool complete = openslide_read_region_deadline(osr, buf, provisional,
+                                                 0, 0, 0,
+                                                 REGION_SIZE, REGION_SIZE, 0);
+  bool marked = false;
+  for (int64_t i = 0; i < REGION_SIZE * REGION_SIZE; i++) {
+    if (provisional[i] != 0 && provisional[i] != 255) {
+      common_fail("Bad provisional mask value %d", provisional[i]);
+    }
+    marked = marked || provisional[i];
+  }
+  if (complete == marked) {
+    common_fail("Provisional mask disagrees with result");
+  }
+
+  openslide_read_region(osr, buf, 0, 0, 0, REGION_SIZE, REGION_SIZE);
+  if (!openslide_read_region_deadline(osr, buf, provisional, 0, 0, 0,
+                                      REGION_SIZE, REGION_SIZE, 0)) {
+    common_fail("Read of cached region was provisional");
+  }
+  for (int64_t i = 0; i < REGION_SIZE * REGION_SIZE; i++) {
+    if (provisional[i]) {
+      common_fail("Cached pixel marked provisional");
+    }
+  }
+  if (memcmp(expected, buf, REGION_SIZE * REGION_SIZE * 4)) {
+    common_fail("Deadline read of cached region returned different pixels");
+  }
+  g_free(provisional);
+  g_free(buf);
+  check_error(osr, "Deadline read");
+}
+
 #if !defined(NONATOMIC_CLOEXEC) && !defined(WIN32)
 static gint leak_test_running;  /* atomic ops only */
 
@@ -238,6 +838,26 @@ int main(int argc, char **argv) {
     test_image_fetch(osr, bounds_xx, bounds_yy, 200, 200);
   }
 
+  // caching, other read paths, and derived images
+  test_cache(osr, path);
+  test_tiles(osr);
+  test_batched_reads(osr);
+  test_pixel_formats(osr);
+  test_thumbnail(osr);
+  test_level_iteration(osr);
+  test_solid_tiles(osr);
+
+  // reads compared against a plain read of the same region
+  uint32_t *expected = g_new(uint32_t, REGION_SIZE * REGION_SIZE);
+  openslide_read_region(osr, expected, 0, 0, 0, REGION_SIZE, REGION_SIZE);
+  test_parallel_decoding(osr, expected);
+  test_unscaled_read(osr, expected);
+  test_async_read(osr, expected);
+  test_prefetch(osr, expected);
+  test_tissue_mask(osr, expected);
+  test_deadline_read(osr, expected);
+  g_free(expected);
+
   openslide_close(osr);
 
   check_cloexec_leaks(path, argv[0], bounds_xx, bounds_yy);
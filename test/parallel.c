@@ -20,11 +20,17 @@
  */
 
 /* Read the entirety of slide level 0, using the specified number of threads,
-   and report the runtime. */
+   and report the runtime.  If a cache size is given, read the level once
+   to warm a cache of that size, then time a second pass, so that the
+   cache hit path is measured.  Given a range of thread counts such as
+   1..32, do this for each count with a freshly opened slide, and report
+   the speedup over the first. */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
 #include <glib.h>
 #include <openslide.h>
 #include "openslide-common.h"
@@ -65,32 +71,62 @@ static void *thread_func(void *data) {
   return NULL;
 }
 
-int main(int argc, char **argv) {
-  struct state state;
+static void read_level(struct state *state, int threads,
+                       int64_t w, int64_t h) {
+  struct tile *tile;
+  int priming = 5 * threads;
+  int outstanding = 0;
 
-  common_fix_argv(&argc, &argv);
-  if (argc != 3) {
-    printf("Usage: %s <file> <threads>\n", argv[0]);
-    return 2;
+  for (int64_t y = 0; y < h; y += TILE_SIZE) {
+    for (int64_t x = 0; x < w; x += TILE_SIZE) {
+      if (priming) {
+        tile = g_slice_new(struct tile);
+        priming--;
+      } else {
+        tile = g_async_queue_pop(state->completions);
+        outstanding--;
+      }
+      tile->x = x;
+      tile->y = y;
+      g_async_queue_push(state->jobs, tile);
+      outstanding++;
+    }
   }
 
-  int threads = atoi(argv[2]);
-  if (threads < 1) {
-    printf("Invalid thread count\n");
-    return 1;
+  // wait for jobs
+  while (outstanding > 0) {
+    tile = g_async_queue_pop(state->completions);
+    g_slice_free(struct tile, tile);
+    outstanding--;
   }
+}
+
+// read the level with the given number of threads, and return the time
+// taken, or a negative value on error
+static double time_level(const char *filename, int threads,
+                         size_t cache_size, int64_t *tiles) {
+  struct state state;
 
   // open file
-  state.osr = openslide_open(argv[1]);
+  state.osr = openslide_open(filename);
   if (!state.osr) {
     printf("Unrecognized file\n");
-    return 1;
+    return -1;
   }
   const char *error = openslide_get_error(state.osr);
   if (error) {
     printf("%s\n", error);
     openslide_close(state.osr);
-    return 1;
+    return -1;
+  }
+
+  // set up cache
+  bool warm = false;
+  if (cache_size) {
+    openslide_cache_t *cache = openslide_cache_create(cache_size);
+    openslide_set_cache(state.osr, cache);
+    openslide_cache_release(cache);
+    warm = true;
   }
 
   // start threads
@@ -99,7 +135,7 @@ int main(int argc, char **argv) {
   for (int i = 0; i < threads; i++) {
     if (g_thread_create(thread_func, &state, FALSE, NULL) == NULL) {
       printf("Couldn't start thread\n");
-      return 1;
+      exit(1);
     }
   }
 
@@ -108,25 +144,17 @@ int main(int argc, char **argv) {
     g_async_queue_pop(state.completions);
   }
 
-  // enqueue jobs
-  struct tile *tile;
-  int priming = 5 * threads;
+  // read
   int64_t w, h;
   openslide_get_level0_dimensions(state.osr, &w, &h);
-  GTimer *timer = g_timer_new();
-  for (int64_t y = 0; y < h; y += TILE_SIZE) {
-    for (int64_t x = 0; x < w; x += TILE_SIZE) {
-      if (priming) {
-        tile = g_slice_new(struct tile);
-        priming--;
-      } else {
-        tile = g_async_queue_pop(state.completions);
-      }
-      tile->x = x;
-      tile->y = y;
-      g_async_queue_push(state.jobs, tile);
-    }
+  if (warm) {
+    read_level(&state, threads, w, h);
   }
+  GTimer *timer = g_timer_new();
+  read_level(&state, threads, w, h);
+  g_timer_stop(timer);
+  double seconds = g_timer_elapsed(timer, NULL);
+  *tiles = ((w + TILE_SIZE - 1) / TILE_SIZE) * ((h + TILE_SIZE - 1) / TILE_SIZE);
 
   // tell threads to stop
   for (int i = 0; i < threads; i++) {
@@ -134,30 +162,68 @@ int main(int argc, char **argv) {
   }
 
   // wait for threads
-  while (threads > 0) {
-    tile = g_async_queue_pop(state.completions);
-    if (tile == &sentinel) {
-      threads--;
-    } else {
-      g_slice_free(struct tile, tile);
-    }
+  for (int i = 0; i < threads; i++) {
+    g_async_queue_pop(state.completions);
   }
 
-  // print error or time
+  // check for error
   error = openslide_get_error(state.osr);
   if (error) {
     printf("%s\n", error);
-  } else {
-    double seconds = g_timer_elapsed(timer, NULL);
-    int tiles = (w + TILE_SIZE - 1) * (h + TILE_SIZE - 1) /
-                (TILE_SIZE * TILE_SIZE);
-    printf("%d tiles in %g seconds -> %g tiles/sec\n", tiles, seconds,
-           tiles / seconds);
+    seconds = -1;
   }
 
   // clean up
+  g_timer_destroy(timer);
   openslide_close(state.osr);
   g_async_queue_unref(state.jobs);
   g_async_queue_unref(state.completions);
+  return seconds;
+}
+
+int main(int argc, char **argv) {
+  common_fix_argv(&argc, &argv);
+  if (argc != 3 && argc != 4) {
+    printf("Usage: %s <file> <threads>[..<max-threads>] [cache-MiB]\n",
+           argv[0]);
+    return 2;
+  }
+
+  // thread count, or range of counts
+  char *end;
+  int min_threads = strtol(argv[2], &end, 10);
+  int max_threads = min_threads;
+  if (g_str_has_prefix(end, "..")) {
+    max_threads = strtol(end + 2, &end, 10);
+  }
+  if (*end || min_threads < 1 || max_threads < min_threads) {
+    printf("Invalid thread count\n");
+    return 1;
+  }
+
+  size_t cache_size = 0;
+  if (argc == 4) {
+    cache_size = (size_t) atoi(argv[3]) * 1024 * 1024;
+  }
+
+  double base_rate = 0;
+  for (int threads = min_threads; threads <= max_threads; threads++) {
+    int64_t tiles;
+    double seconds = time_level(argv[1], threads, cache_size, &tiles);
+    if (seconds < 0) {
+      return 1;
+    }
+    double rate = tiles / seconds;
+    if (min_threads == max_threads) {
+      printf("%"PRId64" tiles in %g seconds -> %g tiles/sec\n",
+             tiles, seconds, rate);
+    } else {
+      if (threads == min_threads) {
+        base_rate = rate;
+      }
+      printf("%d threads: %"PRId64" tiles in %g seconds -> %g tiles/sec, "
+             "%.2fx\n", threads, tiles, seconds, rate, rate / base_rate);
+    }
+  }
   return 0;
 }
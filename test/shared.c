@@ -0,0 +1,216 @@
+/*
+ *  OpenSlide, a library for reading whole slide image files
+ *
+ *  Copyright (c) 2026 OpenSlide contributors
+ *  All rights reserved.
+ *
+ *  OpenSlide is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation, version 2.1.
+ *
+ *  OpenSlide is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with OpenSlide. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Check that processes sharing a shared-memory tile cache reuse each
+   other's tiles.  One process reads a region of level 0 to fill the
+   shared tier, then the specified number of processes read it at once.
+   Each must hit the shared tier, and return the same pixels as a read
+   with a private cache.  Caches in process memory are kept too small to
+   hold any tiles, so every hit comes from the shared tier. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+#include <glib.h>
+#include <openslide.h>
+#include "openslide-common.h"
+
+#ifndef G_OS_WIN32
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+#define TILE_SIZE 512
+#define REGION_TILES 4
+#define SHARED_CAPACITY (256 * 1024 * 1024)
+
+// exit status of the first process if the slide can't be shared
+#define EXIT_UNSHAREABLE 77
+
+#ifndef G_OS_WIN32
+
+static openslide_t *open_slide(const char *filename, const char *shm_name) {
+  openslide_t *osr = openslide_open(filename);
+  if (!osr) {
+    common_fail("Unrecognized file");
+  }
+  const char *error = openslide_get_error(osr);
+  if (error) {
+    common_fail("%s", error);
+  }
+
+  openslide_cache_t *cache = openslide_cache_create(1);
+  if (shm_name &&
+      !openslide_cache_set_shared_memory(cache, shm_name, SHARED_CAPACITY)) {
+    common_fail("Couldn't attach shared memory segment");
+  }
+  openslide_set_cache(osr, cache);
+  openslide_cache_release(cache);
+  return osr;
+}
+
+// read the region around the center of level 0 and return its pixels
+static uint32_t *read_region(openslide_t *osr) {
+  int64_t w, h;
+  openslide_get_level0_dimensions(osr, &w, &h);
+  int64_t size = TILE_SIZE * REGION_TILES;
+  int64_t x0 = MAX(w / 2 - size / 2, 0);
+  int64_t y0 = MAX(h / 2 - size / 2, 0);
+
+  uint32_t *pixels = g_new(uint32_t, size * size);
+  uint32_t *buf = g_new(uint32_t, TILE_SIZE * TILE_SIZE);
+  for (int row = 0; row < REGION_TILES; row++) {
+    for (int col = 0; col < REGION_TILES; col++) {
+      openslide_read_region(osr, buf,
+                            x0 + col * TILE_SIZE, y0 + row * TILE_SIZE,
+                            0, TILE_SIZE, TILE_SIZE);
+      for (int y = 0; y < TILE_SIZE; y++) {
+        memcpy(pixels + (row * TILE_SIZE + y) * size + col * TILE_SIZE,
+               buf + y * TILE_SIZE, TILE_SIZE * 4);
+      }
+    }
+  }
+  g_free(buf);
+
+  const char *error = openslide_get_error(osr);
+  if (error) {
+    common_fail("Read failed: %s", error);
+  }
+  return pixels;
+}
+
+static int fill(const char *filename, const char *shm_name) {
+  openslide_t *osr = open_slide(filename, shm_name);
+  // tiles are only shared for slides with a quickhash
+  if (!openslide_get_property_value(osr,
+                                    OPENSLIDE_PROPERTY_NAME_QUICKHASH1)) {
+    openslide_close(osr);
+    return EXIT_UNSHAREABLE;
+  }
+  g_free(read_region(osr));
+  openslide_close(osr);
+  return 0;
+}
+
+static int check(const char *filename, const char *shm_name) {
+  openslide_t *osr = open_slide(filename, shm_name);
+  uint32_t *shared = read_region(osr);
+  openslide_cache_stats_t stats;
+  openslide_get_cache_stats(osr, &stats);
+  openslide_close(osr);
+  if (stats.shared_hits == 0) {
+    common_fail("No hits in shared memory (%"PRIu64" misses)", stats.misses);
+  }
+
+  osr = open_slide(filename, NULL);
+  uint32_t *private = read_region(osr);
+  openslide_close(osr);
+  int64_t size = TILE_SIZE * REGION_TILES;
+  if (memcmp(shared, private, size * size * 4)) {
+    common_fail("Shared tiles differ from decoded ones");
+  }
+
+  printf("%d: %"PRIu64" shared hits, %"PRIu64" misses\n",
+         (int) getpid(), stats.shared_hits, stats.misses);
+  g_free(private);
+  g_free(shared);
+  return 0;
+}
+
+// run fn in a new process
+static pid_t spawn(int (*fn)(const char *, const char *),
+                   const char *filename, const char *shm_name) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == -1) {
+    common_fail("Couldn't fork");
+  }
+  if (pid == 0) {
+    int ret = fn(filename, shm_name);
+    fflush(stdout);
+    _exit(ret);
+  }
+  return pid;
+}
+
+// returns the exit status, or -1 if the process didn't exit normally
+static int wait_for(pid_t pid) {
+  int status;
+  if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status)) {
+    return -1;
+  }
+  return WEXITSTATUS(status);
+}
+
+int main(int argc, char **argv) {
+  common_fix_argv(&argc, &argv);
+  if (argc != 3) {
+    printf("Usage: %s <file> <processes>\n", argv[0]);
+    return 2;
+  }
+  const char *filename = argv[1];
+  int processes = atoi(argv[2]);
+  if (processes < 1) {
+    printf("Invalid process count\n");
+    return 1;
+  }
+
+  // children do all the work, so that no library threads exist when
+  // forking
+  char *shm_name = g_strdup_printf("/openslide-test-%d", (int) getpid());
+  int status = wait_for(spawn(fill, filename, shm_name));
+  bool ok = status == 0;
+  if (ok) {
+    pid_t *pids = g_new(pid_t, processes);
+    for (int i = 0; i < processes; i++) {
+      pids[i] = spawn(check, filename, shm_name);
+    }
+    for (int i = 0; i < processes; i++) {
+      ok = wait_for(pids[i]) == 0 && ok;
+    }
+    g_free(pids);
+  }
+  openslide_cache_remove_shared_memory(shm_name);
+  g_free(shm_name);
+
+  if (status == EXIT_UNSHAREABLE) {
+    printf("Slide has no quickhash; skipping\n");
+    return 0;
+  }
+  if (!ok) {
+    printf("Failed\n");
+    return 1;
+  }
+  return 0;
+}
+
+#else
+
+int main(int argc G_GNUC_UNUSED, char **argv G_GNUC_UNUSED) {
+  printf("Shared memory caching is not supported on this platform\n");
+  return 0;
+}
+
+#endif
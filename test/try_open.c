@@ -24,6 +24,7 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
+#include <inttypes.h>
 #include <unistd.h>
 #include <glib.h>
 #include "openslide.h"
@@ -31,10 +32,20 @@
 
 #define MAX_FDS 128
 #define TIME_ITERATIONS 5
+// mean difference per channel allowed between a tile painted from a
+// coarser level and the tile itself
+#define DEADLINE_MAX_MEAN_DIFF 32
+// size of the pieces openslide_read_region() paints a large region in
+#define READ_PIECE_SIZE 4096
 
 static gchar *vendor_check;
 static gchar **prop_checks;
 static gchar **region_checks;
+static gboolean deadline_check;
+static gboolean pieces_check;
+static gboolean compressed_check;
+static gboolean raw_jpeg_check;
+static gchar **skip_background_checks;
 static gboolean time_check;
 
 static gboolean have_error = FALSE;
@@ -169,6 +180,219 @@ static void check_regions(openslide_t *osr) {
   }
 }
 
+// read the second smallest level with no time to spare, once the smallest
+// is cached, so that every tile is painted from the smallest level, and
+// check that each lands where the tile itself would.  tiles painted from
+// the wrong place show glass or other tissue.
+static void check_deadline(openslide_t *osr) {
+  int32_t level = openslide_get_level_count(osr) - 2;
+  if (have_error || level < 0) {
+    return;
+  }
+  int64_t w, h, cw, ch;
+  openslide_get_level_dimensions(osr, level, &w, &h);
+  openslide_get_level_dimensions(osr, level + 1, &cw, &ch);
+
+  openslide_cache_t *cache = openslide_cache_create(256 * 1024 * 1024);
+  openslide_set_cache(osr, cache);
+  openslide_cache_release(cache);
+  uint32_t *buf = g_new(uint32_t, MAX(w * h, cw * ch));
+  openslide_read_region(osr, buf, 0, 0, level + 1, cw, ch);
+
+  uint8_t *provisional = g_new(uint8_t, w * h);
+  openslide_read_region_deadline(osr, buf, provisional, 0, 0, level, w, h, 0);
+  uint32_t *full = g_new(uint32_t, w * h);
+  openslide_read_region(osr, full, 0, 0, level, w, h);
+  check_error(osr);
+
+  int64_t compared = 0;
+  int64_t diff = 0;
+  for (int64_t i = 0; i < w * h; i++) {
+    if (!provisional[i] || full[i] >> 24 != 0xff) {
+      continue;
+    }
+    compared++;
+    for (int shift = 0; shift < 24; shift += 8) {
+      diff += ABS((int) ((buf[i] >> shift) & 0xff) -
+                  (int) ((full[i] >> shift) & 0xff));
+    }
+  }
+  if (compared == 0) {
+    fail("Deadline read painted nothing from the coarser level");
+  } else if (diff / (compared * 3) > DEADLINE_MAX_MEAN_DIFF) {
+    fail("Deadline read painted the coarser level in the wrong place");
+  }
+
+  g_free(full);
+  g_free(provisional);
+  g_free(buf);
+}
+
+static int64_t get_tile_dimension(openslide_t *osr, int32_t level,
+                                  const char *dimension) {
+  gchar *name = g_strdup_printf("openslide.level[%d].tile-%s",
+                                level, dimension);
+  const char *value = openslide_get_property_value(osr, name);
+  g_free(name);
+  return value ? g_ascii_strtoll(value, NULL, 10) : 0;
+}
+
+// read a region spanning two pieces of a level with a fractional
+// downsample, and check the tiles on either side of the boundary against
+// the tiles themselves, each decoded whole.  every tile of a region read
+// from the level's origin lies at a whole pixel, and is copied unchanged.
+static void check_pieces(openslide_t *osr) {
+  int32_t level;
+  int64_t tw = 0, th = 0, w = 0, h = 0;
+  for (level = 0; level < openslide_get_level_count(osr); level++) {
+    double ds = openslide_get_level_downsample(osr, level);
+    tw = get_tile_dimension(osr, level, "width");
+    th = get_tile_dimension(osr, level, "height");
+    openslide_get_level_dimensions(osr, level, &w, &h);
+    if (ds != (int64_t) ds && tw > 0 && th > 0 &&
+        w >= READ_PIECE_SIZE + 2 * tw && h >= th) {
+      break;
+    }
+  }
+  if (level == openslide_get_level_count(osr)) {
+    fail("No level with a fractional downsample spans two pieces");
+    return;
+  }
+
+  int64_t first_col = READ_PIECE_SIZE / tw - 1;
+  int64_t last_col = READ_PIECE_SIZE / tw + 1;
+  int64_t rw = (last_col + 1) * tw;
+  uint32_t *buf = g_new(uint32_t, rw * th);
+  openslide_read_region(osr, buf, 0, 0, level, rw, th);
+  check_error(osr);
+
+  for (int64_t col = first_col; !have_error && col <= last_col; col++) {
+    openslide_tile_t *tile = openslide_get_tile(osr, 0, level, col, 0);
+    check_error(osr);
+    if (tile == NULL) {
+      fail("Couldn't get tile %"PRId64" of level %d", col, level);
+      break;
+    }
+    const uint32_t *data = openslide_tile_get_data(tile);
+    int32_t stride = openslide_tile_get_stride(tile) / 4;
+    int64_t cw = MIN(openslide_tile_get_width(tile), tw);
+    int64_t ch = MIN(openslide_tile_get_height(tile), th);
+    for (int64_t y = 0; y < ch; y++) {
+      if (memcmp(buf + y * rw + col * tw, data + y * stride, cw * 4)) {
+        fail("Region pieces at level %d don't line up with tile %"PRId64,
+             level, col);
+        break;
+      }
+    }
+    openslide_tile_release(tile);
+  }
+  g_free(buf);
+}
+
+// read a region twice through a compressed tier with no room for decoded
+// tiles, and check that the second read came from the tier
+static void check_compressed(openslide_t *osr) {
+  if (have_error) {
+    return;
+  }
+  uint32_t *expected = g_new(uint32_t, 256 * 256);
+  uint32_t *buf = g_new(uint32_t, 256 * 256);
+  openslide_read_region(osr, expected, 0, 0, 0, 256, 256);
+
+  openslide_cache_t *cache = openslide_cache_create(0);
+  openslide_cache_set_compressed_capacity(cache, 16 * 1024 * 1024);
+  openslide_set_cache(osr, cache);
+  openslide_cache_release(cache);
+  openslide_read_region(osr, buf, 0, 0, 0, 256, 256);
+  openslide_read_region(osr, buf, 0, 0, 0, 256, 256);
+  check_error(osr);
+  openslide_cache_stats_t stats;
+  openslide_get_cache_stats(osr, &stats);
+  if (memcmp(expected, buf, 256 * 256 * 4)) {
+    fail("Compressed tier returned different pixels");
+  } else if (stats.compressed_hits == 0 || stats.compressed_bytes == 0) {
+    fail("Compressed tier unused: %"PRIu64" hits, %"PRIu64" bytes",
+         stats.compressed_hits, stats.compressed_bytes);
+  }
+  g_free(buf);
+  g_free(expected);
+}
+
+// the first tile of level 0 can be read raw, as a whole JPEG stream
+static void check_raw_jpeg(openslide_t *osr) {
+  if (have_error) {
+    return;
+  }
+  int64_t size;
+  uint8_t *data = openslide_read_raw_tile(osr, 0, 0, 0, 0, &size);
+  check_error(osr);
+  if (data == NULL) {
+    fail("No raw tile");
+  } else if (size < 4 || data[0] != 0xFF || data[1] != 0xD8 ||
+             data[size - 2] != 0xFF || data[size - 1] != 0xD9) {
+    fail("Raw tile is not a JPEG stream");
+  }
+  openslide_raw_tile_free(data);
+}
+
+// read background regions skipping background, and check that tiles were
+// skipped and that only the background color was painted over them
+static void check_skip_background(openslide_t *osr) {
+  uint32_t bg = 0xffffffff;
+  const char *bgcolor =
+    openslide_get_property_value(osr, OPENSLIDE_PROPERTY_NAME_BACKGROUND_COLOR);
+  if (bgcolor) {
+    bg = 0xff000000 | (uint32_t) g_ascii_strtoull(bgcolor, NULL, 16);
+  }
+
+  for (gchar **check = skip_background_checks; !have_error && check && *check;
+       check++) {
+    gchar **args = g_strsplit(*check, " ", 5);
+    if (g_strv_length(args) != 5) {
+      fail("Invalid skip-background check: %s", *check);
+      g_strfreev(args);
+      return;
+    }
+    int64_t x = g_ascii_strtoll(args[0], NULL, 10);
+    int64_t y = g_ascii_strtoll(args[1], NULL, 10);
+    int32_t level = g_ascii_strtoll(args[2], NULL, 10);
+    int64_t w = g_ascii_strtoll(args[3], NULL, 10);
+    int64_t h = g_ascii_strtoll(args[4], NULL, 10);
+    g_strfreev(args);
+
+    uint32_t *expected = g_new(uint32_t, w * h);
+    uint32_t *buf = g_new(uint32_t, w * h);
+    openslide_read_region(osr, expected, x, y, level, w, h);
+    openslide_cache_stats_t stats;
+    openslide_get_cache_stats(osr, &stats);
+    uint64_t skipped = stats.skipped;
+    openslide_read_region_flags(osr, buf, x, y, level, w, h,
+                                OPENSLIDE_READ_SKIP_BACKGROUND);
+    check_error(osr);
+    openslide_get_cache_stats(osr, &stats);
+    if (stats.skipped == skipped) {
+      fail("Read of %s skipped no tiles", *check);
+    }
+    for (int64_t i = 0; !have_error && i < w * h; i++) {
+      if (buf[i] != expected[i] && buf[i] != bg) {
+        fail("Read of %s skipping background returned different pixels",
+             *check);
+      }
+    }
+
+    // the flag applies to that read only
+    openslide_get_cache_stats(osr, &stats);
+    skipped = stats.skipped;
+    openslide_read_region(osr, buf, x, y, level, w, h);
+    openslide_get_cache_stats(osr, &stats);
+    if (stats.skipped != skipped || memcmp(expected, buf, w * h * 4)) {
+      fail("Read of %s after skipping background skipped tiles", *check);
+    }
+    g_free(buf);
+    g_free(expected);
+  }
+}
+
 static GOptionEntry options[] = {
   {"vendor", 'n', 0, G_OPTION_ARG_STRING, &vendor_check,
    "Check for specified vendor (\"none\" for NULL)", "\"VENDOR\""},
@@ -176,6 +400,18 @@ static GOptionEntry options[] = {
    "Check for specified property value", "\"NAME=VALUE\""},
   {"region", 'r', 0, G_OPTION_ARG_STRING_ARRAY, &region_checks,
    "Read specified region", "\"X Y LEVEL W H\""},
+  {"deadline", 'd', 0, G_OPTION_ARG_NONE, &deadline_check,
+   "Check painting from a coarser level under a deadline", NULL},
+  {"pieces", 'P', 0, G_OPTION_ARG_NONE, &pieces_check,
+   "Check a region read in pieces against the tiles it spans", NULL},
+  {"compressed", 'c', 0, G_OPTION_ARG_NONE, &compressed_check,
+   "Check reads through the compressed tier", NULL},
+  {"raw-jpeg", 'j', 0, G_OPTION_ARG_NONE, &raw_jpeg_check,
+   "Check that tiles can be read as raw JPEG", NULL},
+  {"skip-background", 's', 0, G_OPTION_ARG_STRING_ARRAY,
+   &skip_background_checks,
+   "Read specified background region skipping background",
+   "\"X Y LEVEL W H\""},
   {"time", 't', 0, G_OPTION_ARG_NONE, &time_check,
    "Report open time", NULL},
   {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}
@@ -247,6 +483,19 @@ int main(int argc, char **argv) {
     // Check properties and regions
     check_props(osr);
     check_regions(osr);
+    if (deadline_check) {
+      check_deadline(osr);
+    }
+    if (pieces_check) {
+      check_pieces(osr);
+    }
+    if (raw_jpeg_check) {
+      check_raw_jpeg(osr);
+    }
+    check_skip_background(osr);
+    if (compressed_check) {
+      check_compressed(osr);
+    }
 
     // Close
     openslide_close(osr);
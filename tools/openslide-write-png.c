@@ -115,49 +115,15 @@ static void write_png(openslide_t *osr, FILE *f,
   double ds = openslide_get_level_downsample(osr, level);
   int32_t yy = y / ds;
   while (lines_to_draw) {
-    openslide_read_region(osr, dest,
-			  x, yy * ds, level, w, 1);
+    // read as straight RGBA, the format PNG expects
+    openslide_read_region_format(osr, dest, OPENSLIDE_PIXEL_FORMAT_RGBA, 0,
+				 x, yy * ds, level, w, 1);
 
     const char *err = openslide_get_error(osr);
     if (err) {
       fail("%s", err);
     }
 
-    // un-premultiply alpha and pack into expected format
-    for (int i = 0; i < w; i++) {
-      uint32_t p = dest[i];
-      uint8_t *p8 = (uint8_t *) (dest + i);
-
-      uint8_t a = (p >> 24) & 0xFF;
-      uint8_t r = (p >> 16) & 0xFF;
-      uint8_t g = (p >> 8) & 0xFF;
-      uint8_t b = p & 0xFF;
-
-      switch (a) {
-      case 0:
-	r = 0;
-	b = 0;
-	g = 0;
-	break;
-
-      case 255:
-	// no action
-	break;
-
-      default:
-	r = (r * 255 + a / 2) / a;
-	g = (g * 255 + a / 2) / a;
-	b = (b * 255 + a / 2) / a;
-	break;
-      }
-
-      // write back
-      p8[0] = r;
-      p8[1] = g;
-      p8[2] = b;
-      p8[3] = a;
-    }
-
     png_write_row(png_ptr, (png_bytep) dest);
     yy++;
     lines_to_draw--;